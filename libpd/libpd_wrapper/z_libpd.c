@@ -178,11 +178,19 @@ int libpd_init_audio(int inChannels, int outChannels, int sampleRate) {
 static const t_sample sample_to_short = SHRT_MAX,
                       short_to_sample = 1.0 / (t_sample) SHRT_MAX;
 
+// BarePD has neither a GUI nor sockets to poll, so don't pay for the
+// poll on every audio callback; at small block sizes this adds up.
+#ifdef BAREPD
+# define POLLGUI()
+#else
+# define POLLGUI() sys_pollgui()
+#endif
+
 #define PROCESS(_x, _y) \
   int i, j, k; \
   t_sample *p0, *p1; \
   sys_lock(); \
-  sys_pollgui(); \
+  POLLGUI(); \
   for (i = 0; i < ticks; i++) { \
     for (j = 0, p0 = STUFF->st_soundin; j < DEFDACBLKSIZE; j++, p0++) { \
       for (k = 0, p1 = p0; k < STUFF->st_inchannels; k++, p1 += DEFDACBLKSIZE) \
@@ -221,7 +229,7 @@ int libpd_process_double(const int ticks, const double *inBuffer, double *outBuf
   t_sample *p; \
   size_t i; \
   sys_lock(); \
-  sys_pollgui(); \
+  POLLGUI(); \
   for (p = STUFF->st_soundin, i = 0; i < n_in; i++) { \
     *p++ = *inBuffer++ _x; \
   } \
@@ -432,6 +440,37 @@ int libpd_message(const char *recv, const char *msg, int argc, t_atom *argv) {
   return 0;
 }
 
+t_symbol *libpd_gensym(const char *s) {
+  t_symbol *x;
+  sys_lock();
+  x = gensym(s);
+  sys_unlock();
+  return x;
+}
+
+int libpd_send_batch(int n, const t_libpd_batchmsg *msgs) {
+  int i, missing = 0;
+  sys_lock();
+  for (i = 0; i < n; i++) {
+    const t_libpd_batchmsg *m = &msgs[i];
+    t_pd *obj = m->b_recv->s_thing;
+    if (obj == NULL)
+      missing++;
+    else if (m->b_msg)
+      pd_typedmess(obj, m->b_msg, m->b_argc, m->b_argv);
+    else if (m->b_argc == 0)
+      pd_bang(obj);
+    else if (m->b_argc == 1 && m->b_argv->a_type == A_FLOAT)
+      pd_float(obj, m->b_argv->a_w.w_float);
+    else if (m->b_argc == 1 && m->b_argv->a_type == A_SYMBOL)
+      pd_symbol(obj, m->b_argv->a_w.w_symbol);
+    else
+      pd_list(obj, &s_list, m->b_argc, m->b_argv);
+  }
+  sys_unlock();
+  return missing;
+}
+
 void *libpd_bind(const char *recv) {
   t_symbol *x;
   sys_lock();
@@ -606,6 +645,68 @@ int libpd_sysrealtime(int port, int byte) {
   return 0;
 }
 
+// dispatch like libpd_noteon() and friends, without their locking
+static int libpd_domidi(const t_libpd_midimsg *m) {
+  int port = m->m_port, status = m->m_data[0], i;
+  int channel = status & 0x0f;
+  if (m->m_length < 1 || m->m_length > 3 || port < 0 || port > 0x0fff)
+    return -1;
+  if (status >= 0xf8) { // realtime
+    inmidi_realtimein(port, status);
+    return 0;
+  }
+  if (status == 0xf0 || status == 0xf7 || status < 0x80) { // SysEx
+    for (i = 0; i < m->m_length; i++)
+      inmidi_sysex(port, m->m_data[i]);
+    return 0;
+  }
+  if (status >= 0xf0) { // system common
+    for (i = 0; i < m->m_length; i++)
+      inmidi_byte(port, m->m_data[i]);
+    return 0;
+  }
+  if (m->m_length < 2 || m->m_data[1] > 0x7f ||
+      (m->m_length > 2 && m->m_data[2] > 0x7f))
+    return -1;
+  switch (status >> 4) {
+    case 0x8: // note off
+      inmidi_noteon(port, channel, m->m_data[1], 0);
+      return 0;
+    case 0x9:
+      inmidi_noteon(port, channel, m->m_data[1],
+        m->m_length > 2 ? m->m_data[2] : 0);
+      return 0;
+    case 0xa:
+      inmidi_polyaftertouch(port, channel, m->m_data[1],
+        m->m_length > 2 ? m->m_data[2] : 0);
+      return 0;
+    case 0xb:
+      inmidi_controlchange(port, channel, m->m_data[1],
+        m->m_length > 2 ? m->m_data[2] : 0);
+      return 0;
+    case 0xc:
+      inmidi_programchange(port, channel, m->m_data[1]);
+      return 0;
+    case 0xd:
+      inmidi_aftertouch(port, channel, m->m_data[1]);
+      return 0;
+    default: // 0xe, pitch bend, 0-16383 like libpd_pitchbend() + 8192
+      inmidi_pitchbend(port, channel,
+        ((m->m_length > 2 ? m->m_data[2] : 0) << 7) | m->m_data[1]);
+      return 0;
+  }
+}
+
+int libpd_midi_batch(int n, const t_libpd_midimsg *msgs) {
+  int i, malformed = 0;
+  sys_lock();
+  for (i = 0; i < n; i++)
+    if (libpd_domidi(&msgs[i]) != 0)
+      malformed++;
+  sys_unlock();
+  return malformed;
+}
+
 void libpd_set_noteonhook(const t_libpd_noteonhook hook) {
   IMP->i_hooks.h_noteonhook = hook;
 }
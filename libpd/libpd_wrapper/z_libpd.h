@@ -241,6 +241,27 @@ EXTERN int libpd_list(const char *recv, int argc, t_atom *argv);
 EXTERN int libpd_message(const char *recv, const char *msg,
     int argc, t_atom *argv);
 
+/* sending messages in batches */
+
+/// look up a receiver or message name once, for libpd_send_batch()
+/// the symbol stays valid for the lifetime of the Pd instance
+EXTERN t_symbol *libpd_gensym(const char *s);
+
+/// one message of a batch, to the receiver b_recv:
+/// with a b_msg selector, a typed message with b_argc atoms;
+/// without one (NULL), a bang for 0 atoms, a float or symbol for 1 atom,
+/// otherwise a list
+typedef struct _libpd_batchmsg {
+  t_symbol *b_recv;
+  t_symbol *b_msg;
+  int b_argc;
+  t_atom *b_argv;
+} t_libpd_batchmsg;
+
+/// send n messages in order, taking the Pd lock only once
+/// returns the number of messages whose receiver did not exist (skipped)
+EXTERN int libpd_send_batch(int n, const t_libpd_batchmsg *msgs);
+
 /* receiving messages from pd */
 
 /// subscribe to messages sent to a source receiver
@@ -427,6 +448,21 @@ EXTERN int libpd_sysex(int port, int byte);
 /// returns 0 on success or -1 if an argument is out of range
 EXTERN int libpd_sysrealtime(int port, int byte);
 
+/// one raw MIDI message of a batch: a channel message with its status byte,
+/// a system common or realtime message, or up to 3 bytes of SysEx (the
+/// first one 0xF0, 0xF7 or a data byte) as in USB MIDI event packets
+/// port is 0-indexed, length 1-3
+typedef struct _libpd_midimsg {
+  int m_port;
+  int m_length;
+  unsigned char m_data[3];
+} t_libpd_midimsg;
+
+/// send n MIDI messages in order to the MIDI input objects, taking the Pd
+/// lock only once
+/// returns the number of malformed messages (skipped)
+EXTERN int libpd_midi_batch(int n, const t_libpd_midimsg *msgs);
+
 /* receiving MIDI messages from pd */
 
 /// MIDI note on receive hook signature
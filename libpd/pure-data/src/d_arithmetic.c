@@ -10,6 +10,11 @@ to reset the value.
 
 #include "m_pd.h"
 #include <math.h> /* needed for log~ */
+#ifdef BAREPD
+#include "s_stuff.h" /* for DEFDACBLKSIZE */
+
+static t_perfroutine binop_perfblk(t_perfroutine perf8);
+#endif
 
 /* -------------- convenience routines for multichannel binops ----- */
 
@@ -20,6 +25,18 @@ to reset the value.
     with different numbers of channels. Two functions are passed, a general
     one and another that is called if the block size is a multiple of 8. */
 
+    /* choose between the general routine and the one for multiples of 8 */
+static t_perfroutine binop_perf(t_perfroutine func, t_perfroutine func8,
+    t_int n)
+{
+#ifdef BAREPD
+    t_perfroutine blk;
+    if (n == DEFDACBLKSIZE && func8 && (blk = binop_perfblk(func8)))
+        return (blk);
+#endif
+    return ((n & 7) || !func8 ? func : func8);
+}
+
 static void dsp_add_multi(t_sample *vec1, int n1, t_sample *vec2,
     int n2, t_sample *outvec, t_perfroutine func, t_perfroutine func8)
 {
@@ -29,14 +46,14 @@ static void dsp_add_multi(t_sample *vec1, int n1, t_sample *vec2,
     {
         t_int blocksize = (n2 < n1 - i*n2 ?
             n2 : n1 - i*n2);
-        dsp_add(((blocksize & 7) || !func8 ? func : func8), 4,
+        dsp_add(binop_perf(func, func8, blocksize), 4,
             vec1 + i * n2, vec2, outvec + i * n2, blocksize);
     }
     else for (i = (n1+n2-1)/n1; i--; )
     {
         t_int blocksize = (n1 < n2 - i*n1 ?
             n1 : n2 - i*n1);
-        dsp_add(((blocksize & 7) || !func8 ? func : func8), 4,
+        dsp_add(binop_perf(func, func8, blocksize), 4,
             vec1, vec2 + i*n1, outvec + i*n1, blocksize);
     }
 }
@@ -69,7 +86,7 @@ static void any_binop_dsp(t_signal **sp,
             dsp_add_multi(sp[0]->s_vec, bign0, sp[1]->s_vec, bign1,
                 sp[2]->s_vec, perf_vv, perf_vv8);
                     /* add a scalar to a vector */
-        else dsp_add(((bign0 & 7) || !perf_vs8 ? perf_vs : perf_vs8),
+        else dsp_add(binop_perf(perf_vs, perf_vs8, bign0),
             4, sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)bign0);
     }
     else /* first input is scalar */
@@ -97,7 +114,7 @@ static void any_binop_scalar_dsp(t_signal **sp, t_sample *g,
 {
     t_int bign = sp[0]->s_length * sp[0]->s_nchans;
     signal_setmultiout(&sp[1], sp[0]->s_nchans);
-    dsp_add(((bign & 7) || !perf8 ? perf : perf8),
+    dsp_add(binop_perf(perf, perf8, bign),
         4, sp[0]->s_vec, g, sp[1]->s_vec, bign);
 }
 
@@ -1158,6 +1175,130 @@ static void pow_tilde_setup(void)
     class_sethelpsymbol(scalarpow_tilde_class, gensym("binops-tilde"));
 }
 
+#ifdef BAREPD
+/* ---------- fixed-size versions of the perf8 routines (BarePD) ---------- */
+
+/* Most signals in a BarePD patch are exactly DEFDACBLKSIZE long, and that is
+fixed when the kernel is built.  These routines are the perf8 ones above with
+the vector size a constant: the compiler knows the trip count, so the loop
+needs no remainder handling and can be vectorized and unrolled as a whole.
+binop_perf() picks them, through binop_perfblk(), when the size matches. */
+
+#define BLK_PLUS(f, g) ((f) + (g))
+#define BLK_MINUS(f, g) ((f) - (g))
+#define BLK_REVERSEMINUS(f, g) ((g) - (f))
+#define BLK_TIMES(f, g) ((f) * (g))
+#define BLK_OVER(f, g) ((g) ? (f) / (g) : 0)
+#define BLK_REVERSEOVER(f, g) ((f) != 0 ? (g) / (f) : 0)
+#define BLK_MAX(f, g) ((f) > (g) ? (f) : (g))
+#define BLK_MIN(f, g) ((f) < (g) ? (f) : (g))
+
+    /* vector-vector: in1, in2, out, n */
+#define BLK_VECTOR(name, OP) \
+t_int *name(t_int *w) \
+{ \
+    t_sample *in1 = (t_sample *)(w[1]); \
+    t_sample *in2 = (t_sample *)(w[2]); \
+    t_sample *out = (t_sample *)(w[3]); \
+    int i; \
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, in1 += 8, in2 += 8, out += 8) \
+    { \
+        t_sample f0 = in1[0], f1 = in1[1], f2 = in1[2], f3 = in1[3]; \
+        t_sample f4 = in1[4], f5 = in1[5], f6 = in1[6], f7 = in1[7]; \
+        t_sample g0 = in2[0], g1 = in2[1], g2 = in2[2], g3 = in2[3]; \
+        t_sample g4 = in2[4], g5 = in2[5], g6 = in2[6], g7 = in2[7]; \
+        out[0] = OP(f0, g0); out[1] = OP(f1, g1); \
+        out[2] = OP(f2, g2); out[3] = OP(f3, g3); \
+        out[4] = OP(f4, g4); out[5] = OP(f5, g5); \
+        out[6] = OP(f6, g6); out[7] = OP(f7, g7); \
+    } \
+    return (w+5); \
+}
+
+    /* vector-scalar: in, &scalar, out, n */
+#define BLK_SCALAR(name, OP) \
+t_int *name(t_int *w) \
+{ \
+    t_sample *in = (t_sample *)(w[1]); \
+    t_float g = *(t_float *)(w[2]); \
+    t_sample *out = (t_sample *)(w[3]); \
+    int i; \
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, in += 8, out += 8) \
+    { \
+        t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3]; \
+        t_sample f4 = in[4], f5 = in[5], f6 = in[6], f7 = in[7]; \
+        out[0] = OP(f0, g); out[1] = OP(f1, g); \
+        out[2] = OP(f2, g); out[3] = OP(f3, g); \
+        out[4] = OP(f4, g); out[5] = OP(f5, g); \
+        out[6] = OP(f6, g); out[7] = OP(f7, g); \
+    } \
+    return (w+5); \
+}
+
+BLK_VECTOR(minus_perfblk, BLK_MINUS)
+BLK_VECTOR(times_perfblk, BLK_TIMES)
+BLK_VECTOR(over_perfblk, BLK_OVER)
+BLK_VECTOR(max_perfblk, BLK_MAX)
+BLK_VECTOR(min_perfblk, BLK_MIN)
+BLK_SCALAR(scalarplus_perfblk, BLK_PLUS)
+BLK_SCALAR(scalarminus_perfblk, BLK_MINUS)
+BLK_SCALAR(reversescalarminus_perfblk, BLK_REVERSEMINUS)
+BLK_SCALAR(scalartimes_perfblk, BLK_TIMES)
+BLK_SCALAR(reversescalarover_perfblk, BLK_REVERSEOVER)
+BLK_SCALAR(scalarmax_perfblk, BLK_MAX)
+BLK_SCALAR(scalarmin_perfblk, BLK_MIN)
+
+    /* scalarover_perf8() multiplies by the reciprocal */
+t_int *scalarover_perfblk(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_float g = *(t_float *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int i;
+    if (g) g = 1.f / g;
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, in += 8, out += 8)
+    {
+        t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3];
+        t_sample f4 = in[4], f5 = in[5], f6 = in[6], f7 = in[7];
+
+        out[0] = f0 * g; out[1] = f1 * g; out[2] = f2 * g; out[3] = f3 * g;
+        out[4] = f4 * g; out[5] = f5 * g; out[6] = f6 * g; out[7] = f7 * g;
+    }
+    return (w+5);
+}
+
+static const struct _binopblk
+{
+    t_perfroutine b_perf8;
+    t_perfroutine b_perfblk;
+} binop_blks[] =
+{
+    {plus_perf8, plus_perfblk},
+    {minus_perf8, minus_perfblk},
+    {times_perf8, times_perfblk},
+    {over_perf8, over_perfblk},
+    {max_perf8, max_perfblk},
+    {min_perf8, min_perfblk},
+    {scalarplus_perf8, scalarplus_perfblk},
+    {scalarminus_perf8, scalarminus_perfblk},
+    {reversescalarminus_perf8, reversescalarminus_perfblk},
+    {scalartimes_perf8, scalartimes_perfblk},
+    {scalarover_perf8, scalarover_perfblk},
+    {reversescalarover_perf8, reversescalarover_perfblk},
+    {scalarmax_perf8, scalarmax_perfblk},
+    {scalarmin_perf8, scalarmin_perfblk},
+};
+
+static t_perfroutine binop_perfblk(t_perfroutine perf8)
+{
+    unsigned int i;
+    for (i = 0; i < sizeof(binop_blks) / sizeof(*binop_blks); i++)
+        if (binop_blks[i].b_perf8 == perf8)
+            return (binop_blks[i].b_perfblk);
+    return (0);
+}
+#endif /* BAREPD */
+
 /* ----------------------- global setup routine ---------------- */
 void d_arithmetic_setup(void)
 {
@@ -15,12 +15,20 @@ typedef struct _dsparray
     t_gpointer d_gp;
     int d_phase;    /* used for tabwrite~ and tabplay~ */
     void *d_owner;  /* for pd_error() */
+#ifdef BAREPD
+    const unsigned char *d_compact; /* compact samples if d_gp has them */
+    int d_compactn;
+    int d_compactbytes;
+#endif
 } t_dsparray;
 
 typedef struct _arrayvec
 {
     int v_n;
     t_dsparray *v_vec;
+#ifdef BAREPD
+    int v_compact;  /* owner reads compact samples; set before arrayvec_init */
+#endif
 } t_arrayvec;
 
     /* LATER consider exporting this and using it for tabosc4~ too */
@@ -28,6 +36,10 @@ static int dsparray_get_array(t_dsparray *d, int *npoints, t_word **vec,
     int recover)
 {
     t_garray *a;
+#ifdef BAREPD
+    const unsigned char *cvec;
+    t_array *array;
+#endif
 
     if (gpointer_check(&d->d_gp, 0))
     {
@@ -46,6 +58,16 @@ static int dsparray_get_array(t_dsparray *d, int *npoints, t_word **vec,
             gpointer_unset(&d->d_gp);
             return 0;
         }
+#ifdef BAREPD
+            /* converting compact samples to floats takes as long as
+            loading them; perform routines (recover false) leave it to the
+            dsp method, called when garray_compactdone() rebuilds the chain */
+        else if (!recover && garray_getcompact(a, npoints, &cvec, &array))
+        {
+            gpointer_unset(&d->d_gp);
+            return 0;
+        }
+#endif
         else if (!garray_getfloatwords(a, npoints, vec))
         {
             if (d->d_owner)
@@ -55,6 +77,10 @@ static int dsparray_get_array(t_dsparray *d, int *npoints, t_word **vec,
         }
         else
         {
+#ifdef BAREPD
+                /* so that garray_compactdone() rebuilds the chain */
+            garray_usedindsp(a);
+#endif
             gpointer_setarray(&d->d_gp, garray_getarray(a), *vec);
             return 1;
         }
@@ -62,12 +88,78 @@ static int dsparray_get_array(t_dsparray *d, int *npoints, t_word **vec,
     return 0;
 }
 
+#ifdef BAREPD
+    /* like dsparray_get_array(), but for objects that can also read the
+    compact samples of arrays loaded by "soundfiler read -compact"
+    (see g_array.c).  Returns the bytes per sample, 2 or 3, with *cvec set
+    to the samples, or 1 with *vec set to the floats, or 0. */
+static int dsparray_get_samples(t_dsparray *d, int *npoints, t_word **vec,
+    const unsigned char **cvec, int recover)
+{
+    t_garray *a;
+    t_array *array;
+    int bytes;
+
+    if (gpointer_check(&d->d_gp, 0))
+    {
+        if (d->d_compact)
+        {
+            *cvec = d->d_compact;
+            *npoints = d->d_compactn;
+            return (d->d_compactbytes);
+        }
+        *vec = (t_word *)d->d_gp.gp_stub->gs_un.gs_array->a_vec;
+        *npoints = d->d_gp.gp_stub->gs_un.gs_array->a_n;
+        return (1);
+    }
+    else if ((recover || d->d_gp.gp_stub) &&
+        (a = (t_garray *)pd_findbyclass(d->d_symbol, garray_class)) &&
+            (bytes = garray_getcompact(a, npoints, cvec, &array)))
+    {
+        d->d_compact = *cvec;
+        d->d_compactn = *npoints;
+        d->d_compactbytes = bytes;
+        gpointer_setarray(&d->d_gp, array, (t_word *)array->a_vec);
+        return (bytes);
+    }
+    d->d_compact = 0;
+    return (dsparray_get_array(d, npoints, vec, recover));
+}
+
+    /* copy n compact samples from onset on */
+static void dsparray_copy_compact(t_sample *out, const unsigned char *cvec,
+    int bytes, int onset, int n)
+{
+    int i;
+    if (bytes == 2)
+    {
+        const short *sp = (const short *)cvec + onset;
+        for (i = 0; i < n; i++)
+            out[i] = COMPACT_SCALE16 * sp[i];
+    }
+    else
+    {
+        cvec += 3 * onset;
+        for (i = 0; i < n; i++)
+            out[i] = COMPACT_GET24(cvec, i);
+    }
+}
+#endif
+
 static void arrayvec_testvec(t_arrayvec *v)
 {
     int i, vecsize;
     t_word *vec;
+#ifdef BAREPD
+    const unsigned char *cvec;
+#endif
     for (i = 0; i < v->v_n; i++)
     {
+#ifdef BAREPD
+        if (*v->v_vec[i].d_symbol->s_name && v->v_compact)
+            dsparray_get_samples(&v->v_vec[i], &vecsize, &vec, &cvec, 1);
+        else
+#endif
         if (*v->v_vec[i].d_symbol->s_name)
             dsparray_get_array(&v->v_vec[i], &vecsize, &vec, 1);
     }
@@ -121,6 +213,9 @@ static void arrayvec_init(t_arrayvec *v, void *x, int rawargc, t_atom *rawargv)
         v->v_vec[i].d_owner = x;
         v->v_vec[i].d_phase = 0x7fffffff;
         gpointer_init(&v->v_vec[i].d_gp);
+#ifdef BAREPD
+        v->v_vec[i].d_compact = 0;
+#endif
     }
     arrayvec_set(v, argc, argv);
 }
@@ -278,6 +373,9 @@ static void *tabplay_tilde_new(t_symbol *s, int argc, t_atom *argv)
     x->x_clock = clock_new(x, (t_method)tabplay_tilde_tick);
     outlet_new(&x->x_obj, &s_signal);
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
+#ifdef BAREPD
+    x->x_v.v_compact = 1;
+#endif
     arrayvec_init(&x->x_v, x, argc, argv);
     x->x_limit = 0;
     return (x);
@@ -291,19 +389,37 @@ static t_int *tabplay_tilde_perform(t_int *w)
     t_word *wp;
     int n = (int)(w[4]), phase = d->d_phase, endphase, nxfer, n3;
     t_word *buf;
+#ifdef BAREPD
+    const unsigned char *cbuf;
+    int bytes = dsparray_get_samples(d, &endphase, &buf, &cbuf, 0);
 
+    if (!bytes || phase >= endphase)
+        goto zero;
+#else
     if (!dsparray_get_array(d, &endphase, &buf, 0) || phase >= endphase)
         goto zero;
+#endif
     if (endphase > x->x_limit)
         endphase = x->x_limit;
     nxfer = endphase - phase;
-    wp = buf + phase;
     if (nxfer > n)
         nxfer = n;
     n3 = n - nxfer;
-    phase += nxfer;
-    while (nxfer--)
-        *out++ = (wp++)->w_float;
+#ifdef BAREPD
+    if (bytes > 1)
+    {
+        dsparray_copy_compact(out, cbuf, bytes, phase, nxfer);
+        out += nxfer;
+        phase += nxfer;
+    }
+    else
+#endif
+    {
+        wp = buf + phase;
+        phase += nxfer;
+        while (nxfer--)
+            *out++ = (wp++)->w_float;
+    }
     if (phase >= endphase)
     {
         int i, playing = 0;
@@ -402,6 +518,9 @@ typedef struct _tabread_tilde
 static void *tabread_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_tabread_tilde *x = (t_tabread_tilde *)pd_new(tabread_tilde_class);
+#ifdef BAREPD
+    x->x_v.v_compact = 1;
+#endif
     arrayvec_init(&x->x_v, x, argc, argv);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
@@ -415,10 +534,46 @@ static t_int *tabread_tilde_perform(t_int *w)
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]), i, maxindex;
     t_word *buf;
+#ifdef BAREPD
+    const unsigned char *cbuf;
+    int bytes = dsparray_get_samples(d, &maxindex, &buf, &cbuf, 0);
 
+    if (!bytes)
+        goto zero;
+    maxindex -= 1;
+
+    if (bytes == 2)
+    {
+        const short *sp = (const short *)cbuf;
+        for (i = 0; i < n; i++)
+        {
+            int index = *in++;
+            if (index < 0)
+                index = 0;
+            else if (index > maxindex)
+                index = maxindex;
+            *out++ = COMPACT_SCALE16 * sp[index];
+        }
+        return (w+5);
+    }
+    else if (bytes == 3)
+    {
+        for (i = 0; i < n; i++)
+        {
+            int index = *in++;
+            if (index < 0)
+                index = 0;
+            else if (index > maxindex)
+                index = maxindex;
+            *out++ = COMPACT_GET24(cbuf, index);
+        }
+        return (w+5);
+    }
+#else
     if (!dsparray_get_array(d, &maxindex, &buf, 0))
         goto zero;
     maxindex -= 1;
+#endif
 
     for (i = 0; i < n; i++)
     {
@@ -485,6 +640,9 @@ typedef struct _tabread4_tilde
 static void *tabread4_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_tabread4_tilde *x = (t_tabread4_tilde *)pd_new(tabread4_tilde_class);
+#ifdef BAREPD
+    x->x_v.v_compact = 1;
+#endif
     arrayvec_init(&x->x_v, x, argc, argv);
     signalinlet_new(&x->x_obj, 0);
     outlet_new(&x->x_obj, gensym("signal"));
@@ -492,6 +650,22 @@ static void *tabread4_tilde_new(t_symbol *s, int argc, t_atom *argv)
     return (x);
 }
 
+#ifdef BAREPD
+    /* the interpolation below, for compact samples */
+static inline t_sample tabread4_tilde_interp(t_sample frac,
+    t_sample a, t_sample b, t_sample c, t_sample d)
+{
+    const t_sample one_over_six = 1./6.;
+    t_sample cminusb = c-b;
+    return (b + frac * (
+        cminusb - one_over_six * ((t_sample)1.-frac) * (
+            (d - a - (t_sample)3.0 * cminusb) * frac +
+            (d + a*(t_sample)2.0 - b*(t_sample)3.0)
+        )
+    ));
+}
+#endif
+
 static t_int *tabread4_tilde_perform(t_int *w)
 {
     t_dsparray *d = (t_dsparray *)(w[1]);
@@ -502,13 +676,62 @@ static t_int *tabread4_tilde_perform(t_int *w)
     int maxindex, i;
     t_word *buf, *wp;
     const t_sample one_over_six = 1./6.;
+#ifdef BAREPD
+    const unsigned char *cbuf;
+    int bytes = dsparray_get_samples(d, &maxindex, &buf, &cbuf, 0);
+
+    if (!bytes)
+        goto zero;
+
+    maxindex -= 3;
+    if (maxindex < 1)
+        goto zero;
 
+    if (bytes == 2)
+    {
+        const short *sp = (const short *)cbuf;
+        for (i = 0; i < n; i++)
+        {
+            double findex = (double)*in++ + (double)*onset++;
+            int index = findex;
+            t_sample frac;
+            if (index < 1)
+                index = 1, frac = 0;
+            else if (index > maxindex)
+                index = maxindex, frac = 1;
+            else frac = findex - index;
+            *out++ = tabread4_tilde_interp(frac,
+                COMPACT_SCALE16 * sp[index-1], COMPACT_SCALE16 * sp[index],
+                COMPACT_SCALE16 * sp[index+1], COMPACT_SCALE16 * sp[index+2]);
+        }
+        return (w+6);
+    }
+    else if (bytes == 3)
+    {
+        for (i = 0; i < n; i++)
+        {
+            double findex = (double)*in++ + (double)*onset++;
+            int index = findex;
+            t_sample frac;
+            if (index < 1)
+                index = 1, frac = 0;
+            else if (index > maxindex)
+                index = maxindex, frac = 1;
+            else frac = findex - index;
+            *out++ = tabread4_tilde_interp(frac,
+                COMPACT_GET24(cbuf, index-1), COMPACT_GET24(cbuf, index),
+                COMPACT_GET24(cbuf, index+1), COMPACT_GET24(cbuf, index+2));
+        }
+        return (w+6);
+    }
+#else
     if (!dsparray_get_array(d, &maxindex, &buf, 0))
         goto zero;
 
     maxindex -= 3;
     if (maxindex < 1)
         goto zero;
+#endif
 
     for (i = 0; i < n; i++)
     {
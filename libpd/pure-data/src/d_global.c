@@ -6,6 +6,10 @@
 
 #include "m_pd.h"
 #include <string.h>
+#ifdef BAREPD
+#include "g_canvas.h"
+extern int ugen_getsortno(void);
+#endif
 
 /* ----------------------------- send~ ----------------------------- */
 static t_class *sigsend_class;
@@ -20,6 +24,10 @@ typedef struct _sigsend
     int x_prevnchans;
     t_float x_f;
     t_sample *x_vec;
+#ifdef BAREPD
+    int x_sortno;           /* DSP sort in which we were last scheduled */
+    t_signal x_signal;      /* x_vec as a signal for receive~ to borrow */
+#endif
 } t_sigsend;
 
 static void *sigsend_new(t_symbol *s, t_floatarg fnchans)
@@ -35,6 +43,9 @@ static void *sigsend_new(t_symbol *s, t_floatarg fnchans)
     x->x_vec = (t_sample *)getbytes(x->x_nchans * sizeof(t_sample));
     x->x_f = 0;
     x->x_canvas = canvas_getcurrent();
+#ifdef BAREPD
+    x->x_sortno = 0;
+#endif
     return (x);
 }
 
@@ -81,6 +92,23 @@ static void sigsend_dsp(t_sigsend *x, t_signal **sp)
     if (x->x_nchans > usenchans)
         memset(x->x_vec + usenchans * x->x_length, 0,
             (x->x_nchans - usenchans) * x->x_length * sizeof(t_sample));
+#ifdef BAREPD
+        /* receive~s scheduled after us may borrow x_vec; see
+        sigreceive_borrow().  It is marked "scalar" so that it's never put
+        on a free list or written to by an outlet~ (signal_islocal()), and
+        we hold a reference so that the count never drops to zero. */
+    x->x_sortno = ugen_getsortno();
+    x->x_signal.s_vec = x->x_vec;
+    x->x_signal.s_length = x->x_length;
+    x->x_signal.s_nchans = x->x_nchans;
+    x->x_signal.s_sr = sp[0]->s_sr;
+    x->x_signal.s_overlap = sp[0]->s_overlap;
+    x->x_signal.s_nalloc = x->x_length * x->x_nchans;
+    x->x_signal.s_isborrowed = 0;
+    x->x_signal.s_isscalar = 1;
+    x->x_signal.s_borrowedfrom = 0;
+    x->x_signal.s_refcount = 1;
+#endif
 }
 
 static void sigsend_free(t_sigsend *x)
@@ -115,6 +143,9 @@ typedef struct _sigreceive
     t_sample *x_wherefrom;
     int x_length;
     int x_nchans;
+#ifdef BAREPD
+    int x_borrowed;         /* output is the send~'s buffer itself */
+#endif
 } t_sigreceive;
 
 static void *sigreceive_new(t_symbol *s)
@@ -124,6 +155,9 @@ static void *sigreceive_new(t_symbol *s)
     x->x_nchans = 1;
     x->x_sym = s;
     x->x_wherefrom = 0;
+#ifdef BAREPD
+    x->x_borrowed = 0;
+#endif
     outlet_new(&x->x_obj, &s_signal);
     return (x);
 }
@@ -177,8 +211,18 @@ static t_int *sigreceive_perf8(t_int *w)
     x->x_length) and chase down the sender to verify length and nchans match */
 static void sigreceive_set(t_sigreceive *x, t_symbol *s)
 {
-    t_sigsend *sender = (t_sigsend *)pd_findbyclass((x->x_sym = s),
-        sigsend_class);
+    t_sigsend *sender;
+#ifdef BAREPD
+        /* our output can't follow a new sender by itself: resort */
+    if (x->x_borrowed)
+    {
+        x->x_sym = s;
+        x->x_borrowed = 0;
+        canvas_update_dsp();
+        return;
+    }
+#endif
+    sender = (t_sigsend *)pd_findbyclass((x->x_sym = s), sigsend_class);
     x->x_wherefrom = 0;
     if (sender)
     {
@@ -206,10 +250,39 @@ static void sigreceive_set(t_sigreceive *x, t_symbol *s)
         pd_error(x, "receive~ %s: no matching send", x->x_sym->s_name);
 }
 
+#ifdef BAREPD
+    /* If the send~ was scheduled ahead of us, it won't write its buffer
+    again before whoever reads our output has done so, so we can hand out
+    the buffer itself instead of a copy of it.  Otherwise our output is
+    the send~'s previous block and we have to copy it. */
+static int sigreceive_borrow(t_sigreceive *x, t_signal **sp)
+{
+    t_sigsend *sender = (t_sigsend *)pd_findbyclass(x->x_sym, sigsend_class);
+    t_float sr = sp[0]->s_sr;
+    int overlap = sp[0]->s_overlap;
+    if (!x->x_wherefrom || !sender || sender->x_vec != x->x_wherefrom ||
+        sender->x_sortno != ugen_getsortno())
+            return (0);
+    sp[0] = signal_new(0, 1, sr, 0);
+    signal_setborrowed(sp[0], &sender->x_signal);
+    sp[0]->s_sr = sr;
+    sp[0]->s_overlap = overlap;
+    x->x_borrowed = 1;
+    return (1);
+}
+#endif
+
 static void sigreceive_dsp(t_sigreceive *x, t_signal **sp)
 {
     x->x_length = sp[0]->s_length;
+#ifdef BAREPD
+    x->x_borrowed = 0;
+    sigreceive_set(x, x->x_sym);
+    if (sigreceive_borrow(x, sp))
+        return;
+#else
     sigreceive_set(x, x->x_sym);
+#endif
     signal_setmultiout(&sp[0], x->x_nchans);
     if ((x->x_length * x->x_nchans) & 7)
         dsp_add(sigreceive_perform, 3,
@@ -295,10 +368,41 @@ static t_int *sigcatch_perform(t_int *w)
     return (w+4);
 }
 
+#ifdef BAREPD
+static t_int *sigcatch_perf8(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    for (; n; n -= 8, in += 8, out += 8)
+    {
+        t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3];
+        t_sample f4 = in[4], f5 = in[5], f6 = in[6], f7 = in[7];
+        in[0] = 0; in[1] = 0; in[2] = 0; in[3] = 0;
+        in[4] = 0; in[5] = 0; in[6] = 0; in[7] = 0;
+        out[0] = (PD_BIGORSMALL(f0) ? 0 : f0);
+        out[1] = (PD_BIGORSMALL(f1) ? 0 : f1);
+        out[2] = (PD_BIGORSMALL(f2) ? 0 : f2);
+        out[3] = (PD_BIGORSMALL(f3) ? 0 : f3);
+        out[4] = (PD_BIGORSMALL(f4) ? 0 : f4);
+        out[5] = (PD_BIGORSMALL(f5) ? 0 : f5);
+        out[6] = (PD_BIGORSMALL(f6) ? 0 : f6);
+        out[7] = (PD_BIGORSMALL(f7) ? 0 : f7);
+    }
+    return (w+4);
+}
+#endif
+
 static void sigcatch_dsp(t_sigcatch *x, t_signal **sp)
 {
     sigcatch_fixbuf(x, sp[0]->s_length);
     signal_setmultiout(&sp[0], x->x_nchans);
+#ifdef BAREPD
+    if (!(x->x_length & 7))
+        dsp_add(sigcatch_perf8, 3, x->x_vec, sp[0]->s_vec,
+            x->x_length * x->x_nchans);
+    else
+#endif
     dsp_add(sigcatch_perform, 3, x->x_vec, sp[0]->s_vec,
         x->x_length * x->x_nchans);
 }
@@ -360,6 +464,31 @@ static t_int *sigthrow_perform(t_int *w)
     return (w+4);
 }
 
+#ifdef BAREPD
+    /* eight at a time; both n and x_nsamps are multiples of 8 here */
+static t_int *sigthrow_perf8(t_int *w)
+{
+    t_sigthrow *x = (t_sigthrow *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    t_sample *out = x->x_whereto;
+    if (out)
+    {
+        n = (n <= x->x_nsamps ? n : x->x_nsamps);
+        for (; n; n -= 8, in += 8, out += 8)
+        {
+            t_sample f0 = out[0] + in[0], f1 = out[1] + in[1];
+            t_sample f2 = out[2] + in[2], f3 = out[3] + in[3];
+            t_sample f4 = out[4] + in[4], f5 = out[5] + in[5];
+            t_sample f6 = out[6] + in[6], f7 = out[7] + in[7];
+            out[0] = f0; out[1] = f1; out[2] = f2; out[3] = f3;
+            out[4] = f4; out[5] = f5; out[6] = f6; out[7] = f7;
+        }
+    }
+    return (w+4);
+}
+#endif
+
 static void sigthrow_set(t_sigthrow *x, t_symbol *s)
 {
     t_sigcatch *catcher = (t_sigcatch *)pd_findbyclass((x->x_sym = s),
@@ -387,6 +516,12 @@ static void sigthrow_dsp(t_sigthrow *x, t_signal **sp)
 {
     x->x_length = sp[0]->s_n;
     sigthrow_set(x, x->x_sym);
+#ifdef BAREPD
+    if (!(x->x_length & 7))
+        dsp_add(sigthrow_perf8, 3,
+            x, sp[0]->s_vec, (t_int)(sp[0]->s_length * sp[0]->s_nchans));
+    else
+#endif
     dsp_add(sigthrow_perform, 3,
         x, sp[0]->s_vec, (t_int)(sp[0]->s_length * sp[0]->s_nchans));
 }
@@ -57,6 +57,13 @@ static t_int *sigvcf_perform_old(t_int *w);
 static t_int *cos_perform(t_int *w);
 static t_int *osc_perform(t_int *w);
 static t_int *sigvcf_perform(t_int *w);
+#ifdef BAREPD
+#include "s_stuff.h"    /* for DEFDACBLKSIZE */
+    /* the same for vectors of exactly DEFDACBLKSIZE samples */
+static t_int *cos_perfblk(t_int *w);
+static t_int *osc_perfblk(t_int *w);
+static t_int *sigvcf_perfblk(t_int *w);
+#endif
 #define COSTABLENAME cos_newtable   /* keep cos_table back-compatibile */
 
 
@@ -164,6 +171,12 @@ static void cos_dsp(t_cos *x, t_signal **sp)
         dsp_add(cos_perform_old, 3, sp[0]->s_vec, sp[1]->s_vec,
             (t_int)(sp[0]->s_length * sp[0]->s_nchans));
     else
+#endif
+#ifdef BAREPD
+    if (sp[0]->s_length * sp[0]->s_nchans == DEFDACBLKSIZE)
+        dsp_add(cos_perfblk, 3, sp[0]->s_vec, sp[1]->s_vec,
+            (t_int)DEFDACBLKSIZE);
+    else
 #endif
     dsp_add(cos_perform, 3, sp[0]->s_vec, sp[1]->s_vec,
         (t_int)(sp[0]->s_length * sp[0]->s_nchans));
@@ -260,6 +273,12 @@ static void osc_dsp(t_osc *x, t_signal **sp)
             (t_int)sp[0]->s_n);
     }
     else
+#endif
+#ifdef BAREPD
+    if (sp[0]->s_n == DEFDACBLKSIZE)
+        dsp_add(osc_perfblk, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+            (t_int)sp[0]->s_n);
+    else
 #endif
         dsp_add(osc_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
             (t_int)sp[0]->s_n);
@@ -336,6 +355,13 @@ static void sigvcf_dsp(t_sigvcf *x, t_signal **sp)
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec,
                 &x->x_cspace, (t_int)sp[0]->s_n);
     else
+#endif
+#ifdef BAREPD
+    if (sp[0]->s_n == DEFDACBLKSIZE)
+        dsp_add(sigvcf_perfblk, 6,
+            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec,
+                &x->x_cspace, (t_int)sp[0]->s_n);
+    else
 #endif
         dsp_add(sigvcf_perform, 6,
             sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec,
@@ -567,6 +593,18 @@ static void tabosc4_tilde_setup(void)
 
 #include "d_osc.h"    /* include normal perf routines */
 
+#ifdef BAREPD
+#undef COSPERF
+#define COSPERF cos_perfblk
+#undef OSCPERF
+#define OSCPERF osc_perfblk
+#undef SIGVCFPERF
+#define SIGVCFPERF sigvcf_perfblk
+#define OSCBLKSIZE DEFDACBLKSIZE
+#include "d_osc.h"    /* include perf routines for BarePD's fixed block */
+#undef OSCBLKSIZE
+#endif
+
 #ifdef OLDTABSIZE
 #undef COSTABLESIZE
 #define COSTABLESIZE OLDTABSIZE
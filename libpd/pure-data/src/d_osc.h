@@ -16,6 +16,8 @@ would have been.
 The macros COSPERF, etc. should expand to the name of the routine, and
 COSTABLESIZE and COSTABLENAME should be set variously to the standard table
 size and to OLDTABSIZE, and corresponding table pointers, as appropriate.
+BarePD also defines OSCBLKSIZE to hard-code the vector size for a third set
+of routines that run on its fixed top-level block.
 */
 
 
@@ -23,7 +25,11 @@ static t_int *COSPERF(t_int *w)
 {
     t_sample *in = (t_sample *)(w[1]);
     t_sample *out = (t_sample *)(w[2]);
+#ifdef OSCBLKSIZE
+    int n = OSCBLKSIZE;
+#else
     int n = (int)(w[3]);
+#endif
     float *tab = COSTABLENAME, *addr;
     t_float f1, f2, frac;
     double dphase;
@@ -75,7 +81,11 @@ static t_int *OSCPERF(t_int *w)
     t_osc *x = (t_osc *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
+#ifdef OSCBLKSIZE
+    int n = OSCBLKSIZE;
+#else
     int n = (int)(w[4]);
+#endif
     float *tab = COSTABLENAME, *addr;
     t_float f1, f2, frac;
     double dphase = x->x_phase + UNITBIT32;
@@ -135,7 +145,11 @@ static t_int *SIGVCFPERF(t_int *w)
     t_sample *out1 = (t_sample *)(w[3]);
     t_sample *out2 = (t_sample *)(w[4]);
     t_vcfctl *c = (t_vcfctl *)(w[5]);
+#ifdef OSCBLKSIZE
+    int n = OSCBLKSIZE;
+#else
     int n = (int)w[6];
+#endif
     int i;
     t_float re = c->c_re, re2;
     t_float im = c->c_im;
@@ -4,6 +4,10 @@
 
 
 #include "m_pd.h"
+#ifdef BAREPD
+#include <math.h>
+#include <string.h>
+#endif
 
 /* --------------------- up/down-sampling --------------------- */
 t_int *downsampling_perform_0(t_int *w)
@@ -97,6 +101,179 @@ t_int *upsampling_perform_linear(t_int *w)
   return (w+6);
 }
 
+#ifdef BAREPD
+/* ----------- polyphase half-band FIR resampling (method 3) ------------ */
+
+/* Each factor of two is one half-band stage: a linear-phase lowpass at a
+ * quarter of the higher rate in which every other tap is zero.  Split into
+ * its two polyphase branches, one branch is a plain delay and the other a
+ * symmetric FIR of 2*k taps, so a stage costs k multiplies per output pair.
+ * The stage next to the parent rate has the steep filter; stages further
+ * out only have to reject images far above the audio band and are short.
+ * Layout of x->coeffs: the k taps of each stage in a row.  Layout of
+ * x->buffer: per stage, 4*k samples of history followed by the stage's
+ * input; each stage writes its output straight into the next one's input
+ * area, the last one into the outlet. */
+
+#define HALFBAND_KMAIN 16   /* 63 taps, ~80 dB, passband to 0.39 fs */
+#define HALFBAND_KAUX   6   /* 23 taps for the outer stages */
+#define HALFBAND_BETA 8.    /* Kaiser window shape */
+
+static int halfband_nstages(int factor)
+{
+    int n = 0;
+    while (factor > 1 && !(factor & 1))
+        factor >>= 1, n++;
+    return (factor == 1 ? n : 0);
+}
+
+    /* stage 0 is always the one running at the parent rate */
+static int halfband_k(int stage)
+{
+    return (stage ? HALFBAND_KAUX : HALFBAND_KMAIN);
+}
+
+static t_float halfband_i0(t_float x)
+{
+    t_float sum = 1, term = 1;
+    int i;
+    for (i = 1; i < 30; i++)
+    {
+        term *= (x / (2 * i)) * (x / (2 * i));
+        sum += term;
+    }
+    return (sum);
+}
+
+    /* nonzero side taps h[c +- (2j+1)], j = 0..k-1, of a Kaiser-windowed
+    half-band lowpass, scaled for unity gain at DC (center tap is 1/2) */
+static void halfband_design(t_sample *coef, int k)
+{
+    t_float c = 2 * k - 1, sum = 0, i0beta = halfband_i0(HALFBAND_BETA);
+    int j;
+    for (j = 0; j < k; j++)
+    {
+        t_float d = 2 * j + 1, r = d / c;
+        t_float w = halfband_i0(HALFBAND_BETA * sqrt(1 - r * r)) / i0beta;
+        coef[j] = ((j & 1) ? -1 : 1) * w / (3.14159265358979 * d);
+        sum += coef[j];
+    }
+    for (j = 0; j < k; j++)
+        coef[j] *= 0.25 / sum;
+}
+
+    /* one 2x interpolation stage: x[-4k..n-1] -> out[0..2n-1] */
+static void halfband_up(const t_sample *coef, int k,
+    const t_sample *x, t_sample *out, int n)
+{
+    int i, j;
+    for (i = 0; i < n; i++)
+    {
+        const t_sample *p1 = x + i - k + 1, *p2 = x + i - k;
+        t_sample acc = 0;
+        for (j = 0; j < k; j++)
+            acc += coef[j] * (p1[j] + p2[-j]);
+        out[2*i] = 2 * acc;
+        out[2*i+1] = *p1;
+    }
+}
+
+    /* one 2x decimation stage: x[-4k..n-1] -> out[0..n/2-1] */
+static void halfband_down(const t_sample *coef, int k,
+    const t_sample *x, t_sample *out, int n)
+{
+    int i, j;
+    for (i = 0; i < n/2; i++)
+    {
+        const t_sample *p1 = x + 2*i - 2*k + 2, *p2 = x + 2*i - 2*k;
+        t_sample acc = 0.5 * p2[1];
+        for (j = 0; j < k; j++)
+            acc += coef[j] * (p1[2*j] + p2[-2*j]);
+        out[i] = acc;
+    }
+}
+
+static t_int *resampling_perform_fir(t_int *w)
+{
+    t_resample *x = (t_resample *)(w[1]);
+    t_sample *in  = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int nstages   = (int)(w[4]);
+    int up        = (int)(w[5]);    /* nonzero: interpolate */
+    int n         = (int)(w[6]);    /* input vectorsize */
+    t_sample *coef = x->coeffs, *buf = x->buffer;
+    int s;
+
+    memcpy(buf + 4 * halfband_k(up ? 0 : nstages-1), in, n * sizeof(*in));
+    for (s = 0; s < nstages; s++)
+    {
+        int k = halfband_k(up ? s : nstages-1-s), hist = 4 * k;
+        int nout = (up ? 2 * n : n / 2);
+        t_sample *x0 = buf + hist, *next, *dest;
+        if (s == nstages-1)
+            dest = next = out;
+        else
+        {
+            next = x0 + n;
+            dest = next + 4 * halfband_k(up ? s+1 : nstages-2-s);
+        }
+        if (up)
+            halfband_up(coef, k, x0, dest, n);
+        else halfband_down(coef, k, x0, dest, n);
+            /* keep the newest 4k input samples for the next block */
+        memmove(buf, buf + n, hist * sizeof(*buf));
+        coef += k;
+        buf = next;
+        n = nout;
+    }
+    return (w+7);
+}
+
+static void resample_dsp_fir(t_resample *x, t_sample *in, int insize,
+    t_sample *out, int outsize)
+{
+    int up = (outsize > insize), factor = (up ? outsize/insize : insize/outsize);
+    int nstages = halfband_nstages(factor), s, n, ncoef = 0, nbuf = 0;
+    if (!nstages)
+    {
+        pd_error(0, "fir resampling needs a power-of-2 factor");
+        dsp_add(up ? upsampling_perform_hold : downsampling_perform_0, 4,
+            in, out, (t_int)factor, (t_int)insize);
+        return;
+    }
+    for (s = 0, n = insize; s < nstages; s++)
+    {
+        int k = halfband_k(up ? s : nstages-1-s);
+        ncoef += k;
+        nbuf += 4 * k + n;
+        n = (up ? 2 * n : n / 2);
+    }
+    if (x->coefsize != ncoef)
+    {
+        if (x->coefsize)
+            t_freebytes(x->coeffs, x->coefsize * sizeof(*x->coeffs));
+        x->coeffs = (t_sample *)t_getbytes(ncoef * sizeof(*x->coeffs));
+        x->coefsize = ncoef;
+    }
+        /* stage order differs between up and down, so always redesign */
+    for (s = 0, n = 0; s < nstages; s++)
+    {
+        int k = halfband_k(up ? s : nstages-1-s);
+        halfband_design(x->coeffs + n, k);
+        n += k;
+    }
+    if (x->bufsize != nbuf)
+    {
+        if (x->bufsize)
+            t_freebytes(x->buffer, x->bufsize * sizeof(*x->buffer));
+        x->buffer = (t_sample *)getbytes(nbuf * sizeof(*x->buffer));
+        x->bufsize = nbuf;
+    }
+    dsp_add(resampling_perform_fir, 6, x, in, out,
+        (t_int)nstages, (t_int)up, (t_int)insize);
+}
+#endif /* BAREPD */
+
 /* ----------------------- public -------------------------------- */
 
 /* utils */
@@ -132,6 +309,17 @@ void resample_dsp(t_resample *x,
     return;
   }
 
+#ifdef BAREPD
+  if (method == 3) { /* polyphase half-band FIR, either direction */
+    if ((insize > outsize ? insize % outsize : outsize % insize)) {
+      pd_error(0, "bad resampling factor");
+      return;
+    }
+    resample_dsp_fir(x, in, insize, out, outsize);
+    return;
+  }
+#endif
+
   if (insize > outsize) { /* downsampling */
     if (insize % outsize) {
       pd_error(0, "bad downsampling factor");
@@ -436,6 +436,97 @@ int open_soundfile_via_canvas(t_canvas *canvas, const char *filename,
     return sf_fd;
 }
 
+#ifdef BAREPD
+    /* BarePD: little-endian 16 and 24-bit samples, as in nearly every WAV
+    file, are converted a frame at a time and, for mono and stereo, four
+    frames per pass, instead of one channel at a time with a double-precision
+    multiply.  The result is the same.  "stride" is the number of t_samples
+    from one output to the next, 1 for signals and more for t_words.
+    Returns 0, converting nothing, for any other format. */
+#define PCM16(p) ((t_sample)(short)((p)[0] | ((p)[1] << 8)))
+#define PCM24(p) ((t_sample)(int)(((unsigned)(p)[0] << 8) | \
+    ((unsigned)(p)[1] << 16) | ((unsigned)(p)[2] << 24)))
+
+static int soundfile_xferin_pcm(const t_soundfile *sf, int nchannels,
+    t_sample **vecs, int stride, const unsigned char *sp, size_t nframes)
+{
+    int bytesperframe = sf->sf_bytesperframe, i;
+    size_t j = 0;
+    t_sample *fp0 = vecs[0], *fp1 = vecs[nchannels > 1];
+    if (sf->sf_bigendian)
+        return (0);
+    if (sf->sf_bytespersample == 2)
+    {
+        const t_sample scale = (t_sample)(1. / 32768.);
+        if (bytesperframe == 2)
+            for (; j + 4 <= nframes; j += 4, sp += 8)
+        {
+            t_sample f0 = PCM16(sp), f1 = PCM16(sp + 2);
+            t_sample f2 = PCM16(sp + 4), f3 = PCM16(sp + 6);
+            fp0[j*stride] = f0 * scale;
+            fp0[(j+1)*stride] = f1 * scale;
+            fp0[(j+2)*stride] = f2 * scale;
+            fp0[(j+3)*stride] = f3 * scale;
+        }
+        else if (bytesperframe == 4 && nchannels == 2)
+            for (; j + 4 <= nframes; j += 4, sp += 16)
+        {
+            t_sample f0 = PCM16(sp), f1 = PCM16(sp + 4);
+            t_sample f2 = PCM16(sp + 8), f3 = PCM16(sp + 12);
+            t_sample g0 = PCM16(sp + 2), g1 = PCM16(sp + 6);
+            t_sample g2 = PCM16(sp + 10), g3 = PCM16(sp + 14);
+            fp0[j*stride] = f0 * scale;
+            fp0[(j+1)*stride] = f1 * scale;
+            fp0[(j+2)*stride] = f2 * scale;
+            fp0[(j+3)*stride] = f3 * scale;
+            fp1[j*stride] = g0 * scale;
+            fp1[(j+1)*stride] = g1 * scale;
+            fp1[(j+2)*stride] = g2 * scale;
+            fp1[(j+3)*stride] = g3 * scale;
+        }
+        for (; j < nframes; j++, sp += bytesperframe)
+            for (i = 0; i < nchannels; i++)
+                vecs[i][j*stride] = PCM16(sp + 2*i) * scale;
+        return (1);
+    }
+    else if (sf->sf_bytespersample == 3)
+    {
+        const t_sample scale = (t_sample)SCALE;
+        if (bytesperframe == 3)
+            for (; j + 4 <= nframes; j += 4, sp += 12)
+        {
+            t_sample f0 = PCM24(sp), f1 = PCM24(sp + 3);
+            t_sample f2 = PCM24(sp + 6), f3 = PCM24(sp + 9);
+            fp0[j*stride] = f0 * scale;
+            fp0[(j+1)*stride] = f1 * scale;
+            fp0[(j+2)*stride] = f2 * scale;
+            fp0[(j+3)*stride] = f3 * scale;
+        }
+        else if (bytesperframe == 6 && nchannels == 2)
+            for (; j + 4 <= nframes; j += 4, sp += 24)
+        {
+            t_sample f0 = PCM24(sp), f1 = PCM24(sp + 6);
+            t_sample f2 = PCM24(sp + 12), f3 = PCM24(sp + 18);
+            t_sample g0 = PCM24(sp + 3), g1 = PCM24(sp + 9);
+            t_sample g2 = PCM24(sp + 15), g3 = PCM24(sp + 21);
+            fp0[j*stride] = f0 * scale;
+            fp0[(j+1)*stride] = f1 * scale;
+            fp0[(j+2)*stride] = f2 * scale;
+            fp0[(j+3)*stride] = f3 * scale;
+            fp1[j*stride] = g0 * scale;
+            fp1[(j+1)*stride] = g1 * scale;
+            fp1[(j+2)*stride] = g2 * scale;
+            fp1[(j+3)*stride] = g3 * scale;
+        }
+        for (; j < nframes; j++, sp += bytesperframe)
+            for (i = 0; i < nchannels; i++)
+                vecs[i][j*stride] = PCM24(sp + 3*i) * scale;
+        return (1);
+    }
+    return (0);
+}
+#endif
+
 static void soundfile_xferin_sample(const t_soundfile *sf, int nvecs,
     t_sample **vecs, size_t framesread, unsigned char *buf, size_t nframes)
 {
@@ -443,6 +534,14 @@ static void soundfile_xferin_sample(const t_soundfile *sf, int nvecs,
     size_t j;
     unsigned char *sp, *sp2;
     t_sample *fp;
+#ifdef BAREPD
+    t_sample *fvecs[MAXSFCHANS];
+    for (i = 0; i < nchannels; i++)
+        fvecs[i] = vecs[i] + framesread;
+    if (nchannels && soundfile_xferin_pcm(sf, nchannels, fvecs, 1,
+        buf, nframes))
+            nchannels = 0;
+#endif
     for (i = 0, sp = buf; i < nchannels; i++, sp += sf->sf_bytespersample)
     {
         if (sf->sf_bytespersample == 2)
@@ -543,6 +642,14 @@ static void soundfile_xferin_words(const t_soundfile *sf, int nvecs,
     t_word *wp;
     int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i;
     size_t j;
+#ifdef BAREPD
+    t_sample *fvecs[MAXSFCHANS];
+    for (i = 0; i < nchannels; i++)
+        fvecs[i] = (t_sample *)&vecs[i][framesread].w_float;
+    if (nchannels && soundfile_xferin_pcm(sf, nchannels, fvecs,
+        sizeof(t_word) / sizeof(t_sample), buf, nframes))
+            nchannels = 0;
+#endif
     for (i = 0, sp = buf; i < nchannels; i++, sp += sf->sf_bytespersample)
     {
         if (sf->sf_bytespersample == 2)
@@ -1216,6 +1323,30 @@ done:
     return nframes;
 }
 
+#ifdef BAREPD
+    /* round samples to 16 or 24-bit integers for garray_setcompact() */
+static void soundfiler_compact(unsigned char *cvec, int bytes,
+    const t_word *vec, size_t nframes)
+{
+    double scale = (bytes == 2 ? 32768. : 8388608.);
+    size_t j;
+    for (j = 0; j < nframes; j++)
+    {
+        double f = vec[j].w_float * scale;
+        int i = (!(f < scale - 1) ? (int)scale - 1 :
+            (f <= -scale ? -(int)scale : (int)(f + scale + 0.5) - (int)scale));
+        if (bytes == 2)
+            ((short *)cvec)[j] = i;
+        else
+        {
+            cvec[3*j] = i;
+            cvec[3*j+1] = i >> 8;
+            cvec[3*j+2] = i >> 16;
+        }
+    }
+}
+#endif
+
     /* soundfiler_read ...
 
        usage: read [flags] filename [tablename] ...
@@ -1229,6 +1360,7 @@ done:
            -caf
            -next
            -ascii
+           -compact <16 or 24> (BarePD) ... store as integers, implies -resize
     */
 
 static void soundfiler_read(t_soundfiler *x, t_symbol *s,
@@ -1244,6 +1376,12 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     t_garray *garrays[MAXSFCHANS];
     t_word *vecs[MAXSFCHANS];
     char sampbuf[SAMPBUFSIZE];
+#ifdef BAREPD
+    int compact = 0;
+    unsigned char *cvecs[MAXSFCHANS];
+    int ncompact = 0;   /* arrays garray_setcompact() was called for */
+    t_word *chunk = 0;
+#endif
 
     soundfile_clear(&sf);
     sf.sf_headersize = -1;
@@ -1311,6 +1449,17 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             resize = 1;     /* maxsize implies resize */
             argc -= 2; argv += 2;
         }
+#ifdef BAREPD
+        else if (!strcmp(flag, "compact"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                (argv[1].a_w.w_float != 16 && argv[1].a_w.w_float != 24))
+                    goto usage;
+            compact = argv[1].a_w.w_float / 8;
+            resize = 1;     /* so does compact */
+            argc -= 2; argv += 2;
+        }
+#endif
         else
         {
                 /* check for type by name */
@@ -1350,6 +1499,11 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
                 argv[i].a_w.w_symbol->s_name);
             goto done;
         }
+#ifdef BAREPD
+            /* don't convert compact arrays we're about to replace */
+        else if (compact)
+            continue;
+#endif
         else if (!garray_getfloatwords(garrays[i], &vecsize,
                 &vecs[i]))
             pd_error(x, "[soundfiler] read: %s: bad template for tabwrite",
@@ -1371,6 +1525,10 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
                         "'-ascii' requires at least one table");
             goto done;
         }
+#ifdef BAREPD
+        if (compact)
+            goto usage;
+#endif
         if ((framesread = soundfiler_readascii(x, filename, &a)) == 0)
             goto done;
             /* fill in for info outlet */
@@ -1400,6 +1558,28 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             framesinfile = maxsize;
         }
         finalsize = framesinfile;
+#ifdef BAREPD
+        if (compact)
+        {
+            for (i = 0; i < argc; i++)
+            {
+                ncompact = i + 1;
+                if (!(cvecs[i] = garray_setcompact(garrays[i],
+                    (int)finalsize, compact)))
+                {
+                    pd_error(x, "[soundfiler] read: resize failed");
+                    goto done;
+                }
+                garray_setsaveit(garrays[i], 0);
+            }
+                /* convert through floats, a chunk at a time */
+            chunk = (t_word *)getbytes(argc * (SAMPBUFSIZE / 2) *
+                sizeof(t_word));
+            for (i = 0; i < argc; i++)
+                vecs[i] = chunk + i * (SAMPBUFSIZE / 2);
+        }
+        else
+#endif
         for (i = 0; i < argc; i++)
         {
             int vecsize;
@@ -1444,6 +1624,18 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
         nframes = read(sf.sf_fd, sampbuf,
             thisread * sf.sf_bytesperframe) / sf.sf_bytesperframe;
         if (nframes <= 0) break;
+#ifdef BAREPD
+        if (compact)
+        {
+            soundfile_xferin_words(&sf, argc, vecs, 0,
+                (unsigned char *)sampbuf, nframes);
+            for (i = 0; i < argc && i < sf.sf_nchannels; i++)
+                soundfiler_compact(cvecs[i] + framesread * compact, compact,
+                    vecs[i], nframes);
+            framesread += nframes;
+            continue;
+        }
+#endif
         soundfile_xferin_words(&sf, argc, vecs, framesread,
             (unsigned char *)sampbuf, nframes);
         framesread += nframes;
@@ -1455,6 +1647,11 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
 %ld points but file was truncated to %ld",
             filename, (long)finalsize, (long)framesread);
     }
+#ifdef BAREPD
+        /* compact samples start out zeroed */
+    if (compact)
+        goto done;
+#endif
         /* zero out remaining elements of vectors */
     for (i = 0; i < argc; i++)
     {
@@ -1479,9 +1676,18 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
 usage:
     pd_error(x, "[soundfiler]: usage; read [flags] filename [tablename]...");
     post("flags: -skip <n> -resize -maxsize <n> %s -ascii ...", sf_typeargs);
+#ifdef BAREPD
+    post("-compact <16 or 24> to store samples as 16 or 24-bit integers");
+#endif
     post("-raw <headerbytes> <channels> <bytespersample> <endian (b, l, or n)>");
     post("(-ascii flag can only be combined with -resize)");
 done:
+#ifdef BAREPD
+    for (i = 0; i < ncompact; i++)
+        garray_compactdone(garrays[i]);
+    if (chunk)
+        freebytes(chunk, argc * (SAMPBUFSIZE / 2) * sizeof(t_word));
+#endif
     sf.sf_fd = -1;
     if (fd >= 0)
         sys_close(fd);
@@ -15,7 +15,9 @@
 #include "m_imp.h"
 #include "g_canvas.h"
 #include <stdarg.h>
+#ifndef DEFDACBLKSIZE
 #define DEFDACBLKSIZE 64    /* from s_stuff.h - LATER make this dynamic */
+#endif
 
 extern t_class *vinlet_class, *voutlet_class, *canvas_class, *text_class;
 
@@ -45,6 +47,17 @@ struct _instanceugen
     int u_phase;
     int u_loud;
     struct _dspcontext *u_context;
+#ifdef BAREPD
+    int u_sleepblocks;      /* silent blocks before a subpatch sleeps */
+    int u_dspchainalloc;    /* allocated elements in DSP chain */
+    t_dspentry *u_dspmap;   /* where each perform routine sits in the chain */
+    int u_dspmapsize;
+    int u_dspmapalloc;
+    t_symbol *u_dspclass;   /* class whose "dsp" method is adding to chain */
+    t_dspcompiled u_compiled;   /* runs the chain instead of dsp_tick() */
+    t_dspchainhook u_chainhook; /* called when a new chain is complete */
+    int u_recursivesort;    /* sort with ugen_doit() as vanilla Pd does */
+#endif
 };
 
 #define THIS (pd_this->pd_ugen)
@@ -91,6 +104,11 @@ t_int *zero_perf8(t_int *w)
 
 void dsp_add_zero(t_sample *out, int n)
 {
+#ifdef BAREPD
+    if (n == DEFDACBLKSIZE)
+        dsp_add(zero_perfblk, 2, out, (t_int)n);
+    else
+#endif
     if (n&7)
         dsp_add(zero_perform, 2, out, (t_int)n);
     else
@@ -147,6 +165,11 @@ typedef struct _block
     int x_upsample;     /* upsampling-factor */
     int x_downsample;   /* downsampling-factor */
     int x_return;       /* stop right after this block (for one-shots) */
+#ifdef BAREPD
+    int x_sleepcount;   /* consecutive silent blocks so far */
+    char x_autosleep;   /* may fall asleep by itself on silence */
+    char x_autoslept;   /* asleep because of silence, not by its owner */
+#endif
 } t_block;
 
 static void block_set(t_block *x, t_floatarg fvecsize, t_floatarg foverlap,
@@ -354,13 +377,55 @@ static t_int dsp_done(t_int *w)
     return (0);
 }
 
+#ifdef BAREPD
+    /* grow the DSP chain geometrically.  Resizing it for every dsp_add()
+    copies the whole chain each time, which is quadratic in the size of the
+    patch with an allocator that can't grow blocks in place. */
+static void dsp_chainresize(int newsize)
+{
+    if (newsize > THIS->u_dspchainalloc)
+    {
+        int alloc = (THIS->u_dspchainalloc > 64 ? THIS->u_dspchainalloc : 64);
+        while (alloc < newsize)
+            alloc *= 2;
+        THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
+            THIS->u_dspchainalloc * sizeof (t_int), alloc * sizeof (t_int));
+        THIS->u_dspchainalloc = alloc;
+    }
+}
+
+    /* note the perform routine starting at "onset" in the chain together
+    with the class that added it, for dsp_getmap() */
+static void dsp_mapentry(int onset, int nargs)
+{
+    t_dspentry *e;
+    if (THIS->u_dspmapsize == THIS->u_dspmapalloc)
+    {
+        int alloc = (THIS->u_dspmapalloc ? 2 * THIS->u_dspmapalloc : 64);
+        THIS->u_dspmap = t_resizebytes(THIS->u_dspmap,
+            THIS->u_dspmapalloc * sizeof(t_dspentry),
+            alloc * sizeof(t_dspentry));
+        THIS->u_dspmapalloc = alloc;
+    }
+    e = &THIS->u_dspmap[THIS->u_dspmapsize++];
+    e->e_onset = onset;
+    e->e_nargs = nargs;
+    e->e_class = THIS->u_dspclass;
+}
+#endif
+
 void dsp_add(t_perfroutine f, int n, ...)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
     va_list ap;
 
+#ifdef BAREPD
+    dsp_chainresize(newsize);
+    dsp_mapentry(THIS->u_dspchainsize-1, n);
+#else
     THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
         THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
+#endif
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
     if (THIS->u_loud)
         post("add to chain: %lx",
@@ -383,8 +448,13 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
 
+#ifdef BAREPD
+    dsp_chainresize(newsize);
+    dsp_mapentry(THIS->u_dspchainsize-1, n);
+#else
     THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
         THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
+#endif
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
     for (i = 0; i < n; i++)
         THIS->u_dspchain[THIS->u_dspchainsize + i] = vec[i];
@@ -397,6 +467,11 @@ void dsp_tick(void)
     if (THIS->u_dspchain)
     {
         t_int *ip;
+#ifdef BAREPD
+        if (THIS->u_compiled)
+            (*THIS->u_compiled)();
+        else
+#endif
         for (ip = THIS->u_dspchain; ip; ) ip = (*(t_perfroutine)(*ip))(ip);
         THIS->u_phase++;
     }
@@ -610,6 +685,9 @@ typedef struct _ugenbox
     struct _ugenbox *u_next;
     t_object *u_obj;
     int u_done;
+#ifdef BAREPD
+    int u_index;            /* order of ugen_add() calls */
+#endif
 } t_ugenbox;
 
 typedef struct _siginlet
@@ -647,6 +725,15 @@ struct _dspcontext
     unsigned int dc_reblock:1;      /* true if we have to reblock in/outlets */
     unsigned int dc_switched:1;     /* true if we're switched */
     unsigned int dc_warnedmulti:1;  /* already warned about bad multi input */
+#ifdef BAREPD
+    t_block *dc_sleepblock;         /* hidden switch~ used to sleep the canvas */
+    int dc_hassink;                 /* mustn't sleep, see sleep_findsinks() */
+    int dc_nugen;                   /* number of ugenboxes */
+    t_ugenbox **dc_ugenhash;        /* ugenboxes by object, open addressing */
+    int dc_hashsize;                /* power of 2, or 0 */
+    struct _ugenframe *dc_stack;    /* ugens being scheduled, see ugen_schedule() */
+    int dc_stacksize;               /* allocated frames */
+#endif
 };
 #define DC_LENGTH(x) ((x)->dc_nullsignal.s_length)
 #define DC_SR(x) ((x)->dc_nullsignal.s_sr)
@@ -663,6 +750,34 @@ t_signal *signal_newfromcontext(int borrowed, int nchans)
     return s;
 }
 
+#ifdef BAREPD
+static t_signal *signal_getroot(t_signal *sig)
+{
+    while (sig->s_isborrowed && sig->s_borrowedfrom)
+        sig = sig->s_borrowedfrom;
+    return (sig);
+}
+
+    /* true if a signal's samples are computed by the canvas now being
+    scheduled, so that it may be written to while the canvas is switched
+    off.  Not so for a signal borrowed from the containing patch through
+    an inlet~, or for a buffer an object keeps for itself (send~), which
+    we mark "scalar" as it isn't ours to reuse either. */
+int signal_islocal(t_signal *sig)
+{
+    t_dspcontext *dc = THIS->u_context;
+    int i;
+    sig = signal_getroot(sig);
+    if (sig->s_isscalar)
+        return (0);
+    if (dc && !dc->dc_toplevel && dc->dc_iosigs)
+        for (i = 0; i < dc->dc_ninlets; i++)
+            if (signal_getroot(dc->dc_iosigs[i]) == sig)
+                return (0);
+    return (1);
+}
+#endif
+
 void ugen_stop(void)
 {
 #if 0   /* test to make sure we aren't leaving signal garbage */
@@ -682,8 +797,16 @@ void ugen_stop(void)
 #endif
     if (THIS->u_dspchain)
     {
+#ifdef BAREPD
+        freebytes(THIS->u_dspchain,
+            THIS->u_dspchainalloc * sizeof (t_int));
+        THIS->u_dspchainalloc = 0;
+        THIS->u_dspmapsize = 0;
+        THIS->u_compiled = 0;
+#else
         freebytes(THIS->u_dspchain,
             THIS->u_dspchainsize * sizeof (t_int));
+#endif
         THIS->u_dspchain = 0;
     }
     signal_cleanup();
@@ -698,6 +821,9 @@ void ugen_start(void)
     THIS->u_dspchain = (t_int *)getbytes(sizeof(*THIS->u_dspchain));
     THIS->u_dspchain[0] = (t_int)dsp_done;
     THIS->u_dspchainsize = 1;
+#ifdef BAREPD
+    THIS->u_dspchainalloc = 1;
+#endif
     if (THIS->u_context) bug("ugen_start");
 }
 
@@ -751,11 +877,66 @@ t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
     dc->dc_ninlets = ninlets;
     dc->dc_noutlets = noutlets;
     dc->dc_warnedmulti = 0;
+#ifdef BAREPD
+    dc->dc_sleepblock = 0;
+    dc->dc_hassink = 0;
+    dc->dc_nugen = 0;
+    dc->dc_ugenhash = 0;
+    dc->dc_hashsize = 0;
+    dc->dc_stack = 0;
+    dc->dc_stacksize = 0;
+#endif
     dc->dc_parentcontext = THIS->u_context;
     THIS->u_context = dc;
     return (dc);
 }
 
+#ifdef BAREPD
+    /* Finding the ugenbox of an object used to be a walk down dc_ugenlist
+    for both ends of every connection, which made sorting a canvas with
+    thousands of tilde objects quadratic.  The boxes are now also hashed by
+    object pointer, so ugen_connect() is constant time. */
+
+static unsigned int ugen_hash(t_object *obj, int size)
+{
+    return ((unsigned int)(((size_t)obj >> 3) * 2654435761u) & (size - 1));
+}
+
+static void ugen_hashinsert(t_dspcontext *dc, t_ugenbox *x)
+{
+    unsigned int i = ugen_hash(x->u_obj, dc->dc_hashsize);
+    while (dc->dc_ugenhash[i])
+        i = (i + 1) & (dc->dc_hashsize - 1);
+    dc->dc_ugenhash[i] = x;
+}
+
+    /* keep the table at most half full */
+static void ugen_hashgrow(t_dspcontext *dc)
+{
+    t_ugenbox **old = dc->dc_ugenhash;
+    int i, oldsize = dc->dc_hashsize;
+    dc->dc_hashsize = (oldsize ? 2 * oldsize : 64);
+    dc->dc_ugenhash = (t_ugenbox **)getbytes(dc->dc_hashsize * sizeof(*old));
+    for (i = 0; i < oldsize; i++)
+        if (old[i])
+            ugen_hashinsert(dc, old[i]);
+    if (old)
+        freebytes(old, oldsize * sizeof(*old));
+}
+
+static t_ugenbox *ugen_find(t_dspcontext *dc, t_object *obj)
+{
+    unsigned int i;
+    if (!dc->dc_hashsize)
+        return (0);
+    for (i = ugen_hash(obj, dc->dc_hashsize); dc->dc_ugenhash[i];
+        i = (i + 1) & (dc->dc_hashsize - 1))
+            if (dc->dc_ugenhash[i]->u_obj == obj)
+                return (dc->dc_ugenhash[i]);
+    return (0);
+}
+#endif /* BAREPD */
+
     /* first the canvas calls this to create all the boxes... */
 void ugen_add(t_dspcontext *dc, t_object *obj)
 {
@@ -775,6 +956,12 @@ void ugen_add(t_dspcontext *dc, t_object *obj)
     x->u_out = getbytes(x->u_nout * sizeof (*x->u_out));
     for (uout = x->u_out, i = x->u_nout; i--; uout++)
         uout->o_connections = 0, uout->o_nconnect = 0;
+#ifdef BAREPD
+    x->u_index = dc->dc_nugen++;
+    if (2 * dc->dc_nugen > dc->dc_hashsize)
+        ugen_hashgrow(dc);
+    ugen_hashinsert(dc, x);
+#endif
 }
 
     /* and then this to make all the connections. */
@@ -791,8 +978,13 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
         post("%s -> %s: %d->%d",
             class_getname(x1->ob_pd),
                 class_getname(x2->ob_pd), outno, inno);
+#ifdef BAREPD
+    u1 = ugen_find(dc, x1);
+    u2 = ugen_find(dc, x2);
+#else
     for (u1 = dc->dc_ugenlist; u1 && u1->u_obj != x1; u1 = u1->u_next);
     for (u2 = dc->dc_ugenlist; u2 && u2->u_obj != x2; u2 = u2->u_next);
+#endif
     if (!u1 || !u2 || siginno < 0 || !u2->u_nin)
     {
         if (!u1)
@@ -828,11 +1020,16 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
     /* get the index of a ugenbox or -1 if it's not on the list */
 static int ugen_index(t_dspcontext *dc, t_ugenbox *x)
 {
+#ifdef BAREPD
+        /* the list is built by prepending */
+    return (dc->dc_nugen - 1 - x->u_index);
+#else
     int ret;
     t_ugenbox *u;
     for (u = dc->dc_ugenlist, ret = 0; u; u = u->u_next, ret++)
         if (u == x) return (ret);
     return (-1);
+#endif
 }
 extern t_class *clone_class;
 
@@ -840,27 +1037,32 @@ static const t_sample ugen_scalarzero;  /* zero for scalar-to-vector copying */
 
 extern int class_getdspflags(const t_class *c);
 
-    /* put a ugenbox on the chain, recursively putting any others on that
-    this one might uncover. */
-static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
+    /* put a ugenbox on the chain; returns the signals passed to its "dsp"
+    method, to be freed with ugen_doit_end() once its outputs have been
+    passed on, or 0 if it can't be scheduled. */
+static t_signal **ugen_doit_begin(t_dspcontext *dc, t_ugenbox *u)
 {
     t_sigoutlet *uout;
     t_siginlet *uin;
-    t_sigoutconnect *oc;
     t_class *class = pd_class(&u->u_obj->ob_pd);
     t_signal *freelater = 0, *stmp;
     int flags = class_getdspflags(class);
-    int i, n;
+    int i;
         /* suppress creating new signals for the outputs of signal
         inlets for non-reblocked canvases -- those will be borrowed. */
     int nonewsigs = ((class == vinlet_class) && !dc->dc_reblock);
         /* when we encounter a subcanvas or outlet~ object, suppress freeing
         the input signals as they may be "borrowed" for the super or sub
         patch; except blocked or switched outlet~s. */
+#ifdef BAREPD
+        /* (switched outlet~s borrow in BarePD) */
+    int nofreesigs = (class == canvas_class || class == clone_class ||
+        ((class == voutlet_class) &&  !dc->dc_reblock));
+#else
     int nofreesigs = (class == canvas_class || class == clone_class ||
         ((class == voutlet_class) &&  !(dc->dc_reblock || dc->dc_switched)));
-    t_signal **insig, **outsig, **sig, *s1, *s2, *s3;
-    t_ugenbox *u2;
+#endif
+    t_signal **insig, **outsig, **sig;
 
         /* if CLASS_MULTICHANNEL isn't set, check that all input signals
         are one-channel, and if not, just return without doing anything. */
@@ -872,7 +1074,7 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         pd_error(u->u_obj, "object %s can't take multichannel inputs",
             class_getname(u->u_obj->ob_pd));
         dc->dc_warnedmulti = 1;
-        return;
+        return (0);
     }
 
     if (THIS->u_loud) post("doit %s %d %d", class_getname(class), nofreesigs,
@@ -954,7 +1156,13 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         /* now call the DSP scheduling routine for the ugen.  This
         routine must fill in "borrowed" signal outputs in case it's either
         a subcanvas or a signal inlet. */
+#ifdef BAREPD
+    THIS->u_dspclass = pd_class(&u->u_obj->ob_pd)->c_name;
+    mess1(&u->u_obj->ob_pd, gensym("dsp"), insig);
+    THIS->u_dspclass = 0;
+#else
     mess1(&u->u_obj->ob_pd, gensym("dsp"), insig);
+#endif
 
     for (sig = outsig, uout = u->u_out, i = u->u_nout; i--; sig++, uout++)
     {
@@ -990,68 +1198,307 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         signal_dereference(freelater);
         freelater = stmp;
     }
-        /* pass it on and add anyone whose last inlet was filled */
-    for (uout = u->u_out, i = u->u_nout; i--; uout++)
+    return (insig);
+}
+
+    /* pass an output signal of "u" on through connection "oc"; returns the
+    ugen on the other end if that was its last inlet to be filled. */
+static t_ugenbox *ugen_passon(t_dspcontext *dc, t_ugenbox *u, t_signal *s1,
+    t_sigoutconnect *oc)
+{
+    t_ugenbox *u2 = oc->oc_who;
+    t_siginlet *uin = &u2->u_in[oc->oc_inno];
+    t_signal *s2, *s3;
+    int n;
+        /* if there's already someone here, sum the two */
+    if ((s2 = uin->i_signal))
     {
-        s1 = uout->o_signal;
-        for (oc = uout->o_connections; oc; oc = oc->oc_next)
+        s1->s_refcount--;
+        s2->s_refcount--;
+        s3 = signal_newlike(s1);
+        if (s1->s_nchans != s2->s_nchans ||
+            s1->s_length != s2->s_length)
         {
-            u2 = oc->oc_who;
-            uin = &u2->u_in[oc->oc_inno];
-                /* if there's already someone here, sum the two */
-            if ((s2 = uin->i_signal))
-            {
-                s1->s_refcount--;
-                s2->s_refcount--;
-                s3 = signal_newlike(s1);
-                if (s1->s_nchans != s2->s_nchans ||
-                    s1->s_length != s2->s_length)
-                {
-                    pd_error(u->u_obj,
-                        "%s: incompatible signal inputs (%dx%d vs. %dx%d)",
-                        class_getname(u->u_obj->ob_pd),
-                            s1->s_nchans, s1->s_length,
-                            s2->s_nchans, s2->s_length);
-                    dsp_add_copy(s1->s_vec, s3->s_vec,
-                        s1->s_length * s1->s_nchans);
-                }
-                else
-                {
-                    if (s1->s_sr != s2->s_sr)
-                        bug("signals sample rate mismatch");
-                    dsp_add_plus(s1->s_vec, s2->s_vec, s3->s_vec,
-                        s1->s_length * s1->s_nchans);
-                }
-                uin->i_signal = s3;
-                s3->s_refcount = 1;
-                if (!s1->s_refcount) signal_makereusable(s1);
-                if (!s2->s_refcount) signal_makereusable(s2);
-            }
-            else uin->i_signal = s1;
-            uin->i_ngot++;
-                /* if we didn't fill this inlet don't bother yet */
-            if (uin->i_ngot < uin->i_nconnect)
-                goto notyet;
-                /* if there's more than one, check them all */
-            if (u2->u_nin > 1)
-            {
-                for (uin = u2->u_in, n = u2->u_nin; n--; uin++)
-                    if (uin->i_ngot < uin->i_nconnect) goto notyet;
-            }
-                /* so now we can schedule the ugen.  */
-            ugen_doit(dc, u2);
-        notyet: ;
+            pd_error(u->u_obj,
+                "%s: incompatible signal inputs (%dx%d vs. %dx%d)",
+                class_getname(u->u_obj->ob_pd),
+                    s1->s_nchans, s1->s_length,
+                    s2->s_nchans, s2->s_length);
+            dsp_add_copy(s1->s_vec, s3->s_vec,
+                s1->s_length * s1->s_nchans);
         }
+        else
+        {
+            if (s1->s_sr != s2->s_sr)
+                bug("signals sample rate mismatch");
+            dsp_add_plus(s1->s_vec, s2->s_vec, s3->s_vec,
+                s1->s_length * s1->s_nchans);
+        }
+        uin->i_signal = s3;
+        s3->s_refcount = 1;
+        if (!s1->s_refcount) signal_makereusable(s1);
+        if (!s2->s_refcount) signal_makereusable(s2);
+    }
+    else uin->i_signal = s1;
+    uin->i_ngot++;
+        /* if we didn't fill this inlet don't bother yet */
+    if (uin->i_ngot < uin->i_nconnect)
+        return (0);
+        /* if there's more than one, check them all */
+    if (u2->u_nin > 1)
+    {
+        for (uin = u2->u_in, n = u2->u_nin; n--; uin++)
+            if (uin->i_ngot < uin->i_nconnect) return (0);
     }
+        /* so now we can schedule the ugen.  */
+    return (u2);
+}
+
+static void ugen_doit_end(t_ugenbox *u, t_signal **insig)
+{
     t_freebytes(insig,(u->u_nin + u->u_nout) * sizeof(t_signal *));
     u->u_done = 1;
 }
 
+    /* put a ugenbox on the chain, recursively putting any others on that
+    this one might uncover. */
+static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
+{
+    t_sigoutlet *uout;
+    t_sigoutconnect *oc;
+    t_ugenbox *u2;
+    t_signal **insig;
+    int i;
+    if (!(insig = ugen_doit_begin(dc, u)))
+        return;
+        /* pass it on and add anyone whose last inlet was filled */
+    for (uout = u->u_out, i = u->u_nout; i--; uout++)
+        for (oc = uout->o_connections; oc; oc = oc->oc_next)
+            if ((u2 = ugen_passon(dc, u, uout->o_signal, oc)))
+                ugen_doit(dc, u2);
+    ugen_doit_end(u, insig);
+}
+
+#ifdef BAREPD
+    /* Long chains of tilde objects nest ugen_doit() as deep as the chain is
+    long.  ugen_schedule() does the same walk with an explicit stack of
+    frames, one per ugen whose outputs are being passed on, and takes the
+    connections one at a time just as the recursion does, so the chain comes
+    out in exactly the same order. */
+
+typedef struct _ugenframe
+{
+    t_ugenbox *f_ugen;
+    t_signal **f_insig;             /* from ugen_doit_begin() */
+    int f_outno;                    /* outlet being passed on */
+    t_sigoutconnect *f_next;        /* its next connection to pass on to */
+} t_ugenframe;
+
+static int ugen_push(t_dspcontext *dc, int depth, t_ugenbox *u)
+{
+    t_signal **insig;
+    t_ugenframe *f;
+    if (!(insig = ugen_doit_begin(dc, u)))
+        return (depth);
+    if (depth == dc->dc_stacksize)
+    {
+        int newsize = (dc->dc_stacksize ? 2 * dc->dc_stacksize : 64);
+        dc->dc_stack = (t_ugenframe *)resizebytes(dc->dc_stack,
+            dc->dc_stacksize * sizeof(*dc->dc_stack),
+                newsize * sizeof(*dc->dc_stack));
+        dc->dc_stacksize = newsize;
+    }
+    f = &dc->dc_stack[depth];
+    f->f_ugen = u;
+    f->f_insig = insig;
+    f->f_outno = 0;
+    f->f_next = (u->u_nout ? u->u_out[0].o_connections : 0);
+    return (depth + 1);
+}
+
+    /* schedule a ugen and then everything that becomes ready because of it */
+static void ugen_schedule(t_dspcontext *dc, t_ugenbox *u)
+{
+    int depth;
+    if (THIS->u_recursivesort)
+    {
+        ugen_doit(dc, u);
+        return;
+    }
+    depth = ugen_push(dc, 0, u);
+    while (depth)
+    {
+        t_ugenframe *f = &dc->dc_stack[depth - 1];
+        t_sigoutconnect *oc;
+        t_ugenbox *u2;
+        if ((oc = f->f_next))
+        {
+            f->f_next = oc->oc_next;
+            if ((u2 = ugen_passon(dc, f->f_ugen,
+                f->f_ugen->u_out[f->f_outno].o_signal, oc)))
+                    depth = ugen_push(dc, depth, u2);
+        }
+        else if (++f->f_outno < f->f_ugen->u_nout)
+            f->f_next = f->f_ugen->u_out[f->f_outno].o_connections;
+        else
+        {
+            ugen_doit_end(f->f_ugen, f->f_insig);
+            depth--;
+        }
+    }
+}
+
+    /* "pd recursivesort 1": sort with ugen_doit() as vanilla Pd does, to
+    check that ugen_schedule() gives the same chain */
+void glob_recursivesort(void *dummy, t_floatarg f)
+{
+    if ((f != 0) != THIS->u_recursivesort)
+    {
+        THIS->u_recursivesort = (f != 0);
+        canvas_update_dsp();
+    }
+}
+#endif
+
     /* once the DSP graph is built, we call this routine to sort it.
     This routine also deletes the graph; later we might want to leave the
     graph around, in case the user is editing the DSP network, to save having
     to recreate it all the time.  But not today.  */
 
+#ifdef BAREPD
+    /* Automatic DSP sleep.  A subcanvas carrying a hidden switch~ (see
+    "DSP sleep" below) switches itself off once its signal inlets and
+    outlets have been silent for u_sleepblocks blocks, and on again as soon
+    as a non-silent signal reaches an inlet or a message reaches an inlet
+    (canvas_wake()).  Anything treated as silence here is below -140 dB. */
+
+#define SLEEP_SILENCE ((t_sample)1e-7)
+
+static int sleep_silent(t_int *w, int nsig)
+{
+    int i, j;
+    for (i = 0; i < nsig; i++)
+    {
+        t_sample *vec = (t_sample *)(w[2*i]);
+        int n = (int)(w[2*i + 1]);
+        for (j = 0; j < n; j++)
+            if (vec[j] > SLEEP_SILENCE || vec[j] < -SLEEP_SILENCE)
+                return (0);
+    }
+    return (1);
+}
+
+    /* before the block prolog: wake up on input */
+static t_int *sleep_wake_perform(t_int *w)
+{
+    t_block *x = (t_block *)(w[1]);
+    int nsig = (int)(w[2]);
+    if (x->x_autoslept && !sleep_silent(w + 3, nsig))
+    {
+        x->x_switchon = 1;
+        x->x_autoslept = 0;
+        x->x_sleepcount = 0;
+    }
+    return (w + 3 + 2*nsig);
+}
+
+    /* before the block epilog, so only while awake: count silent blocks */
+static t_int *sleep_check_perform(t_int *w)
+{
+    t_block *x = (t_block *)(w[1]);
+    int nsig = (int)(w[2]), nblocks = (int)(w[3]);
+    if (!x->x_autosleep || !sleep_silent(w + 4, nsig))
+        x->x_sleepcount = 0;
+    else if (++x->x_sleepcount >= nblocks)
+    {
+        x->x_switchon = 0;
+        x->x_autoslept = 1;
+        x->x_sleepcount = 0;
+    }
+    return (w + 4 + 2*nsig);
+}
+
+static void sleep_addsigs(t_int *vec, t_signal **sigs, int nsig)
+{
+    int i;
+    for (i = 0; i < nsig; i++)
+    {
+        vec[2*i] = (t_int)(sigs[i]->s_vec);
+        vec[2*i + 1] = (t_int)(sigs[i]->s_length * sigs[i]->s_nchans);
+    }
+}
+
+static void sleep_addwake(t_dspcontext *dc, t_block *blk)
+{
+    int nsig = (dc->dc_iosigs ? dc->dc_ninlets : 0);
+    t_int *vec;
+    if (!nsig)
+        return;
+    vec = (t_int *)getbytes((2 + 2*nsig) * sizeof(*vec));
+    vec[0] = (t_int)blk;
+    vec[1] = nsig;
+    sleep_addsigs(vec + 2, dc->dc_iosigs, nsig);
+    dsp_addv(sleep_wake_perform, 2 + 2*nsig, vec);
+    freebytes(vec, (2 + 2*nsig) * sizeof(*vec));
+}
+
+static void sleep_addcheck(t_dspcontext *dc, t_block *blk)
+{
+    int nsig = (dc->dc_iosigs ? dc->dc_ninlets + dc->dc_noutlets : 0);
+    t_int *vec;
+    blk->x_sleepcount = 0;
+    if (THIS->u_sleepblocks <= 0 || dc->dc_hassink)
+        return;
+    vec = (t_int *)getbytes((3 + 2*nsig) * sizeof(*vec));
+    vec[0] = (t_int)blk;
+    vec[1] = nsig;
+    vec[2] = THIS->u_sleepblocks;
+    sleep_addsigs(vec + 3, dc->dc_iosigs, nsig);
+    dsp_addv(sleep_check_perform, 3 + 2*nsig, vec);
+    freebytes(vec, (3 + 2*nsig) * sizeof(*vec));
+}
+
+    /* A canvas may only fall silent if its sound goes nowhere but its own
+    outlet~s and it gets sound from nowhere but its own inlet~s.  Objects
+    without signal outlets (dac~, send~, throw~, tabwrite~, env~, and
+    subcanvases without outlet~) rule that out, and so do the objects that
+    get sound from elsewhere: receive~, catch~, adc~, delay lines and
+    tables written outside (delread~, delread4~ alias vd~, tabreceive~) and
+    players started by messages that needn't come through an inlet
+    (readsf~, tabplay~).  A canvas with objects bound to a name is a sink
+    from the start (ugen_setsleep()).  A sink makes all containing canvases
+    sinks too. */
+static void sleep_findsinks(t_dspcontext *dc)
+{
+    static const char *sourcenames[] = {"receive~", "catch~", "adc~",
+        "delread~", "delread4~", "tabreceive~", "readsf~", "tabplay~"};
+    static t_symbol *sources[sizeof(sourcenames)/sizeof(*sourcenames)];
+    int nsources = sizeof(sources)/sizeof(*sources), i;
+    t_ugenbox *u;
+    if (!sources[0])
+        for (i = 0; i < nsources; i++)
+            sources[i] = gensym(sourcenames[i]);
+    for (u = dc->dc_ugenlist; u && !dc->dc_hassink; u = u->u_next)
+    {
+        t_class *c = pd_class(&u->u_obj->ob_pd);
+        t_symbol *name;
+        if (c == vinlet_class || c == voutlet_class || c == block_class)
+            continue;
+        if (!u->u_nout)
+        {
+            dc->dc_hassink = 1;
+            break;
+        }
+        name = gensym(class_getname(c));
+        for (i = 0; i < nsources; i++)
+            if (name == sources[i])
+                dc->dc_hassink = 1;
+    }
+    if (dc->dc_hassink && dc->dc_parentcontext)
+        dc->dc_parentcontext->dc_hassink = 1;
+}
+#endif /* BAREPD */
+
 void ugen_done_graph(t_dspcontext *dc)
 {
     t_ugenbox *u;
@@ -1100,6 +1547,12 @@ void ugen_done_graph(t_dspcontext *dc)
             else blk = (t_block *)zz;
         }
     }
+#ifdef BAREPD
+        /* a canvas without its own block~ or switch~ may still carry a
+        hidden switch~ so that it can be put to sleep. */
+    if (!blk && dc->dc_sleepblock && dc->dc_ugenlist)
+        blk = dc->dc_sleepblock;
+#endif
 
         /* figure out block size, calling frequency, sample rate */
     if (parent_context)
@@ -1167,7 +1620,12 @@ void ugen_done_graph(t_dspcontext *dc)
         the case that there was a signal loop.  But we don't know this
         yet.  */
 
+#ifdef BAREPD
+        /* ... unless only switched: then the outlet~s borrow them */
+    if (dc->dc_iosigs && reblock)
+#else
     if (dc->dc_iosigs && (switched || reblock))
+#endif
     {
         t_signal **sigp;
         for (i = 0, sigp = dc->dc_iosigs + dc->dc_ninlets; i < dc->dc_noutlets;
@@ -1211,6 +1669,10 @@ void ugen_done_graph(t_dspcontext *dc)
                 outsigs, calcsize, THIS->u_phase, period, frequency,
                     downsample, upsample, reblock, switched);
     }
+#ifdef BAREPD
+    if (blk && blk == dc->dc_sleepblock)
+        sleep_addwake(dc, blk);
+#endif
     chainblockbegin = THIS->u_dspchainsize;
 
     if (blk && (reblock || switched))   /* add the block DSP prolog */
@@ -1237,7 +1699,11 @@ void ugen_done_graph(t_dspcontext *dc)
         for (uin = u->u_in, i = u->u_nin; i--; uin++)
             if (uin->i_nconnect) goto next;
 
+#ifdef BAREPD
+        ugen_schedule(dc, u);
+#else
         ugen_doit(dc, u);
+#endif
     next: ;
     }
 
@@ -1270,6 +1736,11 @@ void ugen_done_graph(t_dspcontext *dc)
         break;   /* don't need to keep looking. */
     }
 
+#ifdef BAREPD
+    sleep_findsinks(dc);
+    if (blk && blk == dc->dc_sleepblock)
+        sleep_addcheck(dc, blk);
+#endif
     if (blk && (reblock || switched))    /* add block DSP epilog */
         dsp_add(block_epilog, 1, blk);
     chainblockend = THIS->u_dspchainsize;
@@ -1328,6 +1799,12 @@ void ugen_done_graph(t_dspcontext *dc)
         dc->dc_ugenlist = u->u_next;
         freebytes(u, sizeof *u);
     }
+#ifdef BAREPD
+    if (dc->dc_hashsize)
+        freebytes(dc->dc_ugenhash, dc->dc_hashsize * sizeof(*dc->dc_ugenhash));
+    if (dc->dc_stacksize)
+        freebytes(dc->dc_stack, dc->dc_stacksize * sizeof(*dc->dc_stack));
+#endif
     if (THIS->u_context == dc)
         THIS->u_context = dc->dc_parentcontext;
     else bug("THIS->u_context");
@@ -1376,6 +1853,11 @@ t_int *plus_perf8(t_int *w)
 
 void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n)
 {
+#ifdef BAREPD
+    if (n == DEFDACBLKSIZE)
+        dsp_add(plus_perfblk, 4, in1, in2, out, (t_int)n);
+    else
+#endif
     if (n&7)
         dsp_add(plus_perform, 4, in1, in2, out, (t_int)n);
     else
@@ -1422,6 +1904,11 @@ t_int *copy_perf8(t_int *w)
 
 void dsp_add_copy(t_sample *in, t_sample *out, int n)
 {
+#ifdef BAREPD
+    if (n == DEFDACBLKSIZE)
+        dsp_add(copy_perfblk, 3, in, out, (t_int)n);
+    else
+#endif
     if (n&7)
         dsp_add(copy_perform, 3, in, out, (t_int)n);
     else
@@ -1460,12 +1947,195 @@ t_int *scalarcopy_perf8(t_int *w)
 
 void dsp_add_scalarcopy(t_float *in, t_sample *out, int n)
 {
+#ifdef BAREPD
+    if (n == DEFDACBLKSIZE)
+        dsp_add(scalarcopy_perfblk, 3, in, out, (t_int)n);
+    else
+#endif
     if (n&7)
         dsp_add(scalarcopy_perform, 3, in, out, (t_int)n);
     else
         dsp_add(scalarcopy_perf8, 3, in, out, (t_int)n);
 }
 
+#ifdef BAREPD
+/* -------- fixed-size versions of the above (BarePD) -------- */
+
+/* BarePD's top-level block size is fixed at build time, and most signals in
+a patch are exactly that long.  These are the perf8 routines with the vector
+size a constant, so that the compiler knows the trip count: the loop needs
+no tests for the remainder and can be vectorized and unrolled as a whole.
+The dsp_add_...() routines above pick them when the size matches. */
+
+t_int *zero_perfblk(t_int *w)
+{
+    t_sample *out = (t_sample *)(w[1]);
+    int i;
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, out += 8)
+    {
+        out[0] = 0; out[1] = 0; out[2] = 0; out[3] = 0;
+        out[4] = 0; out[5] = 0; out[6] = 0; out[7] = 0;
+    }
+    return (w+3);
+}
+
+t_int *plus_perfblk(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *in2 = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int i;
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, in1 += 8, in2 += 8, out += 8)
+    {
+        t_sample f0 = in1[0], f1 = in1[1], f2 = in1[2], f3 = in1[3];
+        t_sample f4 = in1[4], f5 = in1[5], f6 = in1[6], f7 = in1[7];
+
+        t_sample g0 = in2[0], g1 = in2[1], g2 = in2[2], g3 = in2[3];
+        t_sample g4 = in2[4], g5 = in2[5], g6 = in2[6], g7 = in2[7];
+
+        out[0] = f0 + g0; out[1] = f1 + g1; out[2] = f2 + g2; out[3] = f3 + g3;
+        out[4] = f4 + g4; out[5] = f5 + g5; out[6] = f6 + g6; out[7] = f7 + g7;
+    }
+    return (w+5);
+}
+
+t_int *copy_perfblk(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int i;
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, in1 += 8, out += 8)
+    {
+        t_sample f0 = in1[0], f1 = in1[1], f2 = in1[2], f3 = in1[3];
+        t_sample f4 = in1[4], f5 = in1[5], f6 = in1[6], f7 = in1[7];
+
+        out[0] = f0; out[1] = f1; out[2] = f2; out[3] = f3;
+        out[4] = f4; out[5] = f5; out[6] = f6; out[7] = f7;
+    }
+    return (w+4);
+}
+
+t_int *scalarcopy_perfblk(t_int *w)
+{
+    t_float f = *(t_float *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int i;
+    for (i = 0; i < DEFDACBLKSIZE; i += 8, out += 8)
+    {
+        out[0] = f; out[1] = f; out[2] = f; out[3] = f;
+        out[4] = f; out[5] = f; out[6] = f; out[7] = f;
+    }
+    return (w+4);
+}
+
+/* ------------------------ DSP sleep (BarePD) ------------------------ */
+
+/* A canvas may be given a hidden switch~ that isn't part of its object list.
+It behaves exactly like a [switch~] with default arguments: while the
+canvas is asleep its ugens are skipped and the regular switch~ epilog
+zeroes its signal outlets.  The canvas is either put to sleep by its owner
+(the voice allocator does this for idle [clone] voices) or, with
+"autosleep" set, falls asleep by itself when it goes silent. */
+
+t_pd *dsp_sleep_new(void)
+{
+    t_block *x = (t_block *)switch_new(0, 0, 0);
+    x->x_switchon = 1;
+    return (&x->x_obj.ob_pd);
+}
+
+void dsp_sleep_free(t_pd *x)
+{
+    pd_free(x);
+}
+
+void dsp_sleep_set(t_pd *x, int asleep)
+{
+    t_block *b = (t_block *)x;
+    b->x_autoslept = 0;
+    b->x_sleepcount = 0;
+    block_float(b, (asleep == 0));
+}
+
+int dsp_sleep_get(t_pd *x)
+{
+    return (!((t_block *)x)->x_switchon);
+}
+
+    /* wake up a canvas that fell asleep by itself */
+void dsp_sleep_wake(t_pd *x)
+{
+    t_block *b = (t_block *)x;
+    if (b->x_autoslept)
+        dsp_sleep_set(x, 0);
+}
+
+void dsp_sleep_setauto(t_pd *x, int flag)
+{
+    t_block *b = (t_block *)x;
+    b->x_autosleep = (flag != 0);
+    if (!flag)
+        dsp_sleep_wake(x);
+}
+
+int dsp_sleep_getblocks(void)
+{
+    return (THIS->u_sleepblocks);
+}
+
+    /* "receives": the canvas gets messages other than through its inlets,
+    which don't wake it up, so it mustn't fall asleep by itself */
+void ugen_setsleep(t_dspcontext *dc, t_pd *x, int receives)
+{
+    dc->dc_sleepblock = (t_block *)x;
+    dc->dc_hassink = (receives != 0);
+}
+
+    /* "pd dspsleep <n>": let subpatches fall asleep after n silent blocks;
+    zero turns automatic sleep off. */
+void glob_dspsleep(void *dummy, t_floatarg f)
+{
+    int n = (f > 0 ? (int)f : 0);
+    if (n != THIS->u_sleepblocks)
+    {
+        THIS->u_sleepblocks = n;
+        canvas_update_dsp();
+    }
+}
+
+/* ---------------------- compiled DSP (BarePD) ---------------------- */
+
+/* A patch's DSP chain can be replaced by straight-line code generated
+offline (see tools/pdc).  dsp_getmap() describes the chain so that the
+generated code can check it was made for this very chain before it takes
+over from dsp_tick(). */
+
+int dsp_getmap(t_int **chain, t_dspentry **map)
+{
+    *chain = THIS->u_dspchain;
+    *map = THIS->u_dspmap;
+    return (THIS->u_dspchain ? THIS->u_dspmapsize : 0);
+}
+
+    /* run "fn" instead of the chain until the chain is rebuilt */
+void dsp_setcompiled(t_dspcompiled fn)
+{
+    THIS->u_compiled = (THIS->u_dspchain ? fn : 0);
+}
+
+void dsp_setchainhook(t_dspchainhook fn)
+{
+    THIS->u_chainhook = fn;
+}
+
+    /* called by canvas_start_dsp() once all canvases have been scheduled */
+void dsp_chaindone(void)
+{
+    if (THIS->u_chainhook)
+        (*THIS->u_chainhook)();
+}
+#endif /* BAREPD */
+
 /* ------------------------ samplerate~~ -------------------------- */
 
 static t_class *samplerate_tilde_class;
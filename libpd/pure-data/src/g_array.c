@@ -119,6 +119,11 @@ struct _garray
     unsigned int  x_listviewing:1;  /* list view window is open */
     unsigned int  x_hidename:1;     /* don't print name above graph */
     unsigned int  x_edit:1;         /* we can edit the array */
+#ifdef BAREPD
+    unsigned char *x_compact;   /* compact samples, see garray_setcompact */
+    int x_compactn;             /* number of compact samples */
+    int x_compactbytes;         /* bytes per compact sample, 2 or 3 */
+#endif
 };
 
 static t_pd *garray_arraytemplatecanvas;  /* written at setup w/ global lock */
@@ -178,13 +183,22 @@ static t_garray *graph_scalar(t_glist *gl, t_symbol *s, t_symbol *templatesym,
     x->x_savesize = savesize;
     x->x_listviewing = 0;
     x->x_edit = 1;
+#ifdef BAREPD
+    x->x_compact = 0;
+    x->x_compactn = 0;
+    x->x_compactbytes = 0;
+#endif
     glist_add(gl, &x->x_gobj);
     x->x_glist = gl;
     return (x);
 }
 
     /* get a garray's "array" structure. */
+#ifdef BAREPD
+static t_array *garray_dogetarray(t_garray *x)
+#else
 t_array *garray_getarray(t_garray *x)
+#endif
 {
     int zonset, ztype;
     t_symbol *zarraytype;
@@ -211,6 +225,110 @@ t_array *garray_getarray(t_garray *x)
     return (sc->sc_vec[zonset].w_array);
 }
 
+#ifdef BAREPD
+static void garray_fittograph(t_garray *x, int n, int style);
+
+    /* free compact samples without touching the float array */
+static void garray_freecompact(t_garray *x)
+{
+    if (x->x_compact)
+        freebytes(x->x_compact, (size_t)x->x_compactn * x->x_compactbytes);
+    x->x_compact = 0;
+    x->x_compactn = 0;
+    x->x_compactbytes = 0;
+}
+
+    /* convert compact samples back to floats.  This is how everything but
+    tabread~, tabread4~ and tabplay~ sees them, so that arrays stay usable
+    by any object, at the cost of their memory. */
+static void garray_expand(t_garray *x)
+{
+    t_array *array = garray_dogetarray(x);
+    unsigned char *cvec = x->x_compact;
+    int i, n = x->x_compactn, bytes = x->x_compactbytes;
+    t_word *vec;
+
+        /* resizing may redraw the array, which comes back here */
+    x->x_compact = 0;
+    array_resize_and_redraw(array, x->x_glist, n);
+    x->x_compact = cvec;
+    if (array->a_n != n)
+    {
+        pd_error(x, "%s: no memory to convert samples to floats",
+            x->x_realname->s_name);
+        return;
+    }
+    vec = (t_word *)array->a_vec;
+    if (bytes == 2)
+        for (i = 0; i < n; i++)
+            vec[i].w_float = COMPACT_GET16(cvec, i);
+    else for (i = 0; i < n; i++)
+        vec[i].w_float = COMPACT_GET24(cvec, i);
+    garray_freecompact(x);
+}
+
+t_array *garray_getarray(t_garray *x)
+{
+    if (x->x_compact)
+        garray_expand(x);
+    return (garray_dogetarray(x));
+}
+
+    /* replace the array's contents by n zeroed compact samples of 2 or 3
+    bytes each, returned for the caller to fill in, who then calls
+    garray_compactdone().  The float array is shrunk to one point
+    meanwhile. */
+unsigned char *garray_setcompact(t_garray *x, int n, int bytes)
+{
+    t_array *array = garray_dogetarray(x);
+    t_template *template;
+    int yonset, type;
+    t_symbol *arraytype;
+
+    if (!array || !(template = template_findbyname(array->a_templatesym)) ||
+        !template_find_field(template, gensym("y"), &yonset,
+            &type, &arraytype) || type != DT_FLOAT ||
+                array->a_elemsize != sizeof(t_word))
+    {
+        pd_error(0, "%s: needs floating-point 'y' field",
+            x->x_realname->s_name);
+        return (0);
+    }
+    if (n < 1)
+        n = 1;
+    garray_freecompact(x);
+    garray_fittograph(x, n, template_getfloat(
+        template_findbyname(x->x_scalar->sc_template),
+            gensym("style"), x->x_scalar->sc_vec, 1));
+    array_resize_and_redraw(array, x->x_glist, 1);
+    if (!(x->x_compact = (unsigned char *)getbytes((size_t)n * bytes)))
+        return (0);
+    x->x_compactn = n;
+    x->x_compactbytes = bytes;
+    return (x->x_compact);
+}
+
+    /* objects that hold on to the float array must let go of it, and those
+    that only read floats convert the samples back while the DSP chain is
+    rebuilt rather than in their perform routines.  Not done by
+    garray_setcompact(), as that would convert them before they are in. */
+void garray_compactdone(t_garray *x)
+{
+    if (x->x_usedindsp)
+        canvas_update_dsp();
+}
+
+int garray_getcompact(t_garray *x, int *size, const unsigned char **vec,
+    t_array **arrayp)
+{
+    if (!x->x_compact || !(*arrayp = garray_dogetarray(x)))
+        return (0);
+    *size = x->x_compactn;
+    *vec = x->x_compact;
+    return (x->x_compactbytes);
+}
+#endif
+
     /* get the "array" structure and furthermore check it's float */
 static t_array *garray_getarray_floatonly(t_garray *x,
     int *yonsetp, int *elemsizep)
@@ -557,6 +675,9 @@ static void garray_free(t_garray *x)
     while ((x2 = pd_findbyclass(gensym("#A"), garray_class)))
         pd_unbind(x2, gensym("#A"));
     pd_free(&x->x_scalar->sc_gobj.g_pd);
+#ifdef BAREPD
+    garray_freecompact(x);
+#endif
 }
 
 /* ------------- code used by both array and plot widget functions ---- */
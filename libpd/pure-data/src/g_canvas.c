@@ -32,6 +32,11 @@ struct _canvasenvironment
 typedef struct _canvas_private
 {
     t_undo undo;
+#ifdef BAREPD
+    t_pd *sleepblock;   /* hidden switch~, see canvas_setsleepable() */
+    int sleepable;      /* sleep is managed by the canvas's owner */
+    int receives;       /* contains objects bound to a name, see pd_bind() */
+#endif
 } t_canvas_private;
 
 #define GLIST_DEFCANVASWIDTH 450
@@ -921,6 +926,10 @@ void canvas_free(t_canvas *x)
         freebytes(x->gl_env, sizeof(*x->gl_env));
     }
     canvas_undo_free(x);
+#ifdef BAREPD
+    if (private->sleepblock)
+        dsp_sleep_free(private->sleepblock);
+#endif
     freebytes(private, sizeof(*private));
     canvas_resume_dsp(dspstate);
     freebytes(x->gl_xlabel, x->gl_nxlabels * sizeof(*(x->gl_xlabel)));
@@ -1333,6 +1342,10 @@ void ugen_add(t_dspcontext *dc, t_object *x);
 void ugen_connect(t_dspcontext *dc, t_object *x1, int outno,
     t_object *x2, int inno);
 void ugen_done_graph(t_dspcontext *dc);
+#ifdef BAREPD
+void ugen_setsleep(t_dspcontext *dc, t_pd *x, int receives);
+static t_pd *canvas_getsleepblock(t_canvas *x);
+#endif
 
     /* schedule one canvas for DSP.  This is called below for all "root"
     canvases, but is also called from the "dsp" method for sub-
@@ -1363,6 +1376,11 @@ void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp)
     dc = ugen_start_graph(toplevel, sp,
         obj_nsiginlets(&x->gl_obj),
         obj_nsigoutlets(&x->gl_obj));
+#ifdef BAREPD
+    if (!toplevel)
+        ugen_setsleep(dc, canvas_getsleepblock(x),
+            ((t_canvas_private *)x->gl_privatedata)->receives);
+#endif
 
         /* find all the "dsp" boxes and add them to the graph */
 
@@ -1385,6 +1403,68 @@ static void canvas_dsp(t_canvas *x, t_signal **sp)
     canvas_dodsp(x, 0, sp);
 }
 
+#ifdef BAREPD
+    /* Subcanvases get a hidden switch~ so that their DSP can sleep, either
+    under control of their owner (canvas_setsleepable() and canvas_sleep())
+    or automatically when silent ("pd dspsleep").  Has no effect on
+    canvases that contain their own block~ or switch~. */
+static t_pd *canvas_getsleepblock(t_canvas *x)
+{
+    t_canvas_private *private = x->gl_privatedata;
+    int autosleep = (dsp_sleep_getblocks() > 0 && !private->sleepable);
+    if ((autosleep || private->sleepable) && !private->sleepblock)
+        private->sleepblock = dsp_sleep_new();
+    else if (!autosleep && !private->sleepable && private->sleepblock)
+    {
+        dsp_sleep_free(private->sleepblock);
+        private->sleepblock = 0;
+    }
+    if (private->sleepblock)
+        dsp_sleep_setauto(private->sleepblock, autosleep);
+    return (private->sleepblock);
+}
+
+    /* the caller is responsible for resorting the DSP chain. */
+void canvas_setsleepable(t_canvas *x, int flag)
+{
+    t_canvas_private *private = x->gl_privatedata;
+    private->sleepable = (flag != 0);
+    if (flag && !private->sleepblock)
+        private->sleepblock = dsp_sleep_new();
+    else if (!flag && private->sleepblock)
+        dsp_sleep_set(private->sleepblock, 0);
+}
+
+void canvas_sleep(t_canvas *x, int asleep)
+{
+    t_canvas_private *private = x->gl_privatedata;
+    if (private->sleepblock)
+        dsp_sleep_set(private->sleepblock, asleep);
+}
+
+    /* An object inside the canvas was bound to a name ([r], MIDI input,
+    GUIs with a receive name...).  Messages to it don't come through an
+    inlet, so the canvas can't fall asleep by itself any more. */
+void canvas_setreceives(t_canvas *x)
+{
+    t_canvas_private *private = x->gl_privatedata;
+    private->receives = 1;
+}
+
+    /* wake up a canvas, and the ones containing it, if silence put them
+    to sleep.  Called when a message arrives at an inlet and when a clock
+    of an object in the canvas goes off. */
+void canvas_wake(t_canvas *x)
+{
+    for (; x; x = x->gl_owner)
+    {
+        t_canvas_private *private = x->gl_privatedata;
+        if (private->sleepblock)
+            dsp_sleep_wake(private->sleepblock);
+    }
+}
+#endif /* BAREPD */
+
 int canvas_dspstate;    /* for back compatibility with externs - don't use */
 
     /* this routine starts DSP for all root canvases. */
@@ -1397,6 +1477,9 @@ static void canvas_start_dsp(void)
 
     for (x = pd_getcanvaslist(); x; x = x->gl_next)
         canvas_dodsp(x, 1, 0);
+#ifdef BAREPD
+    dsp_chaindone();
+#endif
 
     canvas_dspstate = THISGUI->i_dspstate = 1;
     if (gensym("pd-dsp-started")->s_thing)
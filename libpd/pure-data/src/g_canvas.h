@@ -570,6 +570,23 @@ EXTERN void linetraverser_skipobject(t_linetraverser *t);
 /* --------- functions on garrays (graphical arrays) -------------------- */
 
 EXTERN t_template *garray_template(t_garray *x);
+#ifdef BAREPD
+    /* samples read by "soundfiler read -compact" are kept as 16-bit or
+    packed little-endian 24-bit integers.  garray_getcompact() returns the
+    bytes per sample, or 0 if the array holds floats as usual, and the
+    one-point float array standing in for the samples, for gpointers. */
+EXTERN unsigned char *garray_setcompact(t_garray *x, int n, int bytes);
+EXTERN void garray_compactdone(t_garray *x);
+EXTERN int garray_getcompact(t_garray *x, int *size,
+    const unsigned char **vec, t_array **arrayp);
+#define COMPACT_SCALE16 ((t_sample)(1. / 32768.))
+#define COMPACT_SCALE24 ((t_sample)(1. / 2147483648.))
+#define COMPACT_GET16(vec, i) \
+    (COMPACT_SCALE16 * ((const short *)(vec))[i])
+#define COMPACT_GET24(vec, i) (COMPACT_SCALE24 * (int)( \
+    ((unsigned)(vec)[3*(i)] << 8) | ((unsigned)(vec)[3*(i)+1] << 16) | \
+        ((unsigned)(vec)[3*(i)+2] << 24)))
+#endif
 
 /* -------------------- arrays --------------------- */
 #define GRAPH_ARRAY_SAVE 1      /* flags for graph_array() below */
@@ -657,10 +674,52 @@ EXTERN t_symbol *iemgui_put_in_braces(t_symbol *s);
 
 /*-------------  g_clone.c ------------- */
 EXTERN t_class *clone_class;
+#ifdef BAREPD
+EXTERN t_pd *clone_find(t_symbol *name);
+EXTERN int clone_get_n(t_gobj *x);
+EXTERN int clone_get_startvoice(t_pd *z);
+EXTERN void clone_setsleepable(t_pd *z, int flag);
+EXTERN void clone_voice_sleep(t_pd *z, int n, int asleep);
+EXTERN void clone_voice_send(t_pd *z, int n, int inno, int argc,
+    t_atom *argv);
+#endif
 
 /*-------------  d_ugen.c ------------- */
 EXTERN void signal_setborrowed(t_signal *sig, t_signal *sig2);
 EXTERN void signal_makereusable(t_signal *sig);
+#ifdef BAREPD
+EXTERN t_pd *dsp_sleep_new(void);
+EXTERN void dsp_sleep_free(t_pd *x);
+EXTERN void dsp_sleep_set(t_pd *x, int asleep);
+EXTERN int dsp_sleep_get(t_pd *x);
+EXTERN void dsp_sleep_wake(t_pd *x);
+EXTERN void dsp_sleep_setauto(t_pd *x, int flag);
+EXTERN int dsp_sleep_getblocks(void);
+EXTERN t_signal *signal_newlike(const t_signal *sig);
+EXTERN int signal_islocal(t_signal *sig);
+
+    /* one perform routine in the DSP chain, as seen by dsp_getmap() */
+typedef struct _dspentry
+{
+    int e_onset;            /* index of the routine in the chain */
+    int e_nargs;            /* number of arguments after it */
+    t_symbol *e_class;      /* class of the object that added it, or 0 */
+} t_dspentry;
+
+typedef void (*t_dspcompiled)(void);
+typedef void (*t_dspchainhook)(void);
+
+EXTERN int dsp_getmap(t_int **chain, t_dspentry **map);
+EXTERN void dsp_setcompiled(t_dspcompiled fn);
+EXTERN void dsp_setchainhook(t_dspchainhook fn);
+EXTERN void dsp_chaindone(void);
+
+/*-------------  g_canvas.c ------------- */
+EXTERN void canvas_setsleepable(t_canvas *x, int flag);
+EXTERN void canvas_sleep(t_canvas *x, int asleep);
+EXTERN void canvas_wake(t_canvas *x);
+EXTERN void canvas_setreceives(t_canvas *x);
+#endif
 
 
 #if defined(_LANGUAGE_C_PLUS_PLUS) || defined(__cplusplus)
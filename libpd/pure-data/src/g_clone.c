@@ -57,6 +57,9 @@ typedef struct _clone
     unsigned int x_suppressvoice:1; /* suppress voice number as $1 arg */
     unsigned int x_distributein:1;  /* distribute input signals across clones */
     unsigned int x_packout:1;       /* pack output signals */
+#ifdef BAREPD
+    unsigned int x_sleepable:1;     /* instances can be put to sleep */
+#endif
 } t_clone;
 
 int clone_match(t_pd *z, t_symbol *name, t_symbol *dir)
@@ -219,6 +222,10 @@ static void clone_initinstance(t_clone *x, int which, t_canvas *c)
         obj_connect(&x->x_vec[which].c_gl->gl_obj, i,
             (t_object *)(&outvec[i]), 0);
     }
+#ifdef BAREPD
+    if (x->x_sleepable)
+        canvas_setsleepable(c, 1);
+#endif
 }
 
 static void clone_freeinstance(t_clone *x, int which)
@@ -668,3 +675,68 @@ t_glist *clone_get_instance(t_gobj *x, int n)
     return  c->x_vec[n].c_gl;
 }
 
+#ifdef BAREPD
+    /* BarePD voice allocation: the allocator in the kernel finds a [clone]
+    by the name of its abstraction, feeds note messages straight to single
+    instances and puts idle instances to sleep.  Callers hold the Pd lock. */
+
+static t_pd *clone_dofind(t_glist *gl, t_symbol *name)
+{
+    t_gobj *y;
+    t_pd *z;
+    for (y = gl->gl_list; y; y = y->g_next)
+    {
+        if (pd_class(&y->g_pd) == clone_class)
+        {
+            if (((t_clone *)y)->x_s == name)
+                return (&y->g_pd);
+        }
+        else if (pd_class(&y->g_pd) == canvas_class &&
+            (z = clone_dofind((t_glist *)y, name)))
+                return (z);
+    }
+    return (0);
+}
+
+t_pd *clone_find(t_symbol *name)
+{
+    t_canvas *x;
+    t_pd *z;
+    for (x = pd_getcanvaslist(); x; x = x->gl_next)
+        if ((z = clone_dofind(x, name)))
+            return (z);
+    return (0);
+}
+
+int clone_get_startvoice(t_pd *z)
+{
+    return (((t_clone *)z)->x_startvoice);
+}
+
+void clone_setsleepable(t_pd *z, int flag)
+{
+    t_clone *x = (t_clone *)z;
+    int dspstate = canvas_suspend_dsp(), i;
+    x->x_sleepable = (flag != 0);
+    for (i = 0; i < x->x_n; i++)
+        canvas_setsleepable(x->x_vec[i].c_gl, flag);
+    canvas_resume_dsp(dspstate);
+}
+
+void clone_voice_sleep(t_pd *z, int n, int asleep)
+{
+    t_clone *x = (t_clone *)z;
+    if (n >= 0 && n < x->x_n)
+        canvas_sleep(x->x_vec[n].c_gl, asleep);
+}
+
+    /* send a message to one inlet of one instance, waking it first */
+void clone_voice_send(t_pd *z, int n, int inno, int argc, t_atom *argv)
+{
+    t_clone *x = (t_clone *)z;
+    if (n < 0 || n >= x->x_n)
+        return;
+    canvas_sleep(x->x_vec[n].c_gl, 0);
+    obj_sendinlet(&x->x_vec[n].c_gl->gl_obj, inno, &s_list, argc, argv);
+}
+#endif /* BAREPD */
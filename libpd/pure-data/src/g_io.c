@@ -23,6 +23,9 @@ static int symbol2resamplemethod(t_symbol*s)
     else if (s == gensym("lin"   )) return 2; /* up: linear interpolation */
     else if (s == gensym("linear")) return 2; /* up: linear interpolation */
     else if (s == gensym("pad"   )) return 0; /* up: zero pad */
+#ifdef BAREPD
+    else if (s == gensym("fir"   )) return 3; /* up/down: half-band FIR */
+#endif
     return -1;  /* default: sample/hold except zero-pad if version<0.44 */
 }
 
@@ -90,31 +93,49 @@ static void *vinlet_new(t_symbol *s)
 
 static void vinlet_bang(t_vinlet *x)
 {
+#ifdef BAREPD
+    canvas_wake(x->x_canvas);
+#endif
     outlet_bang(x->x_obj.ob_outlet);
 }
 
 static void vinlet_pointer(t_vinlet *x, t_gpointer *gp)
 {
+#ifdef BAREPD
+    canvas_wake(x->x_canvas);
+#endif
     outlet_pointer(x->x_obj.ob_outlet, gp);
 }
 
 static void vinlet_float(t_vinlet *x, t_float f)
 {
+#ifdef BAREPD
+    canvas_wake(x->x_canvas);
+#endif
     outlet_float(x->x_obj.ob_outlet, f);
 }
 
 static void vinlet_symbol(t_vinlet *x, t_symbol *s)
 {
+#ifdef BAREPD
+    canvas_wake(x->x_canvas);
+#endif
     outlet_symbol(x->x_obj.ob_outlet, s);
 }
 
 static void vinlet_list(t_vinlet *x, t_symbol *s, int argc, t_atom *argv)
 {
+#ifdef BAREPD
+    canvas_wake(x->x_canvas);
+#endif
     outlet_list(x->x_obj.ob_outlet, s, argc, argv);
 }
 
 static void vinlet_anything(t_vinlet *x, t_symbol *s, int argc, t_atom *argv)
 {
+#ifdef BAREPD
+    canvas_wake(x->x_canvas);
+#endif
     outlet_anything(x->x_obj.ob_outlet, s, argc, argv);
 }
 
@@ -148,9 +169,19 @@ t_int *vinlet_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_reblocker *rb = (t_reblocker *)(w[3]);
     int advance = (int)(w[4]), n = (int)(w[5]), read = x->x_read;
+#ifdef BAREPD
+    int start = x->x_write + read, n1;
+    if (start >= x->x_buflength)
+        start -= x->x_buflength;
+    if ((n1 = x->x_buflength - start) > n)
+        n1 = n;
+    memcpy(out, rb->r_buf + start, n1 * sizeof(t_sample));
+    memcpy(out + n1, rb->r_buf, (n - n1) * sizeof(t_sample));
+#else
     t_sample *in = rb->r_buf + read;
     while (n--)
         *out++ = *in++;
+#endif
     if (advance)    /* only on last channel */
     {
         if ((read += advance) == x->x_buflength)
@@ -198,10 +229,27 @@ static void vinlet_dsp(t_vinlet *x, t_signal **sp)
 t_int *vinlet_doprolog(t_int *w)
 {
     t_vinlet *x = (t_vinlet *)(w[1]);
-    t_sample *in = (t_sample *)(w[2]), *out;
+    t_sample *in = (t_sample *)(w[2]);
     t_sample *buf = (t_sample *)(w[3]);
     int lastone = (int)(w[4]), n = (int)(w[5]), write = x->x_write;
-
+#ifdef BAREPD
+        /* rather than shifting the buffer down by a hop each time it fills
+        up, wrap around; vinlet_perform() reads the window from the write
+        position on, oldest sample first. */
+    int n1 = x->x_buflength - write;
+    if (n1 > n)
+        n1 = n;
+    memcpy(buf + write, in, n1 * sizeof(t_sample));
+    memcpy(buf, in + n1, (n - n1) * sizeof(t_sample));
+    if (lastone)    /* only advance write position on last channel! */
+    {
+        if ((write += n) >= x->x_buflength)
+            write -= x->x_buflength;
+        x->x_write = write;
+    }
+    return (w+6);
+#else
+    t_sample *out;
     if (write == x->x_buflength)
     {
         t_sample *f1 = buf, *f2 = buf + x->x_hop;
@@ -215,6 +263,7 @@ t_int *vinlet_doprolog(t_int *w)
     while (n--)
         *out++ = *in++;
     return (w+6);
+#endif
 }
 
 int inlet_getsignalindex(t_inlet *x);
@@ -275,6 +324,10 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
             x->x_write = prologphase ?
                 x->x_buflength - (x->x_hop - prologphase * re_parentvecsize) :
                     x->x_buflength;
+#ifdef BAREPD
+            if (x->x_write == x->x_buflength)
+                x->x_write = 0;
+#endif
             for (i = 0; i < x->x_nchans; i++)
             {
                 x->x_rb[i].r_updown.downsample = downsample;
@@ -453,12 +506,38 @@ int voutlet_issignal(t_voutlet *x)
     return (x->x_rb != 0);
 }
 
+#ifdef BAREPD
+    /* overlap-add, eight samples at a time like the perf8 routines */
+static void voutlet_add(t_sample *out, const t_sample *in, int n)
+{
+    for (; n >= 8; n -= 8, in += 8, out += 8)
+    {
+        t_sample f0 = out[0] + in[0], f1 = out[1] + in[1];
+        t_sample f2 = out[2] + in[2], f3 = out[3] + in[3];
+        t_sample f4 = out[4] + in[4], f5 = out[5] + in[5];
+        t_sample f6 = out[6] + in[6], f7 = out[7] + in[7];
+        out[0] = f0; out[1] = f1; out[2] = f2; out[3] = f3;
+        out[4] = f4; out[5] = f5; out[6] = f6; out[7] = f7;
+    }
+    while (n--)
+        *out++ += *in++;
+}
+#endif
+
     /* LATER optimize for non-overlapped case where the "+=" isn't needed */
 t_int *voutlet_perform(t_int *w)
 {
     t_voutlet *x = (t_voutlet *)(w[1]);
     t_sample *in = (t_sample *)(w[2]), *buf= (t_sample *)(w[3]);
     int lastone = (int)(w[4]), n = (int)(w[5]), write = x->x_write;
+#ifdef BAREPD
+        /* the block wraps around the end of the buffer at most once */
+    int n1 = x->x_buflength - write;
+    if (n1 > n)
+        n1 = n;
+    voutlet_add(buf + write, in, n1);
+    voutlet_add(buf, in + n1, n - n1);
+#else
     t_sample *out = buf + write,
         *endbuf = buf + x->x_buflength;
     while (n--)
@@ -467,6 +546,7 @@ t_int *voutlet_perform(t_int *w)
         if (out == endbuf)
             out = buf;
     }
+#endif
     if (lastone)    /* only advance write position on last channel! */
     {
         if ((write += x->x_hop) >= x->x_buflength)
@@ -487,8 +567,13 @@ static t_int *voutlet_doepilog(t_int *w)
     if (lastone)    /* only advance read position on last channel! */
         x->x_read = read + n;
     in = buf + read;
+#ifdef BAREPD
+    memcpy(out, in, n * sizeof(t_sample));
+    memset(in, 0, n * sizeof(t_sample));
+#else
     for (; n--; in++)
         *out++ = *in, *in = 0;
+#endif
     return (w+6);
 }
 
@@ -506,8 +591,13 @@ static t_int *voutlet_doepilog_resample(t_int *w)
     if (lastone)    /* only advance read position on last channel! */
         x->x_read = read + n;
     in = buf + read;
+#ifdef BAREPD
+    memcpy(out, in, n * sizeof(t_sample));
+    memset(in, 0, n * sizeof(t_sample));
+#else
     for (; n--; in++)
         *out++ = *in, *in = 0;
+#endif
     return (w+6);
 }
 
@@ -529,7 +619,13 @@ void voutlet_dspprolog(struct _voutlet *x, t_signal **parentsigs,
         &parentsigs[outlet_getsignalindex(x->x_parentoutlet)] : 0);
     if (!parentsigs)
         return;
+#ifdef BAREPD
+        /* switched outlets borrow too (see voutlet_dsp()), so that a
+        subpatch that can sleep costs no copy while it's awake */
+    if (reblock)
+#else
     if (switched || reblock)
+#endif
         x->x_borrowed = 0;
     else    /* OK, borrow it */
     {
@@ -576,6 +672,19 @@ static void voutlet_dsp(t_voutlet *x, t_signal **sp)
     x->x_nchans = sp[0]->s_nchans;
     if (x->x_borrowed)
     {
+#ifdef BAREPD
+            /* while switched off, the epilog zeroes the parent signal.  We
+            can only let it do that to a signal computed in this canvas;
+            anything else is copied to a signal of our own as before. */
+        if (x->x_justcopyout && !signal_islocal(sp[0]))
+        {
+            t_signal *s = signal_newlike(sp[0]);
+            signal_setborrowed(*x->x_parentsignal, s);
+            dsp_add_copy(sp[0]->s_vec, s->s_vec,
+                sp[0]->s_length * sp[0]->s_nchans);
+        }
+        else
+#endif
             /* if we're just going to make the signal available on the
             parent patch, hand it off to the parent signal. */
         signal_setborrowed(*x->x_parentsignal, sp[0]);
@@ -51,6 +51,9 @@ void g_canvas_freepdinstance( void);
 void d_ugen_newpdinstance( void);
 void d_ugen_freepdinstance( void);
 void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv);
+#ifdef BAREPD
+int conf_lazysetup(const char *name);
+#endif
 
 void s_stuff_newpdinstance(void)
 {
@@ -917,6 +920,16 @@ void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv)
       return;
     }
     pd_this->pd_newest = 0;
+#ifdef BAREPD
+        /* a built-in class that hasn't been set up yet (see m_conf.c) */
+    if (conf_lazysetup(s->s_name))
+    {
+        tryingalready++;
+        typedmess(dummy, s, argc, argv);
+        tryingalready--;
+        return;
+    }
+#endif
     class_loadsym = s;
     pd_globallock();
     if (sys_load_lib(canvas_getcurrent(), s->s_name))
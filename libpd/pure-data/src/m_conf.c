@@ -53,6 +53,99 @@ void d_osc_setup(void);
 void d_soundfile_setup(void);
 void d_ugen_setup(void);
 
+#ifdef BAREPD
+#include <string.h>
+
+    /* BarePD: the control and signal libraries below are not set up by
+    conf_init() but only when a patch first creates one of their objects,
+    which saves both boot time and the memory of the classes (their method
+    tables and selector symbols) a patch never uses.  Each entry lists the
+    object names its setup routine adds to pd_objectmaker.  The connective
+    and list objects stay in conf_init() because pd_objectmaker creates
+    "float", "symbol", "bang" and "list" boxes through fixed slots that
+    never reach new_anything(). */
+
+typedef struct _lazylib
+{
+    void (*l_setup)(void);
+    const char *l_names;        /* space separated object names */
+    int l_done;
+} t_lazylib;
+
+static t_lazylib conf_lazylibs[] =
+{
+    {x_acoustics_setup, "mtof ftom powtodb rmstodb dbtopow dbtorms"},
+    {x_interface_setup, "print trace"},
+    {x_time_setup, "delay del metro line timer pipe"},
+    {x_arithmetic_setup, "+ - * / pow max min log == != > < >= <= & && | || "
+        "<< >> % mod div sin cos tan atan atan2 sqrt exp abs wrap clip"},
+    {x_array_setup, "array table"},
+    {x_midi_setup, "midiin sysexin midirealtimein notein ctlin pgmin bendin "
+        "touchin polytouchin midiout noteout ctlout pgmout bendout touchout "
+        "polytouchout makenote stripnote poly bag"},
+    {x_misc_setup, "random loadbang namecanvas cputime realtime oscparse "
+        "oscformat fudiparse fudiformat"},
+    {x_net_setup, "netsend netreceive"},
+    {x_file_setup, "file"},
+    {x_qlist_setup, "text qlist textfile"},
+    {x_gui_setup, "openpanel savepanel key keyup keyname pdcontrol"},
+    {x_scalar_setup, "scalar"},
+    {expr_setup, "expr expr~ fexpr~"},
+    {d_arithmetic_setup, "+~ -~ *~ /~ max~ min~ log~ pow~"},
+    {d_array_setup, "tabwrite~ tabplay~ tabread~ tabread4~ tabsend~ "
+        "tabreceive~ tabread tabread4 tabwrite"},
+    {d_ctl_setup, "sig~ line~ vline~ snapshot~ vsnapshot~ env~ threshold~"},
+    {d_dac_setup, "dac~ adc~"},
+    {d_delay_setup, "delwrite~ delread~ delread4~ vd~"},
+    {d_fft_setup, "fft~ ifft~ rfft~ rifft~ framp~"},
+    {d_filter_setup, "hip~ lop~ bp~ biquad~ samphold~ rpole~ rzero~ "
+        "rzero_rev~ cpole~ czero~ czero_rev~ slop~"},
+    {d_global_setup, "send~ s~ receive~ r~ catch~ throw~"},
+    {d_math_setup, "dbtorms~ rmstodb~ dbtopow~ powtodb~ mtof~ ftom~ rsqrt~ "
+        "q8_rsqrt~ sqrt~ q8_sqrt~ wrap~ exp~ abs~ clip~"},
+    {d_misc_setup, "print~ bang~ snake_in~ snake_out~ snake~"},
+    {d_osc_setup, "phasor~ cos~ osc~ vcf~ noise~ tabosc4~"},
+    {d_soundfile_setup, "soundfiler readsf~ writesf~"},
+};
+
+#define NLAZYLIBS (sizeof(conf_lazylibs) / sizeof(*conf_lazylibs))
+
+static int conf_haslazyname(const char *names, const char *name)
+{
+    size_t len = strlen(name);
+    while (*names)
+    {
+        const char *end = strchr(names, ' ');
+        size_t n = (end ? (size_t)(end - names) : strlen(names));
+        if (n == len && !strncmp(names, name, len))
+            return (1);
+        if (!end)
+            break;
+        names = end + 1;
+    }
+    return (0);
+}
+
+    /* called from new_anything() for an object name that isn't known yet.
+    If one of the libraries provides it, set the library up and return 1 so
+    that the caller retries the creation. */
+int conf_lazysetup(const char *name)
+{
+    unsigned int i;
+    for (i = 0; i < NLAZYLIBS; i++)
+    {
+        t_lazylib *l = &conf_lazylibs[i];
+        if (!l->l_done && conf_haslazyname(l->l_names, name))
+        {
+            l->l_done = 1;
+            (*l->l_setup)();
+            return (1);
+        }
+    }
+    return (0);
+}
+#endif /* BAREPD */
+
 void conf_init(void)
 {
     g_array_setup();
@@ -74,6 +167,10 @@ void conf_init(void)
     g_traversal_setup();
     clone_setup();
     m_pd_setup();
+#ifdef BAREPD
+    x_connective_setup();
+    x_list_setup();
+#else
     x_acoustics_setup();
     x_interface_setup();
     x_connective_setup();
@@ -101,5 +198,6 @@ void conf_init(void)
     d_misc_setup();
     d_osc_setup();
     d_soundfile_setup();
+#endif
     d_ugen_setup();
 }
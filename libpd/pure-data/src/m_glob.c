@@ -43,6 +43,10 @@ void glob_forgetpreferences(t_pd *dummy);
 void glob_open(t_pd *ignore, t_symbol *name, t_symbol *dir, t_floatarg f);
 void glob_fastforward(t_pd *ignore, t_floatarg f);
 void glob_settracing(void *dummy, t_float f);
+#ifdef BAREPD
+void glob_dspsleep(void *dummy, t_floatarg f);
+void glob_recursivesort(void *dummy, t_floatarg f);
+#endif
 
 static void glob_helpintro(t_pd *dummy)
 {
@@ -138,6 +142,12 @@ void glob_init(void)
         gensym("verifyquit"), A_DEFFLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_foo, gensym("foo"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_dsp, gensym("dsp"), A_GIMME, 0);
+#ifdef BAREPD
+    class_addmethod(glob_pdobject, (t_method)glob_dspsleep,
+        gensym("dspsleep"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_recursivesort,
+        gensym("recursivesort"), A_FLOAT, 0);
+#endif
     class_addmethod(glob_pdobject, (t_method)glob_key, gensym("key"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_audiostatus,
         gensym("audiostatus"), 0);
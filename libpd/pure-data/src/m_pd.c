@@ -126,6 +126,11 @@ void m_pd_setup(void)
 
 void pd_bind(t_pd *x, t_symbol *s)
 {
+#ifdef BAREPD
+        /* an object receiving by name keeps its canvas from sleeping */
+    if (*x != canvas_class && pd_checkobject(x) && canvas_getcurrent())
+        canvas_setreceives(canvas_getcurrent());
+#endif
     if (s->s_thing)
     {
         if (*s->s_thing == bindlist_class)
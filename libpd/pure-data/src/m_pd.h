@@ -698,6 +698,13 @@ EXTERN t_int *copy_perform(t_int *args);
 EXTERN t_int *copy_perf8(t_int *args);
 EXTERN t_int *scalarcopy_perform(t_int *args);
 EXTERN t_int *scalarcopy_perf8(t_int *args);
+#ifdef BAREPD
+    /* the same for vectors of exactly DEFDACBLKSIZE samples */
+EXTERN t_int *plus_perfblk(t_int *args);
+EXTERN t_int *zero_perfblk(t_int *args);
+EXTERN t_int *copy_perfblk(t_int *args);
+EXTERN t_int *scalarcopy_perfblk(t_int *args);
+#endif
 
 EXTERN void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n);
 EXTERN void dsp_add_copy(t_sample *in, t_sample *out, int n);
@@ -49,8 +49,15 @@ struct _clock
     t_clockmethod c_fn;
     struct _clock *c_next;
     t_float c_unit;         /* >0 if in TIMEUNITS; <0 if in samples */
+#ifdef BAREPD
+    t_glist *c_canvas;      /* woken up when the clock goes off */
+#endif
 };
 
+#ifdef BAREPD
+void canvas_wake(t_glist *x);
+#endif
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -63,6 +70,10 @@ t_clock *clock_new(void *owner, t_method fn)
     x->c_fn = (t_clockmethod)fn;
     x->c_next = 0;
     x->c_unit = TIMEUNITPERMSEC;
+#ifdef BAREPD
+        /* objects make their clocks while their canvas is the current one */
+    x->c_canvas = canvas_getcurrent();
+#endif
     return (x);
 }
 
@@ -301,6 +312,10 @@ void sched_tick(void)
         pd_this->pd_systime = c->c_settime;
         clock_unset(pd_this->pd_clock_setlist);
         outlet_setstacklim();
+#ifdef BAREPD
+        if (c->c_canvas)
+            canvas_wake(c->c_canvas);
+#endif
         (*c->c_fn)(c->c_owner);
         if (!countdown--)
         {
@@ -195,7 +195,14 @@ double nt_tixtotime(LARGE_INTEGER *dumbass)
     first time we get called as a reference time of zero. */
 double sys_getrealtime(void)
 {
-#ifndef _WIN32
+#if defined(BAREPD)
+        /* ARM generic timer, see src/pd_clock.cpp */
+    extern double barepd_getrealtime(void);
+    static double then = -1;
+    double now = barepd_getrealtime();
+    if (then < 0) then = now;
+    return (now - then);
+#elif !defined(_WIN32)
     static struct timeval then;
     struct timeval now;
     gettimeofday(&now, 0);
@@ -88,7 +88,9 @@ typedef struct _audiosettings
 #define SENDDACS_YES 1
 #define SENDDACS_SLEPT 2
 
+#ifndef DEFDACBLKSIZE      /* BarePD sets this from the Makefile */
 #define DEFDACBLKSIZE 64
+#endif
 #define DEFDACSAMPLERATE 48000
 
                     /* s_audio.c */
@@ -32,6 +32,16 @@
 #define CLOCKHZ CLOCKS_PER_SEC
 #endif
 
+#ifdef BAREPD
+    /* bare metal: no process accounting, all CPU time is Pd's.  [cputime]
+    reads the high-resolution clock, which also backs sys_getrealtime();
+    CLOCKHZ is its rate rather than the host's process clock's. */
+#undef CLOCKHZ
+#define CLOCKHZ pd_clock_frequency()
+extern unsigned pd_clock_frequency(void);
+extern double barepd_getrealtime(void);
+#endif
+
 #include "m_private_utils.h"
 
 /* -------------------------- random ------------------------------ */
@@ -159,7 +169,9 @@ static t_class *cputime_class;
 typedef struct _cputime
 {
     t_object x_obj;
-#ifdef _WIN32
+#if defined(BAREPD)
+    double x_setcputime;
+#elif defined(_WIN32)
     LARGE_INTEGER x_kerneltime;
     LARGE_INTEGER x_usertime;
     int x_warned;
@@ -170,7 +182,9 @@ typedef struct _cputime
 
 static void cputime_bang(t_cputime *x)
 {
-#ifdef _WIN32
+#if defined(BAREPD)
+    x->x_setcputime = barepd_getrealtime();
+#elif defined(_WIN32)
     FILETIME ignorethis, ignorethat;
     BOOL retval;
     retval = GetProcessTimes(GetCurrentProcess(), &ignorethis, &ignorethat,
@@ -190,7 +204,10 @@ static void cputime_bang(t_cputime *x)
 
 static void cputime_bang2(t_cputime *x)
 {
-#ifndef _WIN32
+#if defined(BAREPD)
+    outlet_float(x->x_obj.ob_outlet,
+        (barepd_getrealtime() - x->x_setcputime) * 1000.);
+#elif !defined(_WIN32)
     t_float elapsedcpu;
     struct tms newcputime;
     times(&newcputime);
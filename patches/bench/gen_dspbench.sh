@@ -0,0 +1,72 @@
+#!/bin/bash
+#
+# gen_dspbench.sh - generate a DSP sort benchmark patch
+#
+# Usage: ./gen_dspbench.sh <ugens> [voices] [outdir]
+#
+# Writes <outdir>/main.pd (default: current directory) containing a chain
+# of <ugens> tilde objects with extra cross connections. With [voices],
+# the chain goes into dspvoice.pd instead and main.pd holds
+# [clone dspvoice <voices>].
+#
+# Copy the files to the SD card and read "DSP graph sorted in ... us" in
+# the boot log. Sort time should grow linearly with ugens x voices.
+#
+
+set -e
+
+NUGENS="$1"
+NVOICES="${2:-0}"
+OUTDIR="${3:-.}"
+
+if [[ -z "$NUGENS" || "$NUGENS" -lt 3 ]]; then
+    echo "Usage: $0 <ugens (3 or more)> [voices] [outdir]" >&2
+    exit 1
+fi
+
+# emit_chain <file> <source object> <sink object>
+# Object 0 is the source, objects 1..N-2 alternate [*~] and [+~] (every
+# [+~] also takes a signal from halfway back up the chain), N-1 is the sink.
+emit_chain() {
+    local file="$1" src="$2" sink="$3" i
+    {
+        echo "#N canvas 0 0 800 600 12;"
+        echo "#X obj 10 10 $src;"
+        for ((i = 1; i < NUGENS - 1; i++)); do
+            if ((i % 2)); then
+                echo "#X obj 10 $((10 + i * 30)) *~ 0.5;"
+            else
+                echo "#X obj 10 $((10 + i * 30)) +~;"
+            fi
+        done
+        echo "#X obj 10 $((10 + (NUGENS - 1) * 30)) $sink;"
+        for ((i = 1; i < NUGENS; i++)); do
+            echo "#X connect $((i - 1)) 0 $i 0;"
+            if ((i % 2 == 0 && i < NUGENS - 1)); then
+                echo "#X connect $((i / 2)) 0 $i 1;"
+            fi
+        done
+        if [[ "$sink" == "dac~" ]]; then
+            echo "#X connect $((NUGENS - 2)) 0 $((NUGENS - 1)) 1;"
+        fi
+    } > "$file"
+}
+
+mkdir -p "$OUTDIR"
+
+if [[ "$NVOICES" -gt 0 ]]; then
+    emit_chain "$OUTDIR/dspvoice.pd" "osc~ \\\$1" "outlet~"
+    cat > "$OUTDIR/main.pd" <<PATCH
+#N canvas 0 0 450 300 12;
+#X obj 10 10 clone dspvoice $NVOICES;
+#X obj 10 60 *~ 0.01;
+#X obj 10 110 dac~;
+#X connect 0 0 1 0;
+#X connect 1 0 2 0;
+#X connect 1 0 2 1;
+PATCH
+    echo "Wrote $OUTDIR/main.pd and $OUTDIR/dspvoice.pd: $NVOICES voices x $NUGENS ugens"
+else
+    emit_chain "$OUTDIR/main.pd" "osc~ 220" "dac~"
+    echo "Wrote $OUTDIR/main.pd: $NUGENS ugens"
+fi
@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# gen_spectralbench.sh - generate a spectral processing benchmark patch
+#
+# Usage: ./gen_spectralbench.sh <voices> [blocksize] [overlap] [outdir]
+#
+# Writes <outdir>/main.pd (default: current directory) and specvoice.pd.
+# main.pd feeds a sawtooth into [clone specvoice <voices>]. Each voice runs
+# under [block~ <blocksize> <overlap>] (default 1024 4): Hann window,
+# [rfft~], a gain computed from each bin's magnitude, [rifft~], window
+# again and overlap-add through [outlet~], as in a phase vocoder.
+#
+# Run it on the host with tools/pdc ("make bench PATCH=<outdir>/main.pd")
+# to see the time per DSP tick. Compare overlaps 1 and 4 to see what the
+# overlapping costs besides the extra FFTs.
+#
+
+set -e
+
+NVOICES="$1"
+BLOCKSIZE="${2:-1024}"
+OVERLAP="${3:-4}"
+OUTDIR="${4:-.}"
+
+if [[ -z "$NVOICES" || "$NVOICES" -lt 1 ]]; then
+    echo "Usage: $0 <voices> [blocksize] [overlap] [outdir]" >&2
+    exit 1
+fi
+
+mkdir -p "$OUTDIR"
+
+# rfft~/rifft~ scale by the block size, overlapping Hann^2 windows sum
+# to 3/8 of the overlap
+GAIN=$(awk "BEGIN { print 8 / (3 * $BLOCKSIZE * $OVERLAP) }")
+
+# 0 inlet~, 1 window, 2 windowing, 3 rfft~, 4-7 magnitude, 8 gain,
+# 9-10 scaled bins, 11 rifft~, 12 windowing, 13 normalization, 14 outlet~
+cat > "$OUTDIR/specvoice.pd" <<PATCH
+#N canvas 0 0 600 500 12;
+#X obj 10 10 inlet~;
+#X obj 200 10 tabreceive~ specbench-hann;
+#X obj 10 40 *~;
+#X obj 10 70 rfft~;
+#X obj 10 100 *~;
+#X obj 100 100 *~;
+#X obj 10 130 +~;
+#X obj 10 160 sqrt~;
+#X obj 10 190 clip~ 0 1;
+#X obj 10 220 *~;
+#X obj 100 220 *~;
+#X obj 10 250 rifft~;
+#X obj 10 280 *~;
+#X obj 10 310 *~ $GAIN;
+#X obj 10 340 outlet~;
+#X obj 300 10 block~ $BLOCKSIZE $OVERLAP;
+#X connect 0 0 2 0;
+#X connect 1 0 2 1;
+#X connect 2 0 3 0;
+#X connect 3 0 4 0;
+#X connect 3 0 4 1;
+#X connect 3 1 5 0;
+#X connect 3 1 5 1;
+#X connect 4 0 6 0;
+#X connect 5 0 6 1;
+#X connect 6 0 7 0;
+#X connect 7 0 8 0;
+#X connect 3 0 9 0;
+#X connect 8 0 9 1;
+#X connect 3 1 10 0;
+#X connect 8 0 10 1;
+#X connect 9 0 11 0;
+#X connect 10 0 11 1;
+#X connect 11 0 12 0;
+#X connect 1 0 12 1;
+#X connect 12 0 13 0;
+#X connect 13 0 14 0;
+PATCH
+
+cat > "$OUTDIR/main.pd" <<PATCH
+#N canvas 0 0 450 300 12;
+#X obj 10 10 phasor~ 110;
+#X obj 10 40 clone specvoice $NVOICES;
+#X obj 10 70 *~ 0.1;
+#X obj 10 100 dac~;
+#X obj 200 10 table specbench-hann $BLOCKSIZE;
+#X obj 200 40 loadbang;
+#X msg 200 70 \; specbench-hann cosinesum $BLOCKSIZE 0.5 -0.5;
+#X connect 0 0 1 0;
+#X connect 1 0 2 0;
+#X connect 2 0 3 0;
+#X connect 2 0 3 1;
+#X connect 5 0 6 0;
+PATCH
+
+echo "Wrote $OUTDIR/main.pd and $OUTDIR/specvoice.pd: $NVOICES voices, block~ $BLOCKSIZE $OVERLAP"
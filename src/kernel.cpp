@@ -9,6 +9,7 @@
 //
 #include "kernel.h"
 #include <circle/machineinfo.h>
+#include <circle/synchronize.h>
 #include <circle/util.h>
 #include <assert.h>
 #include <cstdlib>
@@ -18,8 +19,14 @@
 extern "C" {
 #include "z_libpd.h"
 #include "pd_fileio.h"
+#include "pd_conv.h"
+#include "pd_clock.h"
 }
 
+#ifdef PD_COMPILED_PATCH
+#include "pd_compiled.h"
+#endif
+
 static const char FromKernel[] = "kernel";
 
 CKernel *CKernel::s_pThis = nullptr;
@@ -29,19 +36,43 @@ CKernel::CKernel (void)
 	m_Serial (&m_Interrupt, TRUE),  // FIQ mode for RX buffering
 	m_Timer (&m_Interrupt),
 	m_Logger (m_Options.GetLogLevel (), &m_Timer),
-	m_USBHCI (&m_Interrupt, &m_Timer, TRUE),
 	m_I2CMaster (CMachineInfo::Get ()->GetDevice (DeviceI2CMaster), TRUE),
 	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED),
 	m_AudioOutput (AudioOutputI2S),
 	m_nSampleRate (DEFAULT_SAMPLE_RATE_HZ),
+	m_nAudioQueueFrames (0),
 	m_bHeadless (FALSE),
+	m_pUSB (nullptr),
+	m_bUSBGadget (FALSE),
 	m_pSoundDevice (nullptr),
 	m_pI2SDevice (nullptr),
-	m_pMIDIDevice (nullptr),
+	m_bSerialMIDI (FALSE),
+	m_nSerialMIDIPort (0),
+	m_pSerialMIDIParser (nullptr),
+	m_ucSerialStatus (0),
+	m_nMIDIBatch (0),
 	m_bFudiEnabled (TRUE),
+	m_nVoiceReleaseMs (VOICE_DEFAULT_RELEASE_MS),
+	m_nDSPSleepBlocks (0),
+	m_bOverload (TRUE),
+	m_nOverloadWarn (OVERLOAD_DEFAULT_WARN),
+	m_nOverloadShed (OVERLOAD_DEFAULT_SHED),
+	m_GovernorMode (GovernorAuto),
+	m_nGovernorUp (GOVERNOR_DEFAULT_UP),
+	m_nGovernorDown (GOVERNOR_DEFAULT_DOWN),
+	m_nGovernorIdleMs (GOVERNOR_DEFAULT_IDLE_MS),
+	m_bPMU (FALSE),
+	m_bPMUProfile (FALSE),
+	m_nPMUReportMs (PMU_DEFAULT_REPORT_MS),
+	m_bTrace (FALSE),
+	m_bTraceUnderrun (TRUE),
+	m_bRecord (FALSE),
+	m_bRecordOverload (TRUE),
+	m_bCompiled (FALSE),
 	m_pPatch (nullptr)
 {
 	s_pThis = this;
+	memset (m_pMIDIDevices, 0, sizeof m_pMIDIDevices);
 	m_ActLED.Blink (5);
 }
 
@@ -49,6 +80,8 @@ CKernel::~CKernel (void)
 {
 	delete m_pSoundDevice;
 	delete m_pI2SDevice;
+	delete m_pUSB;
+	delete m_pSerialMIDIParser;
 	s_pThis = nullptr;
 }
 
@@ -59,6 +92,16 @@ boolean CKernel::Initialize (void)
 	// Check for headless mode (skip video for lower latency)
 	m_bHeadless = m_Options.GetAppOptionDecimal ("headless", 0) != 0;
 
+	// DIN MIDI takes the UART from FUDI and the serial log
+	// Format: serialmidi=0|1 serialmidiport=<1-8>
+	m_bSerialMIDI = m_Options.GetAppOptionDecimal ("serialmidi", 0) != 0;
+	m_nSerialMIDIPort = m_Options.GetAppOptionDecimal ("serialmidiport", 1);
+	if (m_nSerialMIDIPort < 1 || m_nSerialMIDIPort > MIDI_MAX_PORTS)
+	{
+		m_nSerialMIDIPort = 1;
+	}
+	m_nSerialMIDIPort--;
+
 	// Initialize interrupt system first (required for FIQ serial)
 	if (bOK)
 	{
@@ -71,10 +114,20 @@ boolean CKernel::Initialize (void)
 		bOK = m_Screen.Initialize ();
 	}
 
-	// Initialize serial for FUDI communication
+	// Initialize serial for FUDI communication, or DIN MIDI
 	if (bOK)
 	{
-		bOK = m_Serial.Initialize (115200);
+		if (m_bSerialMIDI)
+		{
+			bOK = m_Serial.Initialize (31250);
+
+			// Binary data, no CR after each NL
+			m_Serial.SetOptions (0);
+		}
+		else
+		{
+			bOK = m_Serial.Initialize (115200);
+		}
 	}
 
 	// Initialize logger
@@ -85,6 +138,10 @@ boolean CKernel::Initialize (void)
 		{
 			pTarget = m_bHeadless ? (CDevice *)&m_Serial : (CDevice *)&m_Screen;
 		}
+		if (m_bSerialMIDI && pTarget == &m_Serial)
+		{
+			pTarget = &m_NullDevice;
+		}
 		bOK = m_Logger.Initialize (pTarget);
 	}
 
@@ -98,9 +155,21 @@ boolean CKernel::Initialize (void)
 		bOK = m_I2CMaster.Initialize ();
 	}
 
+	// USB: host for MIDI controllers, or a MIDI device itself on the OTG port
+	// Format: usbgadget=0|1
 	if (bOK)
 	{
-		bOK = m_USBHCI.Initialize ();
+		m_bUSBGadget = m_Options.GetAppOptionDecimal ("usbgadget", 0) != 0;
+		if (m_bUSBGadget)
+		{
+			m_pUSB = new CUSBMIDIGadget (&m_Interrupt);
+		}
+		else
+		{
+			m_pUSB = new CUSBHCIDevice (&m_Interrupt, &m_Timer, TRUE);
+		}
+
+		bOK = m_pUSB->Initialize ();
 	}
 
 	if (bOK)
@@ -125,10 +194,79 @@ void CKernel::ParseConfig (void)
 	{
 		m_nSampleRate = nRate;
 	}
+
+	// Parse I2S output queue length in frames (optional)
+	// Format: audioqueue=<frames>, e.g. 64 for about 1.3 ms at 48 kHz
+	m_nAudioQueueFrames = m_Options.GetAppOptionDecimal ("audioqueue", 0);
 	
 	// Parse FUDI option (enabled by default)
 	// Format: fudi=0|1
-	m_bFudiEnabled = m_Options.GetAppOptionDecimal ("fudi", 1) != 0;
+	m_bFudiEnabled = m_Options.GetAppOptionDecimal ("fudi", 1) != 0 && !m_bSerialMIDI;
+
+	// Parse voice allocator options (disabled by default)
+	// Format: voices=<abstraction name of a [clone]> voicerelease=<ms>
+	const char *pVoices = m_Options.GetAppOptionString ("voices");
+	if (pVoices != nullptr)
+	{
+		m_VoiceAbstraction = pVoices;
+	}
+	m_nVoiceReleaseMs = m_Options.GetAppOptionDecimal ("voicerelease", VOICE_DEFAULT_RELEASE_MS);
+
+	// Parse preset receivers (disabled by default)
+	// Format: presets=all|<receiver>,<receiver>,...
+	const char *pPresets = m_Options.GetAppOptionString ("presets");
+	if (pPresets != nullptr)
+	{
+		m_PresetReceivers = pPresets;
+	}
+
+	// Parse automatic DSP sleep of silent subpatches (disabled by default)
+	// Format: dspsleep=<number of silent blocks>
+	m_nDSPSleepBlocks = m_Options.GetAppOptionDecimal ("dspsleep", 0);
+
+	// Parse overload protection options (enabled by default)
+	// Format: overload=0|1 overloadwarn=<%> overloadshed=<%>
+	m_bOverload = m_Options.GetAppOptionDecimal ("overload", 1) != 0;
+	m_nOverloadWarn = m_Options.GetAppOptionDecimal ("overloadwarn", OVERLOAD_DEFAULT_WARN);
+	m_nOverloadShed = m_Options.GetAppOptionDecimal ("overloadshed", OVERLOAD_DEFAULT_SHED);
+
+	// Parse CPU governor options (automatic by default)
+	// Format: governor=auto|max|low|off governorup=<%> governordown=<%> governoridle=<ms>
+	m_GovernorMode = CCPUGovernor::ParseMode (m_Options.GetAppOptionString ("governor", "auto"));
+	if (m_GovernorMode == GovernorUnknown)
+	{
+		m_GovernorMode = GovernorAuto;
+	}
+	m_nGovernorUp = m_Options.GetAppOptionDecimal ("governorup", GOVERNOR_DEFAULT_UP);
+	m_nGovernorDown = m_Options.GetAppOptionDecimal ("governordown", GOVERNOR_DEFAULT_DOWN);
+	m_nGovernorIdleMs = m_Options.GetAppOptionDecimal ("governoridle", GOVERNOR_DEFAULT_IDLE_MS);
+
+	// Parse event trace options (disabled by default), not with DIN MIDI
+	// Format: trace=0|1 traceunderrun=0|1
+	m_bTrace = m_Options.GetAppOptionDecimal ("trace", 0) != 0 && !m_bSerialMIDI;
+	m_bTraceUnderrun = m_Options.GetAppOptionDecimal ("traceunderrun", 1) != 0;
+
+	// Parse input recording options (disabled by default)
+	// Format: record=0|1 recordoverload=0|1
+	m_bRecord = m_Options.GetAppOptionDecimal ("record", 0) != 0;
+	m_bRecordOverload = m_Options.GetAppOptionDecimal ("recordoverload", 1) != 0;
+
+#ifdef PD_COMPILED_PATCH
+	// Parse compiled DSP chain option (enabled by default when built in)
+	// Format: compiled=0|1
+	m_bCompiled = m_Options.GetAppOptionDecimal ("compiled", 1) != 0;
+#endif
+
+	// Parse performance monitor options (disabled by default), reported over FUDI
+	// Format: pmu=0|1 pmuprofile=0|1 pmureport=<ms>
+	m_bPMUProfile = m_Options.GetAppOptionDecimal ("pmuprofile", 0) != 0;
+	m_bPMU = (m_Options.GetAppOptionDecimal ("pmu", 0) != 0 || m_bPMUProfile) && m_bFudiEnabled;
+	m_nPMUReportMs = m_Options.GetAppOptionDecimal ("pmureport", PMU_DEFAULT_REPORT_MS);
+	if (m_bPMU && m_bPMUProfile)
+	{
+		// Profiling walks the chain itself
+		m_bCompiled = FALSE;
+	}
 	
 	m_Logger.Write (FromKernel, LogNotice, "Audio config: %s @ %u Hz",
 	                CAudioOutputFactory::GetTypeName (m_AudioOutput), m_nSampleRate);
@@ -137,6 +275,12 @@ void CKernel::ParseConfig (void)
 	{
 		m_Logger.Write (FromKernel, LogNotice, "FUDI: enabled (UART GPIO 14/15, 115200 baud)");
 	}
+
+	if (m_bSerialMIDI)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "DIN MIDI: UART GPIO 14/15 on port %u",
+				m_nSerialMIDIPort + 1);
+	}
 }
 
 boolean CKernel::SetupAudio (void)
@@ -147,7 +291,8 @@ boolean CKernel::SetupAudio (void)
 	{
 	case AudioOutputI2S:
 		// I2S output for PCM5102A and similar DACs
-		m_pI2SDevice = new CPdSoundI2S(&m_Interrupt, &m_I2CMaster, m_nSampleRate);
+		m_pI2SDevice = new CPdSoundI2S(&m_Interrupt, &m_I2CMaster, m_nSampleRate,
+		                               m_nAudioQueueFrames);
 		if (m_pI2SDevice)
 		{
 			bOK = m_pI2SDevice->Initialize();
@@ -299,6 +444,7 @@ TShutdownMode CKernel::Run (void)
 	ParseConfig ();
 
 	// Initialize libpd
+	m_Logger.Write (FromKernel, LogNotice, "Clock source %u Hz", pd_clock_frequency ());
 	m_Logger.Write (FromKernel, LogNotice, "Initializing libpd...");
 	
 	m_Logger.Write (FromKernel, LogDebug, "Setting up libpd hooks...");
@@ -337,23 +483,46 @@ TShutdownMode CKernel::Run (void)
 	// Also sends to FUDI output
 	libpd_set_symbolhook (PdSymbolHook);
 
-	// Set up MIDI hooks for monitoring
-	libpd_set_noteonhook ([](int ch, int pitch, int vel) {
-		CLogger::Get()->Write("pd-midi", LogDebug, "Note %s ch=%d note=%d vel=%d",
-		                      vel > 0 ? "ON" : "OFF", ch, pitch, vel);
-	});
+	// Set up MIDI hooks for [noteout], [ctlout] and so on
+	// Sent to the USB MIDI device (host or gadget mode) and DIN MIDI
+	libpd_set_noteonhook (PdNoteOnHook);
+	libpd_set_controlchangehook (PdControlChangeHook);
+	libpd_set_programchangehook (PdProgramChangeHook);
+	libpd_set_pitchbendhook (PdPitchBendHook);
+	libpd_set_aftertouchhook (PdAftertouchHook);
+	libpd_set_polyaftertouchhook (PdPolyAftertouchHook);
 
-	libpd_set_controlchangehook ([](int ch, int cc, int val) {
-		CLogger::Get()->Write("pd-midi", LogDebug, "CC ch=%d cc=%d val=%d", ch, cc, val);
-	});
+	// [midiout] sends raw bytes, to DIN MIDI only
+	libpd_set_midibytehook (PdMIDIByteHook);
 
 	// Initialize libpd
 	m_Logger.Write (FromKernel, LogNotice, "Initializing libpd...");
+	unsigned long long nInitStart = pd_clock_usec ();
 	int initResult = libpd_init();
 	if (initResult != 0)
 	{
 		m_Logger.Write (FromKernel, LogWarning, "libpd already initialized");
 	}
+	m_Logger.Write (FromKernel, LogNotice, "libpd initialized in %u us",
+			(unsigned) (pd_clock_usec () - nInitStart));
+
+	// BarePD's built-in Pd classes
+	conv_tilde_setup ();
+
+	// Record events from here on, loading the patch too
+	if (m_bTrace)
+	{
+		m_Trace.Initialize (&m_Serial, m_bTraceUnderrun);
+	}
+
+	// Let silent subpatches and clone instances drop out of the DSP chain
+	if (m_nDSPSleepBlocks > 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "DSP sleep after %u silent blocks", m_nDSPSleepBlocks);
+		libpd_start_message(1);
+		libpd_add_float((float) m_nDSPSleepBlocks);
+		libpd_finish_message("pd", "dspsleep");
+	}
 
 	// Setup audio output
 	m_Logger.Write (FromKernel, LogNotice, "Setting up audio output...");
@@ -370,11 +539,63 @@ TShutdownMode CKernel::Run (void)
 		m_Logger.Write (FromKernel, LogWarning, "Place a 'main.pd' file on the SD card");
 	}
 
+	// Hand MIDI notes to the voice allocator, if one is configured
+	if (m_pPatch != nullptr && m_VoiceAbstraction.GetLength () > 0)
+	{
+		m_VoiceAllocator.Attach (m_VoiceAbstraction, m_nVoiceReleaseMs);
+	}
+
+	// Snapshot and recall the values of receivers, if configured
+	if (m_pPatch != nullptr && m_PresetReceivers.GetLength () > 0)
+	{
+		m_Presets.Initialize (m_PresetReceivers, (t_canvas *) m_pPatch, &m_FileSystem);
+	}
+
+	// Shed voices, then insert silence, when DSP time runs out
+	if (m_bOverload && m_pI2SDevice != nullptr)
+	{
+		m_Overload.Initialize (&m_VoiceAllocator, m_nOverloadWarn, m_nOverloadShed,
+				       OVERLOAD_DEFAULT_FADE_MS);
+		m_pI2SDevice->SetOverloadSilence (TRUE);
+	}
+
+	// Count cache refills, branch misses and stalls around each DSP tick
+	if (m_bPMU)
+	{
+		m_PerfMonitor.Initialize (&m_FudiParser, m_nPMUReportMs, m_bPMUProfile);
+	}
+
+	// Record the inputs from the first DSP tick on
+	if (m_bRecord)
+	{
+		// PWM output renders in the sound device's interrupt (GetChunk)
+		m_Recorder.Initialize (&m_FileSystem, m_bRecordOverload,
+				       m_pSoundDevice != nullptr);
+	}
+
+#ifdef PD_COMPILED_PATCH
+	// Checked against the chain each time DSP is switched on
+	if (m_bCompiled)
+	{
+		pd_compiled_enable (1);
+	}
+#endif
+
 	// Enable DSP
 	m_Logger.Write (FromKernel, LogNotice, "Enabling DSP...");
+	unsigned long long nDSPStart = pd_clock_usec ();
 	libpd_start_message(1);
 	libpd_add_float(1.0f);
 	libpd_finish_message("pd", "dsp");
+	m_Logger.Write (FromKernel, LogNotice, "DSP graph sorted in %u us",
+			(unsigned) (pd_clock_usec () - nDSPStart));
+#ifdef PD_COMPILED_PATCH
+	if (m_bCompiled)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Compiled DSP chain (%s): %s", CompiledPatch.pName,
+				pd_compiled_active () ? "active" : "not matching, using libpd");
+	}
+#endif
 
 	m_Logger.Write (FromKernel, LogNotice, "Starting audio output...");
 	
@@ -395,10 +616,34 @@ TShutdownMode CKernel::Run (void)
 		return ShutdownHalt;
 	}
 
+	// The clock may change from here on, the DAC's I2C setup is done
+	m_Governor.Initialize (m_GovernorMode, m_nSampleRate,
+			       m_nGovernorUp, m_nGovernorDown, m_nGovernorIdleMs);
+
+	// Parse DIN MIDI in the UART interrupt, into the queue of the main loop
+	if (m_bSerialMIDI)
+	{
+		m_pSerialMIDIParser = new CMIDIParser (m_MIDIIngress.GetQueue (MIDI_SOURCE_SERIAL),
+						       m_nSerialMIDIPort);
+		m_Serial.RegisterCharReceivedHandler (SerialMIDIHandler, m_pSerialMIDIParser);
+	}
+
 	m_Logger.Write (FromKernel, LogNotice, "");
 	m_Logger.Write (FromKernel, LogNotice, "BarePD is running!");
 	m_Logger.Write (FromKernel, LogNotice, "Audio output: %s", CAudioOutputFactory::GetTypeName(m_AudioOutput));
-	m_Logger.Write (FromKernel, LogNotice, "Connect USB MIDI to send notes to the patch.");
+	if (m_bUSBGadget)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Connect the USB port to a computer to use BarePD as a MIDI device.");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Connect USB MIDI to send notes to the patch.");
+	}
+	if (m_bSerialMIDI)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "DIN MIDI: 31250 baud, channels %u-%u in Pd",
+				m_nSerialMIDIPort * 16 + 1, m_nSerialMIDIPort * 16 + 16);
+	}
 	if (m_bFudiEnabled)
 	{
 		m_Logger.Write (FromKernel, LogNotice, "FUDI: Connect via USB serial or UART (115200 baud)");
@@ -413,11 +658,32 @@ TShutdownMode CKernel::Run (void)
 	boolean bActive = TRUE;
 	while (bActive)
 	{
+		// MIDI received since the last pass, ahead of the next audio period
+		unsigned long long nFlushStart = pd_clock_ticks ();
+		boolean bHeld = CInputRecorder::BeginInput ();
+		unsigned nMIDIEvents = m_MIDIIngress.Flush (MIDIEventHandler, this);
+		SendMIDIBatch ();
+		CInputRecorder::EndInput (bHeld);
+		if (nMIDIEvents > 0)
+		{
+			CEventTrace::Span (TraceMIDIFlush, nFlushStart, nMIDIEvents);
+		}
+
 		// Audio processing - highest priority
 		if (m_AudioOutput == AudioOutputI2S && m_pI2SDevice)
 		{
 			bActive = m_pI2SDevice->IsActive();
 			m_pI2SDevice->Process();
+
+			if (m_bOverload)
+			{
+				unsigned nSilences = m_pI2SDevice->ReadSilences ();
+				m_Overload.Update (m_pI2SDevice->ReadPeakLoad (), nSilences);
+				if (nSilences > 0)
+				{
+					m_Recorder.Overload ();
+				}
+			}
 		}
 		else if (m_pSoundDevice)
 		{
@@ -433,19 +699,34 @@ TShutdownMode CKernel::Run (void)
 		{
 			ProcessFudi();
 		}
+
+		// Send the MIDI that Pd put out since the last pass
+		FlushMIDIOutput ();
+
+		// Put voices to sleep whose release phase has timed out
+		m_VoiceAllocator.Update ();
+
+		// Write stored presets to the SD card
+		m_Presets.Update ();
+
+		// Set the CPU clock from the DSP load, report temperature
+		m_Governor.Update ();
+
+		// Send the performance monitor counters over FUDI
+		m_PerfMonitor.Update ();
+
+		// Write the event trace to the UART when due
+		m_Trace.Update ();
+
+		// Write the recorded inputs to the SD card
+		m_Recorder.Update ();
 		
-		// Check for USB MIDI device
-		if (m_pMIDIDevice == nullptr)
+		// Check for USB MIDI devices plugged in or removed
+		unsigned long long nPlugAndPlayStart = pd_clock_ticks ();
+		if (m_pUSB->UpdatePlugAndPlay())
 		{
-			if (m_USBHCI.UpdatePlugAndPlay())
-			{
-				m_pMIDIDevice = (CUSBMIDIDevice *) m_DeviceNameService.GetDevice ("umidi1", FALSE);
-				if (m_pMIDIDevice != nullptr)
-				{
-					m_pMIDIDevice->RegisterRemovedHandler (USBDeviceRemovedHandler);
-					m_pMIDIDevice->RegisterPacketHandler (MIDIPacketHandler);
-				}
-			}
+			UpdateMIDIDevices ();
+			CEventTrace::Span (TraceUSBPlugAndPlay, nPlugAndPlayStart);
 		}
 
 		m_Scheduler.Yield();
@@ -463,47 +744,132 @@ TShutdownMode CKernel::Run (void)
 	return ShutdownHalt;
 }
 
-void CKernel::MIDIPacketHandler (unsigned nCable, u8 *pPacket, unsigned nLength)
+// Pick up new USB MIDI devices. Device umidiN is Pd's MIDI port N-1,
+// i.e. its channels appear as N*16-15 to N*16 in Pd.
+void CKernel::UpdateMIDIDevices (void)
 {
-	if (nLength < 3)
-		return;
+	for (unsigned nPort = 0; nPort < MIDI_MAX_PORTS; nPort++)
+	{
+		if (m_pMIDIDevices[nPort] != nullptr)
+		{
+			continue;
+		}
+
+		CUSBMIDIDevice *pDevice =
+			(CUSBMIDIDevice *) m_DeviceNameService.GetDevice ("umidi", nPort + 1, FALSE);
+		if (pDevice != nullptr)
+		{
+			m_Logger.Write (FromKernel, LogNotice, "USB MIDI device umidi%u on port %u",
+					nPort + 1, nPort + 1);
+
+			m_pMIDIDevices[nPort] = pDevice;
+			pDevice->RegisterRemovedHandler (USBDeviceRemovedHandler, &m_pMIDIDevices[nPort]);
+			pDevice->RegisterPacketHandler (MIDIPacketHandler, m_MIDIIngress.GetQueue (nPort));
+		}
+	}
+}
+
+// Called at interrupt level: only queue the event for the main loop
+void CKernel::MIDIPacketHandler (unsigned nCable, u8 *pPacket, unsigned nLength,
+				 unsigned nDevice, void *pParam)
+{
+	CMIDIQueue *pQueue = (CMIDIQueue *) pParam;
+	assert (pQueue != nullptr);
+
+	if (nLength > 0 && nDevice >= 1)
+	{
+		CEventTrace::Instant (TraceMIDIReceive, nDevice - 1);
+		pQueue->Put (nDevice - 1, pPacket, nLength <= 3 ? nLength : 3);
+	}
+}
+
+// Called at interrupt level for each byte received on the UART
+void CKernel::SerialMIDIHandler (u8 uchChar, int nStatus, void *pParam)
+{
+	CMIDIParser *pParser = (CMIDIParser *) pParam;
+	assert (pParser != nullptr);
 
-	u8 ucStatus  = pPacket[0];
-	u8 ucChannel = ucStatus & 0x0F;
+	if (nStatus == 0)
+	{
+		CEventTrace::Instant (TraceMIDIReceive, MIDI_SOURCE_SERIAL);
+		pParser->Parse (uchChar);
+	}
+}
+
+void CKernel::MIDIEventHandler (const TMIDIEvent *pEvent, void *pParam)
+{
+	CKernel *pThis = (CKernel *) pParam;
+	assert (pThis != nullptr);
+
+	CInputRecorder::RecordMIDI (pEvent);
+
+	u8 ucStatus  = pEvent->Data[0];
 	u8 ucType    = ucStatus >> 4;
-	u8 ucData1   = pPacket[1];
-	u8 ucData2   = pPacket[2];
 
-	// Forward MIDI to libpd
-	switch (ucType)
+	// Notes go to the voice allocator if one is attached,
+	// after the messages batched before them
+	CVoiceAllocator *pVoices = &pThis->m_VoiceAllocator;
+	if (pVoices->IsAttached () && pEvent->ucLength >= 2)
 	{
-	case 0x8:  // Note Off
-		libpd_noteon(ucChannel, ucData1, 0);
-		break;
-	case 0x9:  // Note On
-		libpd_noteon(ucChannel, ucData1, ucData2);
-		break;
-	case 0xB:  // Control Change
-		libpd_controlchange(ucChannel, ucData1, ucData2);
-		break;
-	case 0xC:  // Program Change
-		libpd_programchange(ucChannel, ucData1);
-		break;
-	case 0xE:  // Pitch Bend
+		u8 ucChannel = ucStatus & 0x0F;
+		u8 ucData1   = pEvent->Data[1];
+		u8 ucData2   = pEvent->ucLength > 2 ? pEvent->Data[2] : 0;
+
+		switch (ucType)
 		{
-			int value = ((ucData2 << 7) | ucData1) - 8192;
-			libpd_pitchbend(ucChannel, value);
+		case 0x8:  // Note Off
+			pThis->SendMIDIBatch ();
+			pVoices->NoteOff(ucChannel, ucData1);
+			return;
+		case 0x9:  // Note On
+			pThis->SendMIDIBatch ();
+			pVoices->NoteOn(ucChannel, ucData1, ucData2);
+			return;
+		case 0xB:  // Control Change, also passed on to libpd
+			if (ucData1 == MIDI_CC_SUSTAIN)
+			{
+				pThis->SendMIDIBatch ();
+				pVoices->Sustain(ucChannel, ucData2 >= 64);
+			}
+			else if (ucData1 == MIDI_CC_ALL_NOTES_OFF)
+			{
+				pThis->SendMIDIBatch ();
+				pVoices->AllNotesOff(ucChannel);
+			}
+			break;
 		}
-		break;
+	}
+
+	// Everything else is forwarded to libpd, many messages at a time.
+	// Pd numbers the channels of port p from p*16.
+	t_libpd_midimsg *pMsg = &pThis->m_MIDIBatch[pThis->m_nMIDIBatch++];
+	pMsg->m_port = pEvent->ucPort;
+	pMsg->m_length = pEvent->ucLength;
+	memcpy (pMsg->m_data, pEvent->Data, sizeof pMsg->m_data);
+
+	if (pThis->m_nMIDIBatch == MIDI_BATCH_SIZE)
+	{
+		pThis->SendMIDIBatch ();
+	}
+}
+
+void CKernel::SendMIDIBatch (void)
+{
+	if (m_nMIDIBatch > 0)
+	{
+		libpd_midi_batch (m_nMIDIBatch, m_MIDIBatch);
+		m_nMIDIBatch = 0;
 	}
 }
 
 void CKernel::USBDeviceRemovedHandler (CDevice *pDevice, void *pContext)
 {
-	if (s_pThis && s_pThis->m_pMIDIDevice == (CUSBMIDIDevice *) pDevice)
+	// pContext is the device's slot in m_pMIDIDevices
+	CUSBMIDIDevice **ppDevice = (CUSBMIDIDevice **) pContext;
+	if (ppDevice != nullptr && *ppDevice == (CUSBMIDIDevice *) pDevice)
 	{
 		CLogger::Get()->Write(FromKernel, LogNotice, "USB MIDI device removed");
-		s_pThis->m_pMIDIDevice = nullptr;
+		*ppDevice = nullptr;
 	}
 }
 
@@ -528,7 +894,12 @@ void CKernel::ProcessFudiSerial (CDevice *pSerial)
 	if (nRead > 0)
 	{
 		buffer[nRead] = '\0';
-		m_FudiParser.ProcessBuffer(buffer, nRead);
+		boolean bHeld = CInputRecorder::BeginInput();
+		CInputRecorder::RecordFudi(buffer, nRead);
+		CEventTrace::Begin(TraceFudiReceive, nRead);
+		unsigned nMessages = m_FudiParser.ProcessBuffer(buffer, nRead);
+		CEventTrace::End(TraceFudiReceive, nMessages);
+		CInputRecorder::EndInput(bHeld);
 	}
 }
 
@@ -537,6 +908,10 @@ void CKernel::FudiOutputHandler (const char *pMessage)
 	if (!s_pThis || !pMessage)
 		return;
 	
+	// Not in the middle of a trace dump
+	if (s_pThis->m_Trace.IsDumping())
+		return;
+	
 	// Send FUDI output to UART serial
 	s_pThis->m_Serial.Write(pMessage, strlen(pMessage));
 }
@@ -545,6 +920,33 @@ void CKernel::FudiOutputHandler (const char *pMessage)
 
 void CKernel::PdFloatHook (const char *recv, float x)
 {
+	if (s_pThis && strcmp(recv, VOICE_DONE_RECEIVER) == 0)
+	{
+		s_pThis->m_VoiceAllocator.VoiceDone((int) x);
+		return;
+	}
+
+	if (s_pThis && strcmp(recv, GOVERNOR_RECEIVER) == 0)
+	{
+		s_pThis->m_Governor.SetHold(x != 0.0f);
+		return;
+	}
+
+	if (s_pThis && strcmp(recv, TRACE_RECEIVER) == 0)
+	{
+		s_pThis->m_Trace.SetRecording(x != 0.0f);
+		return;
+	}
+
+	if (s_pThis && strcmp(recv, RECORD_RECEIVER) == 0)
+	{
+		if (x == 0.0f)
+		{
+			s_pThis->m_Recorder.Stop();
+		}
+		return;
+	}
+
 	if (s_pThis && s_pThis->m_bFudiEnabled)
 	{
 		s_pThis->m_FudiParser.SendFloat(recv, x);
@@ -553,6 +955,12 @@ void CKernel::PdFloatHook (const char *recv, float x)
 
 void CKernel::PdBangHook (const char *recv)
 {
+	if (s_pThis && strcmp(recv, TRACE_RECEIVER) == 0)
+	{
+		s_pThis->m_Trace.RequestDump();
+		return;
+	}
+
 	if (s_pThis && s_pThis->m_bFudiEnabled)
 	{
 		s_pThis->m_FudiParser.SendBang(recv);
@@ -566,3 +974,137 @@ void CKernel::PdSymbolHook (const char *recv, const char *sym)
 		s_pThis->m_FudiParser.SendSymbol(recv, sym);
 	}
 }
+
+// ============================================================================
+// MIDI Output
+// ============================================================================
+
+// Pd's hooks run wherever libpd does, at interrupt level with PWM output,
+// so they only queue the messages. The main loop sends them on.
+#define MIDI_PORT_RAW	0x80		// queued port of a [midiout] byte
+
+// nChannel is Pd's: the port (USB MIDI device) times 16 plus the channel
+void CKernel::SendMIDI (int nChannel, u8 ucStatus, const u8 *pData, unsigned nLength)
+{
+	unsigned nPort = (unsigned) nChannel >> 4;
+	if (nPort >= MIDI_MAX_PORTS)
+		return;
+
+	u8 Message[3];
+	Message[0] = ucStatus | (nChannel & 0x0F);
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		Message[1+i] = pData[i] & 0x7F;
+	}
+
+	QueueMIDIOutput (nPort, Message, 1 + nLength);
+}
+
+// The hooks may be called from the main loop and from the audio interrupt,
+// but the queue takes one caller at a time
+void CKernel::QueueMIDIOutput (unsigned nPort, const u8 *pData, unsigned nLength)
+{
+	if (!s_pThis)
+		return;
+
+	EnterCritical ();
+	s_pThis->m_MIDIEgress.Put (nPort, pData, nLength);
+	LeaveCritical ();
+}
+
+void CKernel::FlushMIDIOutput (void)
+{
+	const TMIDIEvent *pEvent;
+	while ((pEvent = m_MIDIEgress.Peek ()) != nullptr)
+	{
+		unsigned nPort = pEvent->ucPort;
+		if (nPort & MIDI_PORT_RAW)
+		{
+			// Raw bytes may be anything, send the next status byte again
+			m_ucSerialStatus = 0;
+			m_Serial.Write (pEvent->Data, 1);
+		}
+		else
+		{
+			if (m_bSerialMIDI && nPort == m_nSerialMIDIPort)
+			{
+				SendSerialMIDI (pEvent->Data[0], &pEvent->Data[1], pEvent->ucLength - 1);
+			}
+
+			CUSBMIDIDevice *pDevice = m_pMIDIDevices[nPort];
+			if (pDevice != nullptr)
+			{
+				pDevice->SendPlainMIDI (0, pEvent->Data, pEvent->ucLength);
+			}
+		}
+
+		m_MIDIEgress.Remove ();
+	}
+}
+
+// DIN MIDI output, leaving out the status byte if it repeats
+void CKernel::SendSerialMIDI (u8 ucStatus, const u8 *pData, unsigned nLength)
+{
+	u8 Buffer[3];
+	unsigned nBytes = 0;
+
+	if (ucStatus != m_ucSerialStatus)
+	{
+		Buffer[nBytes++] = ucStatus;
+		m_ucSerialStatus = ucStatus;
+	}
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		Buffer[nBytes++] = pData[i];
+	}
+
+	m_Serial.Write(Buffer, nBytes);
+}
+
+void CKernel::PdNoteOnHook (int nChannel, int nPitch, int nVelocity)
+{
+	u8 Data[2] = {(u8) nPitch, (u8) nVelocity};
+	SendMIDI(nChannel, 0x90, Data, 2);
+}
+
+void CKernel::PdControlChangeHook (int nChannel, int nController, int nValue)
+{
+	u8 Data[2] = {(u8) nController, (u8) nValue};
+	SendMIDI(nChannel, 0xB0, Data, 2);
+}
+
+void CKernel::PdProgramChangeHook (int nChannel, int nValue)
+{
+	u8 Data[1] = {(u8) nValue};
+	SendMIDI(nChannel, 0xC0, Data, 1);
+}
+
+void CKernel::PdPitchBendHook (int nChannel, int nValue)
+{
+	// libpd sends -8192 to 8191
+	nValue += 8192;
+	u8 Data[2] = {(u8) (nValue & 0x7F), (u8) (nValue >> 7)};
+	SendMIDI(nChannel, 0xE0, Data, 2);
+}
+
+void CKernel::PdAftertouchHook (int nChannel, int nValue)
+{
+	u8 Data[1] = {(u8) nValue};
+	SendMIDI(nChannel, 0xD0, Data, 1);
+}
+
+void CKernel::PdPolyAftertouchHook (int nChannel, int nPitch, int nValue)
+{
+	u8 Data[2] = {(u8) nPitch, (u8) nValue};
+	SendMIDI(nChannel, 0xA0, Data, 2);
+}
+
+void CKernel::PdMIDIByteHook (int nPort, int nByte)
+{
+	if (   !s_pThis || !s_pThis->m_bSerialMIDI
+	    || (unsigned) nPort != s_pThis->m_nSerialMIDIPort)
+		return;
+
+	u8 ucByte = (u8) nByte;
+	QueueMIDIOutput (nPort | MIDI_PORT_RAW, &ucByte, 1);
+}
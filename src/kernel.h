@@ -15,20 +15,31 @@
 #include <circle/devicenameservice.h>
 #include <circle/screen.h>
 #include <circle/serial.h>
+#include <circle/nulldevice.h>
 #include <circle/exceptionhandler.h>
 #include <circle/interrupt.h>
 #include <circle/timer.h>
 #include <circle/logger.h>
 #include <circle/usb/usbhcidevice.h>
 #include <circle/usb/usbmidi.h>
+#include <circle/usb/gadget/usbmidigadget.h>
 #include <circle/i2cmaster.h>
 #include <circle/sched/scheduler.h>
 #include <circle/types.h>
+#include <circle/string.h>
 #include <circle/fs/fat/fatfs.h>
 #include <SDCard/emmc.h>
 
 #include "pdsounddevice.h"
 #include "pd_fudi.h"
+#include "pd_voice.h"
+#include "pd_midi.h"
+#include "pd_governor.h"
+#include "pd_overload.h"
+#include "pd_preset.h"
+#include "pd_trace.h"
+#include "pd_pmu.h"
+#include "pd_record.h"
 
 // Default patch filename
 #define DEFAULT_PATCH_NAME      "main.pd"
@@ -67,8 +78,26 @@ private:
 	boolean SetupAudio (void);
 
 	// MIDI handlers
-	static void MIDIPacketHandler (unsigned nCable, u8 *pPacket, unsigned nLength);
+	void UpdateMIDIDevices (void);
+	static void MIDIPacketHandler (unsigned nCable, u8 *pPacket, unsigned nLength,
+				       unsigned nDevice, void *pParam);
+	static void MIDIEventHandler (const TMIDIEvent *pEvent, void *pParam);
+	void SendMIDIBatch (void);
 	static void USBDeviceRemovedHandler (CDevice *pDevice, void *pContext);
+	static void SerialMIDIHandler (u8 uchChar, int nStatus, void *pParam);
+
+	// Pd MIDI output hooks, queued for the USB MIDI device and DIN MIDI
+	static void SendMIDI (int nChannel, u8 ucStatus, const u8 *pData, unsigned nLength);
+	static void QueueMIDIOutput (unsigned nPort, const u8 *pData, unsigned nLength);
+	void FlushMIDIOutput (void);
+	void SendSerialMIDI (u8 ucStatus, const u8 *pData, unsigned nLength);
+	static void PdNoteOnHook (int nChannel, int nPitch, int nVelocity);
+	static void PdControlChangeHook (int nChannel, int nController, int nValue);
+	static void PdProgramChangeHook (int nChannel, int nValue);
+	static void PdPitchBendHook (int nChannel, int nValue);
+	static void PdAftertouchHook (int nChannel, int nValue);
+	static void PdPolyAftertouchHook (int nChannel, int nPitch, int nValue);
+	static void PdMIDIByteHook (int nPort, int nByte);
 
 	// FUDI processing
 	void ProcessFudi (void);
@@ -93,8 +122,9 @@ private:
 	CLogger			m_Logger;
 	CScheduler		m_Scheduler;
 
-	// USB Host for MIDI devices
-	CUSBHCIDevice		m_USBHCI;
+	// USB host for MIDI devices, or USB MIDI gadget (usbgadget=1)
+	CUSBController		*m_pUSB;
+	boolean			m_bUSBGadget;
 	CI2CMaster		m_I2CMaster;
 
 	// SD Card and filesystem
@@ -104,19 +134,79 @@ private:
 	// Audio configuration
 	TAudioOutputType	m_AudioOutput;
 	unsigned		m_nSampleRate;
+	unsigned		m_nAudioQueueFrames;	// I2S queue length, 0 for default
 	boolean			m_bHeadless;		// Skip video for lower latency
 	
 	// Sound devices
 	CSoundBaseDevice	*m_pSoundDevice;	// For PWM output
 	CPdSoundI2S		*m_pI2SDevice;		// For I2S output (PCM5102A)
 
-	// USB MIDI
-	CUSBMIDIDevice		*m_pMIDIDevice;
+	// USB MIDI, umidiN on Pd MIDI port N-1
+	CUSBMIDIDevice		*m_pMIDIDevices[MIDI_MAX_PORTS];
+	CMIDIIngress		m_MIDIIngress;
+
+	// DIN MIDI on the UART (GPIO 14/15, 31250 baud) instead of FUDI
+	boolean			m_bSerialMIDI;
+	unsigned		m_nSerialMIDIPort;	// Pd MIDI port
+	CMIDIParser		*m_pSerialMIDIParser;
+	u8			m_ucSerialStatus;	// running status of the output
+	CNullDevice		m_NullDevice;		// log target instead of the UART
+
+	// MIDI from Pd, sent from the main loop
+	CMIDIQueue		m_MIDIEgress;
+
+	// MIDI messages for libpd, collected while the ingress is flushed
+	t_libpd_midimsg		m_MIDIBatch[MIDI_BATCH_SIZE];
+	unsigned		m_nMIDIBatch;
 
 	// FUDI remote control via UART serial (GPIO 14/15, 115200 baud)
 	CFudiParser		m_FudiParser;
 	boolean			m_bFudiEnabled;
 
+	// Polyphonic voice allocation for a [clone] (optional)
+	CVoiceAllocator		m_VoiceAllocator;
+	CString			m_VoiceAbstraction;
+	unsigned		m_nVoiceReleaseMs;
+
+	// Preset snapshots of receivers (optional)
+	CPresetBank		m_Presets;
+	CString			m_PresetReceivers;
+
+	// Silent blocks before a subpatch's DSP sleeps (0 = off)
+	unsigned		m_nDSPSleepBlocks;
+
+	// Voice shedding and silence when DSP time runs out (I2S only)
+	COverloadGuard		m_Overload;
+	boolean			m_bOverload;
+	unsigned		m_nOverloadWarn;
+	unsigned		m_nOverloadShed;
+
+	// CPU clock from DSP load and SoC temperature
+	CCPUGovernor		m_Governor;
+	TGovernorMode		m_GovernorMode;
+	unsigned		m_nGovernorUp;
+	unsigned		m_nGovernorDown;
+	unsigned		m_nGovernorIdleMs;
+
+	// Performance monitor counters per DSP tick, reported over FUDI (optional)
+	CPerfMonitor		m_PerfMonitor;
+	boolean			m_bPMU;
+	boolean			m_bPMUProfile;		// count each perform routine
+	unsigned		m_nPMUReportMs;
+
+	// Event trace, dumped to the UART (optional)
+	CEventTrace		m_Trace;
+	boolean			m_bTrace;
+	boolean			m_bTraceUnderrun;
+
+	// Inputs recorded to the SD card, for replay on the host (optional)
+	CInputRecorder		m_Recorder;
+	boolean			m_bRecord;
+	boolean			m_bRecordOverload;	// stop after an overload
+
+	// Run the DSP chain compiled into the kernel (PATCH_COMPILED builds)
+	boolean			m_bCompiled;
+
 	// Loaded patch handle
 	void			*m_pPatch;
 
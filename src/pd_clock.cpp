@@ -0,0 +1,98 @@
+//
+// pd_clock.cpp
+//
+// BarePD - High-resolution monotonic clock
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+//
+// Licensed under GPLv3
+//
+
+#include "pd_clock.h"
+#include <circle/timer.h>
+#include <circle/synchronize.h>
+#include <circle/types.h>
+
+// libpd's sys_getrealtime() (s_inter.c) and [cputime] (x_misc.c)
+extern "C" double barepd_getrealtime(void);
+
+static unsigned s_nFrequency = 0;	// 0: not yet determined
+
+// The ARM1176 (RASPPI=1) has no generic timer, CP15 c14 is undefined
+// there; 0 makes pd_clock_frequency() fall back to the system timer
+static u32 ReadCounterFrequency (void)
+{
+#if RASPPI >= 2
+	u32 nCNTFRQ;
+#if AARCH == 32
+	asm volatile ("mrc p15, 0, %0, c14, c0, 0" : "=r" (nCNTFRQ));
+#else
+	u64 nCNTFRQ64;
+	asm volatile ("mrs %0, CNTFRQ_EL0" : "=r" (nCNTFRQ64));
+	nCNTFRQ = (u32) nCNTFRQ64;
+#endif
+	return nCNTFRQ;
+#else
+	return 0;
+#endif
+}
+
+static u64 ReadCounter (void)
+{
+#if RASPPI >= 2
+	InstructionSyncBarrier ();
+#if AARCH == 32
+	u32 nCNTPCTLow, nCNTPCTHigh;
+	asm volatile ("mrrc p15, 0, %0, %1, c14" : "=r" (nCNTPCTLow), "=r" (nCNTPCTHigh));
+
+	return (u64) nCNTPCTHigh << 32 | nCNTPCTLow;
+#else
+	u64 nCNTPCT;
+	asm volatile ("mrs %0, CNTPCT_EL0" : "=r" (nCNTPCT));
+
+	return nCNTPCT;
+#endif
+#else
+	return CTimer::GetClockTicks64 ();
+#endif
+}
+
+unsigned pd_clock_frequency (void)
+{
+	if (s_nFrequency == 0)
+	{
+		// The firmware programs CNTFRQ; if it did not, the generic
+		// timer's rate is unknown and the system timer is used instead
+		u32 nFrequency = ReadCounterFrequency ();
+		s_nFrequency = nFrequency != 0 ? nFrequency : CLOCKHZ;
+	}
+
+	return s_nFrequency;
+}
+
+unsigned long long pd_clock_ticks (void)
+{
+	if (pd_clock_frequency () == CLOCKHZ)
+	{
+		return CTimer::GetClockTicks64 ();
+	}
+
+	return ReadCounter ();
+}
+
+double pd_clock_seconds (void)
+{
+	return (double) pd_clock_ticks () / pd_clock_frequency ();
+}
+
+unsigned long long pd_clock_usec (void)
+{
+	u64 nTicks = pd_clock_ticks ();
+	unsigned nFrequency = pd_clock_frequency ();
+
+	return nTicks / nFrequency * 1000000 + nTicks % nFrequency * 1000000 / nFrequency;
+}
+
+double barepd_getrealtime (void)
+{
+	return pd_clock_seconds ();
+}
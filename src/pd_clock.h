@@ -0,0 +1,35 @@
+//
+// pd_clock.h
+//
+// BarePD - High-resolution monotonic clock
+// Reads the ARM generic timer (19.2 MHz on the Raspberry Pi 3), falling
+// back to Circle's 1 MHz system timer if the counter frequency is unset
+// and on the Raspberry Pi 1 and Zero, which have no generic timer.
+// Used by libpd's sys_getrealtime(), gettimeofday(), [realtime] and
+// [cputime], and by BarePD's own timing code.
+//
+
+#ifndef _pd_clock_h
+#define _pd_clock_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counter ticks since boot (never wraps in practice)
+unsigned long long pd_clock_ticks(void);
+
+// Counter frequency in Hz
+unsigned pd_clock_frequency(void);
+
+// Seconds since boot
+double pd_clock_seconds(void);
+
+// Microseconds since boot
+unsigned long long pd_clock_usec(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
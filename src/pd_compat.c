@@ -19,6 +19,9 @@
 /* File I/O bridge - implemented in pd_fileio.cpp */
 #include "pd_fileio.h"
 
+/* Monotonic clock - implemented in pd_clock.cpp */
+#include "pd_clock.h"
+
 /* Newlib system call stubs - these are called by newlib's libc */
 
 /* _sbrk - increase program data space for malloc
@@ -290,12 +293,13 @@ int _open(const char *path, int flags, ...) {
 /* _fini stub */
 void _fini(void) { }
 
-/* gettimeofday stub */
+/* gettimeofday - monotonic time since boot (there is no wall clock) */
 int gettimeofday(struct timeval *tv, void *tz) {
     (void)tz;
     if (tv) {
-        tv->tv_sec = 0;
-        tv->tv_usec = 0;
+        unsigned long long usec = pd_clock_usec();
+        tv->tv_sec = (time_t)(usec / 1000000);
+        tv->tv_usec = (suseconds_t)(usec % 1000000);
     }
     return 0;
 }
@@ -0,0 +1,153 @@
+//
+// pd_compiled.cpp
+//
+// BarePD - Runtime for DSP chains compiled ahead of time
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+//
+// Licensed under GPLv3
+//
+
+#include "pd_compiled.h"
+#include <string.h>
+
+extern "C" {
+#include "g_canvas.h"
+}
+
+static int s_bEnabled = 0;
+static int s_bActive = 0;
+
+// Check the DSP chain against CompiledPatch entry by entry and note where
+// each entry sits in the chain. Returns the index of the first entry that
+// differs, or nEntries if they all match.
+static unsigned Bind (const TCompiledPatch *pPatch, t_dspentry **ppMap, int *pnMapSize)
+{
+	t_int *pChain;
+	t_dspentry *pMap;
+	int nMapSize = dsp_getmap (&pChain, &pMap);
+	*ppMap = pMap;
+	*pnMapSize = nMapSize;
+
+	unsigned i;
+	for (i = 0; i < pPatch->nEntries && i < (unsigned) nMapSize; i++)
+	{
+		const TCompiledEntry *pEntry = &pPatch->pEntries[i];
+		const t_dspentry *pMapEntry = &pMap[i];
+		t_int *w = pChain + pMapEntry->e_onset;
+
+		const char *pClass = pMapEntry->e_class ? pMapEntry->e_class->s_name : 0;
+		if (   (pClass == 0) != (pEntry->pClass == 0)
+		    || (pClass != 0 && strcmp (pClass, pEntry->pClass) != 0)
+		    || pMapEntry->e_nargs != (int) pEntry->nArgs
+		    || (pEntry->pRoutine != 0 && (t_perfroutine) w[0] != pEntry->pRoutine)
+		    || (pEntry->nSizeArg != 0 && w[pEntry->nSizeArg] != (t_int) pEntry->nSize))
+		{
+			break;
+		}
+
+		pPatch->ppEntry[i] = w;
+	}
+
+	if (i == pPatch->nEntries && nMapSize > 0)
+	{
+		// Pd's final dsp_done(), where the tick ends
+		const t_dspentry *pLast = &pMap[nMapSize - 1];
+		pPatch->ppEntry[i] = pChain + pLast->e_onset + pLast->e_nargs + 1;
+	}
+
+	return i;
+}
+
+static void ChainHook (void)
+{
+	const TCompiledPatch *pPatch = &CompiledPatch;
+
+	s_bActive = 0;
+	if (!s_bEnabled)
+	{
+		return;
+	}
+
+	if (pPatch->nBlockSize != DEFDACBLKSIZE)
+	{
+		pd_error (0, "compiled DSP: %s was compiled for block size %u, not %d",
+			  pPatch->pName, pPatch->nBlockSize, DEFDACBLKSIZE);
+		return;
+	}
+
+	t_dspentry *pMap;
+	int nMapSize;
+	unsigned nMatched = Bind (pPatch, &pMap, &nMapSize);
+	if (nMapSize == 0)
+	{
+		return;
+	}
+
+	if (   nMatched != pPatch->nEntries
+	    || nMapSize != (int) pPatch->nEntries)
+	{
+		// Name both sides, so that an entry pdc didn't see (the hidden
+		// switch~ of each voice with voices=, say) can be told from an
+		// edited patch
+		const char *pFound = "end of chain";
+		if (nMatched < (unsigned) nMapSize)
+		{
+			pFound = pMap[nMatched].e_class ? pMap[nMatched].e_class->s_name : "(Pd)";
+		}
+		const char *pExpected = "end of chain";
+		if (nMatched < pPatch->nEntries)
+		{
+			pExpected = pPatch->pEntries[nMatched].pClass ? pPatch->pEntries[nMatched].pClass : "(Pd)";
+		}
+
+		post ("compiled DSP: chain differs from %s at routine %u (%s, compiled %s), using libpd",
+		      pPatch->pName, nMatched, pFound, pExpected);
+		return;
+	}
+
+	dsp_setcompiled (pPatch->pTick);
+	s_bActive = 1;
+
+	post ("compiled DSP: running %s (%u routines)", pPatch->pName, pPatch->nEntries);
+}
+
+void pd_compiled_enable (int bEnable)
+{
+	sys_lock ();
+
+	s_bEnabled = bEnable;
+	dsp_setchainhook (bEnable ? ChainHook : 0);
+	if (!bEnable)
+	{
+		dsp_setcompiled (0);
+		s_bActive = 0;
+	}
+
+	sys_unlock ();
+}
+
+int pd_compiled_active (void)
+{
+	return s_bActive;
+}
+
+unsigned pd_compiled_find (const TCompiledPatch *pPatch, t_int *w)
+{
+	// Chain positions increase with the entry index
+	unsigned nLow = 0;
+	unsigned nHigh = pPatch->nEntries;
+	while (nLow < nHigh)
+	{
+		unsigned nMid = (nLow + nHigh) / 2;
+		if (pPatch->ppEntry[nMid] < w)
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	return nLow;
+}
@@ -0,0 +1,186 @@
+//
+// pd_compiled.h
+//
+// BarePD - Runtime for DSP chains compiled ahead of time
+// tools/pdc loads a patch on the host and writes its sorted DSP chain out
+// as C++: a table describing every perform routine in the chain and a
+// tick function that runs them in order. Simple routines (arithmetic,
+// copying, zeroing) are replaced by versions specialized for their fixed
+// vector size, the others are called one after the other; either way the
+// calls are direct, without the chain walk's indirection through the
+// previous routine's return value. The routines still take their
+// arguments from the chain libpd builds, as buffer and object addresses
+// are only known at run time. Linked into the
+// kernel, the code replaces Pd's chain walk whenever the chain built from
+// the patch on the SD card matches the table; otherwise (the patch was
+// changed, or another block size or channel count is used) libpd runs
+// the chain as usual.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_compiled_h
+#define _pd_compiled_h
+
+extern "C" {
+#include "m_pd.h"
+}
+
+struct TCompiledEntry
+{
+	t_perfroutine	 pRoutine;	// perform routine it must be, or 0 for any
+	const char	*pClass;	// class that added it, or 0 for Pd itself
+	unsigned	 nArgs;
+	unsigned	 nSizeArg;	// argument holding the vector size, or 0
+	unsigned	 nSize;		// vector size the code was generated for
+};
+
+struct TCompiledPatch
+{
+	const char		*pName;		// patch the code was generated from
+	unsigned		 nBlockSize;	// Pd's DEFDACBLKSIZE
+	unsigned		 nEntries;
+	const TCompiledEntry	*pEntries;
+	t_int			**ppEntry;	// nEntries + 1 chain positions, set by binding
+	void			(*pTick) (void);
+};
+
+// The patch linked into the kernel, defined by the generated code
+extern const TCompiledPatch CompiledPatch;
+
+// Run CompiledPatch instead of the DSP chain whenever the chain matches
+// it; checked again each time the chain is rebuilt
+void pd_compiled_enable (int bEnable);
+
+// Nonzero while CompiledPatch runs the DSP chain
+int pd_compiled_active (void);
+
+// Entry at chain position w (after a routine jumped, as block~ does)
+unsigned pd_compiled_find (const TCompiledPatch *pPatch, t_int *w);
+
+// Used by the generated tick function
+#define PDC_ENTRY(k)	(CompiledPatch.ppEntry[k])
+#define PDC_CALL(k)	w = (*(t_perfroutine) *PDC_ENTRY (k)) (PDC_ENTRY (k));	\
+			if (w != PDC_ENTRY ((k) + 1))				\
+			{							\
+				nEntry = pd_compiled_find (&CompiledPatch, w);	\
+				goto resume;					\
+			}
+
+// Fixed-size versions of Pd's perform routines, with the same argument
+// blocks and the same arithmetic. They are not inlined: one copy for each
+// operation and size keeps the tick function small enough for the
+// instruction cache in patches with hundreds of them.
+
+struct TPDCAdd		{ static t_sample Op (t_sample f, t_sample g) { return f + g; } };
+struct TPDCSub		{ static t_sample Op (t_sample f, t_sample g) { return f - g; } };
+struct TPDCReverseSub	{ static t_sample Op (t_sample f, t_sample g) { return g - f; } };
+struct TPDCMul		{ static t_sample Op (t_sample f, t_sample g) { return f * g; } };
+struct TPDCMax		{ static t_sample Op (t_sample f, t_sample g) { return f > g ? f : g; } };
+struct TPDCMin		{ static t_sample Op (t_sample f, t_sample g) { return f < g ? f : g; } };
+struct TPDCScalarMax	{ static t_sample Op (t_sample f, t_sample g) { return g > f ? g : f; } };
+struct TPDCScalarMin	{ static t_sample Op (t_sample f, t_sample g) { return g < f ? g : f; } };
+
+// The loops go eight samples at a time, loading all inputs of a group before
+// storing, like Pd's perf8 routines: outputs may be the inputs (in place),
+// and the compiler needs no alias checks to vectorize the group.
+
+#define PDC_STORE8(p)	((p)[0] = f0, (p)[1] = f1, (p)[2] = f2, (p)[3] = f3,	\
+			 (p)[4] = f4, (p)[5] = f5, (p)[6] = f6, (p)[7] = f7)
+
+// in1, in2, out, n
+template <class TOp, unsigned N>
+__attribute__ ((noinline)) void PDCVectorOp (const t_int *w)
+{
+	const t_sample *pIn1 = (const t_sample *) w[1];
+	const t_sample *pIn2 = (const t_sample *) w[2];
+	t_sample *pOut = (t_sample *) w[3];
+
+	unsigned i = 0;
+	for (; i + 8 <= N; i += 8)
+	{
+		const t_sample *p1 = pIn1 + i, *p2 = pIn2 + i;
+		t_sample f0 = TOp::Op (p1[0], p2[0]), f1 = TOp::Op (p1[1], p2[1]);
+		t_sample f2 = TOp::Op (p1[2], p2[2]), f3 = TOp::Op (p1[3], p2[3]);
+		t_sample f4 = TOp::Op (p1[4], p2[4]), f5 = TOp::Op (p1[5], p2[5]);
+		t_sample f6 = TOp::Op (p1[6], p2[6]), f7 = TOp::Op (p1[7], p2[7]);
+		PDC_STORE8 (pOut + i);
+	}
+	for (; i < N; i++)
+	{
+		pOut[i] = TOp::Op (pIn1[i], pIn2[i]);
+	}
+}
+
+// in, &scalar, out, n
+template <class TOp, unsigned N>
+__attribute__ ((noinline)) void PDCScalarOp (const t_int *w)
+{
+	const t_sample *pIn = (const t_sample *) w[1];
+	t_sample g = *(const t_float *) w[2];
+	t_sample *pOut = (t_sample *) w[3];
+
+	unsigned i = 0;
+	for (; i + 8 <= N; i += 8)
+	{
+		const t_sample *p = pIn + i;
+		t_sample f0 = TOp::Op (p[0], g), f1 = TOp::Op (p[1], g);
+		t_sample f2 = TOp::Op (p[2], g), f3 = TOp::Op (p[3], g);
+		t_sample f4 = TOp::Op (p[4], g), f5 = TOp::Op (p[5], g);
+		t_sample f6 = TOp::Op (p[6], g), f7 = TOp::Op (p[7], g);
+		PDC_STORE8 (pOut + i);
+	}
+	for (; i < N; i++)
+	{
+		pOut[i] = TOp::Op (pIn[i], g);
+	}
+}
+
+// out, n
+template <unsigned N>
+__attribute__ ((noinline)) void PDCZero (const t_int *w)
+{
+	t_sample *pOut = (t_sample *) w[1];
+
+	for (unsigned i = 0; i < N; i++)
+	{
+		pOut[i] = 0;
+	}
+}
+
+// in, out, n
+template <unsigned N>
+__attribute__ ((noinline)) void PDCCopy (const t_int *w)
+{
+	const t_sample *pIn = (const t_sample *) w[1];
+	t_sample *pOut = (t_sample *) w[2];
+
+	unsigned i = 0;
+	for (; i + 8 <= N; i += 8)
+	{
+		const t_sample *p = pIn + i;
+		t_sample f0 = p[0], f1 = p[1], f2 = p[2], f3 = p[3];
+		t_sample f4 = p[4], f5 = p[5], f6 = p[6], f7 = p[7];
+		PDC_STORE8 (pOut + i);
+	}
+	for (; i < N; i++)
+	{
+		pOut[i] = pIn[i];
+	}
+}
+
+// &scalar, out, n
+template <unsigned N>
+__attribute__ ((noinline)) void PDCScalarCopy (const t_int *w)
+{
+	t_sample f = *(const t_float *) w[1];
+	t_sample *pOut = (t_sample *) w[2];
+
+	for (unsigned i = 0; i < N; i++)
+	{
+		pOut[i] = f;
+	}
+}
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ * pd_conv.c
+ *
+ * BarePD - [conv~] partitioned FFT convolution
+ * Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+ *
+ * Convolves its input with an impulse response held in a Pd array, e.g.
+ * one loaded from the SD card with [soundfiler]. Usage:
+ *
+ *   [conv~ ir-left]     convolve with array "ir-left"
+ *   [set ir-right(      switch arrays (also re-reads a changed array)
+ *
+ * The response is split into two partition sizes. The head, the first
+ * 2*T samples, is done in partitions of the DSP block size N, so there is
+ * no latency. The tail is done in partitions of T = CONV_TAILSIZE samples,
+ * whose cost is spread evenly over the T/N blocks during which its input
+ * is collected: the FFT of the last input frame runs in the first block
+ * of a frame, the spectral multiply-adds are shared out between all of
+ * them and the inverse FFT runs in the last one. The result plays during
+ * the following frame, which is why the head covers two tail partitions.
+ *
+ * Both levels use uniformly partitioned overlap-save convolution with a
+ * frequency-domain delay line and Pd's real FFT (as [rfft~]).
+ *
+ * Licensed under GPLv3
+ */
+
+#include <string.h>
+#include "m_pd.h"
+#include "pd_conv.h"
+
+void mayer_init(void);
+void mayer_term(void);
+
+#define CONV_TAILSIZE   1024    /* tail partition size in samples */
+
+static t_class *conv_tilde_class;
+
+    /* one level of uniformly partitioned convolution; spectra and the
+    delay line hold npart packed real spectra of 2*n points each */
+typedef struct _convlevel
+{
+    int c_n;                /* partition size */
+    int c_npart;            /* number of partitions */
+    int c_pos;              /* delay line slot of the newest spectrum */
+    t_sample *c_spec;       /* impulse response spectra, pre-scaled */
+    t_sample *c_fdl;        /* input spectra */
+    t_sample *c_in;         /* last 2*n input samples */
+    t_sample *c_acc;        /* spectral sum, then the time-domain result */
+} t_convlevel;
+
+typedef struct _conv_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    t_symbol *x_arrayname;
+    int x_n;                /* block size the levels were built for */
+    int x_frameblocks;      /* tail: blocks per tail partition */
+    int x_phase;            /* tail: block within the current frame */
+    t_convlevel x_head;
+    t_convlevel x_tail;
+    t_sample *x_tailout;    /* tail result playing in this frame */
+} t_conv_tilde;
+
+static void convlevel_free(t_convlevel *c)
+{
+    int m = 2 * c->c_n, size = c->c_npart * m * sizeof(t_sample);
+    if (c->c_npart)
+    {
+        freebytes(c->c_spec, size);
+        freebytes(c->c_fdl, size);
+        freebytes(c->c_in, m * sizeof(t_sample));
+        freebytes(c->c_acc, m * sizeof(t_sample));
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+    /* build the partitions from ir[0..len-1]; the length is padded with
+    zeros to a whole number of partitions */
+static void convlevel_init(t_convlevel *c, int n, const t_word *ir, int len)
+{
+    int m = 2 * n, i, j;
+    convlevel_free(c);
+    if (len <= 0)
+        return;
+    c->c_n = n;
+    c->c_npart = (len + n - 1) / n;
+    c->c_spec = (t_sample *)getbytes(c->c_npart * m * sizeof(t_sample));
+    c->c_fdl = (t_sample *)getbytes(c->c_npart * m * sizeof(t_sample));
+    c->c_in = (t_sample *)getbytes(m * sizeof(t_sample));
+    c->c_acc = (t_sample *)getbytes(m * sizeof(t_sample));
+    for (i = 0; i < c->c_npart; i++)
+    {
+        t_sample *spec = c->c_spec + i * m;
+        for (j = 0; j < n && i * n + j < len; j++)
+            spec[j] = ir[i * n + j].w_float / m;
+        mayer_realfft(m, spec);
+    }
+}
+
+    /* c_in is complete: transform it into the newest delay line slot */
+static void convlevel_transform(t_convlevel *c)
+{
+    int m = 2 * c->c_n;
+    t_sample *slot;
+    if (--c->c_pos < 0)
+        c->c_pos = c->c_npart - 1;
+    slot = c->c_fdl + c->c_pos * m;
+    memcpy(slot, c->c_in, m * sizeof(t_sample));
+    mayer_realfft(m, slot);
+}
+
+    /* start the next input frame: the newer half becomes the older one */
+static void convlevel_shift(t_convlevel *c)
+{
+    memmove(c->c_in, c->c_in + c->c_n, c->c_n * sizeof(t_sample));
+}
+
+    /* multiply-add partitions [from, to) into the accumulator.  Spectra
+    are packed as by mayer_realfft(): re[0..m/2] then im[m/2-1..1]. */
+static void convlevel_mac(t_convlevel *c, int from, int to)
+{
+    int m = 2 * c->c_n, nover2 = c->c_n, i, k;
+    t_sample *acc = c->c_acc;
+    for (i = from; i < to; i++)
+    {
+        int slot = c->c_pos + i;
+        const t_sample *x, *h;
+        if (slot >= c->c_npart)
+            slot -= c->c_npart;
+        x = c->c_fdl + slot * m;
+        h = c->c_spec + i * m;
+        acc[0] += x[0] * h[0];
+        acc[nover2] += x[nover2] * h[nover2];
+        for (k = 1; k < nover2; k++)
+        {
+            t_sample xr = x[k], xi = x[m-k], hr = h[k], hi = h[m-k];
+            acc[k] += xr * hr - xi * hi;
+            acc[m-k] += xr * hi + xi * hr;
+        }
+    }
+}
+
+    /* transform the accumulated spectrum back; the last n samples are the
+    result.  The accumulator is cleared for the next frame. */
+static void convlevel_output(t_convlevel *c, t_sample *out)
+{
+    int n = c->c_n, m = 2 * n;
+    mayer_realifft(m, c->c_acc);
+    memcpy(out, c->c_acc + n, n * sizeof(t_sample));
+    memset(c->c_acc, 0, m * sizeof(t_sample));
+}
+
+static t_int *conv_tilde_perform(t_int *w)
+{
+    t_conv_tilde *x = (t_conv_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]), i;
+    t_convlevel *tail = &x->x_tail;
+
+        /* silent after a "set" to a missing or empty array */
+    if (!x->x_head.c_npart)
+    {
+        memset(out, 0, n * sizeof(t_sample));
+        return (w+5);
+    }
+    if (tail->c_npart)
+    {
+        if (x->x_phase == 0)
+        {
+                /* the frame before this one is complete */
+            convlevel_transform(tail);
+            convlevel_shift(tail);
+        }
+        memcpy(tail->c_in + tail->c_n + x->x_phase * n, in,
+            n * sizeof(t_sample));
+    }
+        /* in and out may share a buffer, so the input is copied first */
+    convlevel_shift(&x->x_head);
+    memcpy(x->x_head.c_in + n, in, n * sizeof(t_sample));
+    convlevel_transform(&x->x_head);
+    convlevel_mac(&x->x_head, 0, x->x_head.c_npart);
+    convlevel_output(&x->x_head, out);
+
+    if (tail->c_npart)
+    {
+        int nframe = x->x_frameblocks, phase = x->x_phase;
+        t_sample *tailout = x->x_tailout + phase * n;
+        for (i = 0; i < n; i++)
+            out[i] += tailout[i];
+        convlevel_mac(tail, (phase * tail->c_npart) / nframe,
+            ((phase + 1) * tail->c_npart) / nframe);
+        if (phase == nframe - 1)
+        {
+            convlevel_output(tail, x->x_tailout);
+            x->x_phase = 0;
+        }
+        else x->x_phase = phase + 1;
+    }
+    return (w+5);
+}
+
+static void conv_tilde_clear(t_conv_tilde *x)
+{
+    convlevel_free(&x->x_head);
+    convlevel_free(&x->x_tail);
+    if (x->x_tailout)
+        freebytes(x->x_tailout, CONV_TAILSIZE * sizeof(t_sample));
+    x->x_tailout = 0;
+    x->x_phase = 0;
+}
+
+    /* (re)build the partitions from the array for block size n */
+static void conv_tilde_load(t_conv_tilde *x, int n)
+{
+    t_garray *a;
+    t_word *vec;
+    int len, headlen;
+
+    conv_tilde_clear(x);
+    x->x_n = n;
+    if (!n || !*x->x_arrayname->s_name)
+        return;
+    if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
+    {
+        pd_error(x, "conv~: %s: no such array", x->x_arrayname->s_name);
+        return;
+    }
+    if (!garray_getfloatwords(a, &len, &vec))
+    {
+        pd_error(x, "%s: bad template for conv~", x->x_arrayname->s_name);
+        return;
+    }
+    garray_usedindsp(a);
+
+        /* a tail is only worth it if a frame spans several blocks */
+    x->x_frameblocks = CONV_TAILSIZE / n;
+    headlen = (x->x_frameblocks >= 2 ? 2 * CONV_TAILSIZE : len);
+    if (headlen > len)
+        headlen = len;
+    convlevel_init(&x->x_head, n, vec, headlen);
+    if (len > headlen)
+    {
+        convlevel_init(&x->x_tail, CONV_TAILSIZE, vec + headlen,
+            len - headlen);
+        x->x_tailout = (t_sample *)getbytes(CONV_TAILSIZE * sizeof(t_sample));
+    }
+}
+
+static void conv_tilde_set(t_conv_tilde *x, t_symbol *s)
+{
+    x->x_arrayname = s;
+    conv_tilde_load(x, x->x_n);
+}
+
+static void conv_tilde_dsp(t_conv_tilde *x, t_signal **sp)
+{
+    int n = sp[0]->s_n;
+    if (n < 4 || n != (1 << ilog2(n)))
+    {
+        pd_error(x, "conv~: blocksize (%d) not a power of 2", n);
+        conv_tilde_clear(x);
+        dsp_add_zero(sp[1]->s_vec, n);
+        return;
+    }
+    conv_tilde_load(x, n);
+    if (!x->x_head.c_npart)
+    {
+        dsp_add_zero(sp[1]->s_vec, n);
+        return;
+    }
+    dsp_add(conv_tilde_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, (t_int)n);
+}
+
+static void *conv_tilde_new(t_symbol *s)
+{
+    t_conv_tilde *x = (t_conv_tilde *)pd_new(conv_tilde_class);
+    x->x_arrayname = s;
+    x->x_f = 0;
+    outlet_new(&x->x_obj, &s_signal);
+    mayer_init();
+    return (x);
+}
+
+static void conv_tilde_free(t_conv_tilde *x)
+{
+    conv_tilde_clear(x);
+    mayer_term();
+}
+
+void conv_tilde_setup(void)
+{
+    conv_tilde_class = class_new(gensym("conv~"),
+        (t_newmethod)conv_tilde_new, (t_method)conv_tilde_free,
+        sizeof(t_conv_tilde), 0, A_DEFSYM, 0);
+    CLASS_MAINSIGNALIN(conv_tilde_class, t_conv_tilde, x_f);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_set,
+        gensym("set"), A_SYMBOL, 0);
+}
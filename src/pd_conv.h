@@ -0,0 +1,21 @@
+//
+// pd_conv.h
+//
+// BarePD - [conv~] partitioned FFT convolution
+//
+
+#ifndef _pd_conv_h
+#define _pd_conv_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register the [conv~] class with Pd; call after libpd_init()
+void conv_tilde_setup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
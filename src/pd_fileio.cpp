@@ -11,6 +11,7 @@
 //
 
 #include "pd_fileio.h"
+#include "pd_trace.h"
 #include <circle/fs/fat/fatfs.h>
 #include <circle/logger.h>
 #include <circle/util.h>
@@ -159,8 +160,10 @@ int barepd_open(const char *path, int oflag)
     pEntry->szPath[MAX_PATH_LEN - 1] = '\0';
     
     // Open file
+    CEventTrace::Begin(TraceSDOpen);
     unsigned hFile = s_pFileSystem->FileOpen(pName);
     if (hFile == 0) {
+        CEventTrace::End(TraceSDOpen);
         CLogger::Get()->Write(FromFileIO, LogWarning, "Cannot open: %s", pName);
         return -1;
     }
@@ -177,6 +180,7 @@ int barepd_open(const char *path, int oflag)
     
     // Reopen for actual reading
     hFile = s_pFileSystem->FileOpen(pName);
+    CEventTrace::End(TraceSDOpen, nSize);
     if (hFile == 0) {
         return -1;
     }
@@ -228,11 +232,14 @@ int pd_fileio_read(int fd, void *buf, unsigned int count)
     
     FileEntry *pEntry = &s_FileTable[slot];
     
+    CEventTrace::Begin(TraceSDRead, count);
     unsigned nRead = s_pFileSystem->FileRead(pEntry->hFile, buf, count);
     
     if (nRead == 0 || nRead == FS_ERROR) {
+        CEventTrace::End(TraceSDRead, 0);
         return 0;  // EOF
     }
+    CEventTrace::End(TraceSDRead, nRead);
     
     pEntry->nPosition += nRead;
     return (int)nRead;
@@ -13,14 +13,11 @@
 #include <cstdlib>
 #include <cstdio>
 
-extern "C" {
-#include "z_libpd.h"
-}
-
 static const char FromFudi[] = "fudi";
 
 CFudiParser::CFudiParser(void)
 :   m_nBufferPos(0),
+    m_nBatch(0),
     m_pOutputCallback(nullptr),
     m_nMessagesReceived(0),
     m_nParseErrors(0)
@@ -33,6 +30,31 @@ CFudiParser::~CFudiParser(void)
 }
 
 boolean CFudiParser::ProcessByte(char c)
+{
+    if (!CollectByte(c))
+        return FALSE;
+    
+    return SendBatch() > 0;
+}
+
+unsigned CFudiParser::ProcessBuffer(const char *pBuffer, unsigned nLength)
+{
+    unsigned nMessages = 0;
+    
+    for (unsigned i = 0; i < nLength; i++)
+    {
+        if (CollectByte(pBuffer[i]) && m_nBatch == FUDI_MAX_BATCH)
+        {
+            nMessages += SendBatch();
+        }
+    }
+    
+    nMessages += SendBatch();
+    
+    return nMessages;
+}
+
+boolean CFudiParser::CollectByte(char c)
 {
     // Ignore carriage returns
     if (c == '\r')
@@ -67,19 +89,23 @@ boolean CFudiParser::ProcessByte(char c)
     return FALSE;
 }
 
-unsigned CFudiParser::ProcessBuffer(const char *pBuffer, unsigned nLength)
+unsigned CFudiParser::SendBatch(void)
 {
-    unsigned nMessages = 0;
+    if (m_nBatch == 0)
+        return 0;
     
-    for (unsigned i = 0; i < nLength; i++)
+    unsigned nMissing = libpd_send_batch(m_nBatch, m_Batch);
+    unsigned nSent = m_nBatch - nMissing;
+    m_nBatch = 0;
+    
+    m_nMessagesReceived += nSent;
+    if (nMissing > 0)
     {
-        if (ProcessByte(pBuffer[i]))
-        {
-            nMessages++;
-        }
+        CLogger::Get()->Write(FromFudi, LogWarning, "%u messages to unknown receivers", nMissing);
+        m_nParseErrors += nMissing;
     }
     
-    return nMessages;
+    return nSent;
 }
 
 boolean CFudiParser::ParseAtom(const char *pAtom, boolean *pbIsFloat, float *pfValue)
@@ -128,111 +154,47 @@ boolean CFudiParser::ParseMessage(void)
         return FALSE;
     
     // First token is the receiver
-    const char *pReceiver = pTokens[0];
-    
-    // Handle special case: single token = bang
-    if (nTokens == 1)
+    t_libpd_batchmsg *pMsg = &m_Batch[m_nBatch];
+    t_atom *pAtoms = m_Atoms[m_nBatch];
+    pMsg->b_recv = libpd_gensym(pTokens[0]);
+    pMsg->b_msg = nullptr;
+    pMsg->b_argc = 0;
+    pMsg->b_argv = pAtoms;
+    
+    // Just the receiver name, or "receiver bang" = send bang
+    // Two tokens: receiver + float or symbol
+    // Three or more tokens: receiver + message + args
+    unsigned nFirstArg = 1;
+    if (nTokens == 1 || strcmp(pTokens[1], "bang") == 0)
     {
-        // Just receiver name = send bang
-        if (libpd_bang(pReceiver) == 0)
-        {
-            m_nMessagesReceived++;
-            CLogger::Get()->Write(FromFudi, LogDebug, "bang -> %s", pReceiver);
-            return TRUE;
-        }
-        else
-        {
-            CLogger::Get()->Write(FromFudi, LogWarning, "Unknown receiver: %s", pReceiver);
-            m_nParseErrors++;
-            return FALSE;
-        }
+        nFirstArg = nTokens;
     }
-    
-    // Second token might be a message type or a value
-    const char *pSecond = pTokens[1];
-    boolean bIsFloat;
-    float fValue;
-    
-    // Check if second token is "bang"
-    if (strcmp(pSecond, "bang") == 0)
+    else if (nTokens > 2)
     {
-        if (libpd_bang(pReceiver) == 0)
-        {
-            m_nMessagesReceived++;
-            CLogger::Get()->Write(FromFudi, LogDebug, "bang -> %s", pReceiver);
-            return TRUE;
-        }
-        m_nParseErrors++;
-        return FALSE;
+        pMsg->b_msg = libpd_gensym(pTokens[1]);
+        nFirstArg = 2;
     }
     
-    // Two tokens: receiver + float
-    if (nTokens == 2)
+    // Build argument list
+    for (unsigned i = nFirstArg; i < nTokens; i++)
     {
-        if (ParseAtom(pSecond, &bIsFloat, &fValue) && bIsFloat)
+        boolean bIsFloat;
+        float fValue;
+        if (ParseAtom(pTokens[i], &bIsFloat, &fValue))
         {
-            if (libpd_float(pReceiver, fValue) == 0)
+            if (bIsFloat)
             {
-                m_nMessagesReceived++;
-                CLogger::Get()->Write(FromFudi, LogDebug, "%.2f -> %s", (double)fValue, pReceiver);
-                return TRUE;
+                libpd_set_float(&pAtoms[pMsg->b_argc++], fValue);
             }
-        }
-        else
-        {
-            // It's a symbol
-            if (libpd_symbol(pReceiver, pSecond) == 0)
-            {
-                m_nMessagesReceived++;
-                CLogger::Get()->Write(FromFudi, LogDebug, "%s -> %s", pSecond, pReceiver);
-                return TRUE;
-            }
-        }
-        m_nParseErrors++;
-        return FALSE;
-    }
-    
-    // Three or more tokens: receiver + message + args
-    // Format: receiver message arg1 arg2 ...
-    const char *pMessage = pSecond;
-    
-    // Build argument list
-    int nArgs = nTokens - 2;
-    if (nArgs > 0)
-    {
-        if (libpd_start_message(nArgs) != 0)
-        {
-            m_nParseErrors++;
-            return FALSE;
-        }
-        
-        for (int i = 0; i < nArgs; i++)
-        {
-            const char *pArg = pTokens[2 + i];
-            if (ParseAtom(pArg, &bIsFloat, &fValue))
+            else
             {
-                if (bIsFloat)
-                {
-                    libpd_add_float(fValue);
-                }
-                else
-                {
-                    libpd_add_symbol(pArg);
-                }
+                libpd_set_symbol(&pAtoms[pMsg->b_argc++], pTokens[i]);
             }
         }
-        
-        if (libpd_finish_message(pReceiver, pMessage) == 0)
-        {
-            m_nMessagesReceived++;
-            CLogger::Get()->Write(FromFudi, LogDebug, "%s %s [...] -> %s", 
-                                  pMessage, nArgs > 0 ? pTokens[2] : "", pReceiver);
-            return TRUE;
-        }
     }
     
-    m_nParseErrors++;
-    return FALSE;
+    m_nBatch++;
+    return TRUE;
 }
 
 void CFudiParser::SetOutputCallback(TFudiOutputCallback pCallback)
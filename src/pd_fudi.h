@@ -11,6 +11,10 @@
 //   pd dsp 1;           -> libpd_message("pd", "dsp", 1, [1])
 //   osc freq 440 amp 0.5; -> libpd_message("osc", "freq", ...)
 //
+// The messages of a buffer are collected and handed to libpd in one
+// libpd_send_batch() call, so a burst (e.g. a controller dump) does not
+// pay for the lock and the dispatch of every single message.
+//
 // Copyright (C) 2024 Daniel Górny <PlayableElectronics>
 // Licensed under GPLv3
 //
@@ -20,9 +24,14 @@
 
 #include <circle/types.h>
 
+extern "C" {
+#include "z_libpd.h"
+}
+
 // Maximum message length
 #define FUDI_MAX_MESSAGE_LEN    256
 #define FUDI_MAX_ATOMS          32
+#define FUDI_MAX_BATCH          32      // messages sent to libpd at once
 
 // FUDI output callback type
 typedef void (*TFudiOutputCallback)(const char *pMessage);
@@ -34,11 +43,11 @@ public:
     ~CFudiParser(void);
 
     /// Process incoming bytes, returns true if a complete message was parsed
-    /// Call repeatedly with incoming serial data
+    /// and sent. Call repeatedly with incoming serial data
     boolean ProcessByte(char c);
     
-    /// Process a buffer of bytes
-    /// Returns number of complete messages parsed
+    /// Process a buffer of bytes, sending its messages as a batch
+    /// Returns number of complete messages parsed and sent
     unsigned ProcessBuffer(const char *pBuffer, unsigned nLength);
     
     /// Set callback for Pd output (messages from Pd to send back)
@@ -55,8 +64,14 @@ public:
     unsigned GetParseErrors(void) const { return m_nParseErrors; }
 
 private:
-    /// Parse and execute a complete FUDI message
+    /// Collect a byte, returns true if it completed a message
+    boolean CollectByte(char c);
+
+    /// Parse a complete FUDI message into the batch
     boolean ParseMessage(void);
+
+    /// Send the batch to libpd, returns the number of messages delivered
+    unsigned SendBatch(void);
     
     /// Parse a single atom (float or symbol)
     boolean ParseAtom(const char *pAtom, boolean *pbIsFloat, float *pfValue);
@@ -65,6 +80,11 @@ private:
     char m_Buffer[FUDI_MAX_MESSAGE_LEN];
     unsigned m_nBufferPos;
     
+    // Parsed messages, not yet sent
+    t_libpd_batchmsg m_Batch[FUDI_MAX_BATCH];
+    t_atom m_Atoms[FUDI_MAX_BATCH][FUDI_MAX_ATOMS];
+    unsigned m_nBatch;
+    
     // Output callback
     TFudiOutputCallback m_pOutputCallback;
     
@@ -0,0 +1,299 @@
+//
+// pd_governor.cpp
+//
+// BarePD - CPU clock governor implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_governor.h"
+#include "pd_record.h"
+#include <circle/koptions.h>
+#include <circle/logger.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+extern "C" {
+#include "z_libpd.h"
+#include "pd_clock.h"
+}
+
+#define GOVERNOR_UPDATE_MS	100	// load is averaged over this time
+#define GOVERNOR_REPORT_MS	1000	// temperature and load are sent this often
+#define GOVERNOR_COOL_DOWN	3	// degrees below socmaxtemp before the clock may rise
+
+static const char FromGovernor[] = "governor";
+
+volatile unsigned CCPUGovernor::s_nDSPClockTicks = 0;
+volatile unsigned CCPUGovernor::s_nDSPFrames = 0;
+
+CCPUGovernor::CCPUGovernor (void)
+:	m_pThrottle (nullptr),
+	m_Mode (GovernorOff),
+	m_bHold (FALSE),
+	m_Speed (CPUSpeedUnknown),
+	m_nUpPercent (GOVERNOR_DEFAULT_UP),
+	m_nDownPercent (GOVERNOR_DEFAULT_DOWN),
+	m_nIdleTicks (0),
+	m_nTicksPerFrame (0),
+	m_nMaxTemperature (0),
+	m_nLastUpdate (0),
+	m_nLastReport (0),
+	m_nLastBusy (0),
+	m_nPeakLoad (0),
+	m_nClockMHz (0),
+	m_nTemperature (0),
+	m_bHeldLow (FALSE),
+	m_pReceiver (nullptr)
+{
+}
+
+CCPUGovernor::~CCPUGovernor (void)
+{
+	if (m_pReceiver != nullptr)
+	{
+		libpd_unbind (m_pReceiver);
+	}
+
+	delete m_pThrottle;
+}
+
+boolean CCPUGovernor::Initialize (TGovernorMode Mode, unsigned nSampleRate,
+				  unsigned nUpPercent, unsigned nDownPercent, unsigned nIdleMs)
+{
+	if (Mode == GovernorOff)
+	{
+		return TRUE;
+	}
+
+	// Start at the maximum clock, the patch has just been loaded
+	assert (m_pThrottle == nullptr);
+	m_pThrottle = new CCPUThrottle (Mode == GovernorLow ? CPUSpeedLow : CPUSpeedMaximum);
+	if (   m_pThrottle == nullptr
+	    || !m_pThrottle->IsDynamic ())
+	{
+		CLogger::Get ()->Write (FromGovernor, LogWarning,
+					"CPU clock rate cannot be changed, governor disabled");
+		delete m_pThrottle;
+		m_pThrottle = nullptr;
+
+		return FALSE;
+	}
+
+	m_Mode = Mode;
+	m_Speed = Mode == GovernorLow ? CPUSpeedLow : CPUSpeedMaximum;
+
+	m_nUpPercent = nUpPercent;
+	m_nDownPercent = nDownPercent < nUpPercent ? nDownPercent : nUpPercent / 2;
+	m_nIdleTicks = nIdleMs * (CLOCKHZ / 1000);
+	m_nTicksPerFrame = (unsigned) (((u64) pd_clock_frequency () << 8) / nSampleRate);
+	m_nMaxTemperature = CKernelOptions::Get ()->GetSoCMaxTemp ();
+
+	m_pThrottle->RegisterSystemThrottledHandler (  SystemStateUnderVoltageOccurred
+						     | SystemStateFrequencyCappingOccurred
+						     | SystemStateThrottlingOccurred
+						     | SystemStateSoftTempLimitOccurred,
+						     ThrottledHandler, this);
+
+	m_pReceiver = libpd_bind (GOVERNOR_RECEIVER);
+
+	m_nLastUpdate = m_nLastReport = m_nLastBusy = CTimer::GetClockTicks ();
+
+	CLogger::Get ()->Write (FromGovernor, LogNotice,
+				"%s, %u-%u MHz, up at %u%% load, down below %u%% after %u ms, max. %u C",
+				GetModeName (Mode),
+				m_pThrottle->GetMinClockRate () / 1000000,
+				m_pThrottle->GetMaxClockRate () / 1000000,
+				m_nUpPercent, m_nDownPercent, nIdleMs, m_nMaxTemperature);
+
+	return TRUE;
+}
+
+void CCPUGovernor::SetHold (boolean bHold)
+{
+	m_bHold = bHold;
+
+	// Let the next Update() act on it right away
+	m_nLastUpdate -= GOVERNOR_UPDATE_MS * (CLOCKHZ / 1000);
+}
+
+void CCPUGovernor::Update (void)
+{
+	if (m_pThrottle == nullptr)
+	{
+		return;
+	}
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+	if (nTicks - m_nLastUpdate < GOVERNOR_UPDATE_MS * (CLOCKHZ / 1000))
+	{
+		return;
+	}
+	m_nLastUpdate = nTicks;
+
+	EnterCritical ();
+	unsigned nDSPClockTicks = s_nDSPClockTicks;
+	unsigned nDSPFrames = s_nDSPFrames;
+	s_nDSPClockTicks = 0;
+	s_nDSPFrames = 0;
+	LeaveCritical ();
+
+	// Time spent in libpd against the time the rendered audio lasts
+	unsigned nLoad = 0;
+	if (nDSPFrames > 0)
+	{
+		nLoad = (unsigned) (((u64) nDSPClockTicks * 100 << 8)
+				    / ((u64) nDSPFrames * m_nTicksPerFrame));
+	}
+	if (nLoad > m_nPeakLoad)
+	{
+		m_nPeakLoad = nLoad;
+	}
+	if (nLoad >= m_nDownPercent)
+	{
+		m_nLastBusy = nTicks;
+	}
+
+	TCPUSpeed Speed = m_Speed;
+	if (m_bHeldLow)
+	{
+		Speed = CPUSpeedLow;
+	}
+	else if (m_bHold || m_Mode == GovernorMax)
+	{
+		Speed = CPUSpeedMaximum;
+	}
+	else if (m_Mode == GovernorLow)
+	{
+		Speed = CPUSpeedLow;
+	}
+	else if (nLoad >= m_nUpPercent)
+	{
+		Speed = CPUSpeedMaximum;
+	}
+	else if (nTicks - m_nLastBusy >= m_nIdleTicks)
+	{
+		Speed = CPUSpeedLow;
+	}
+	SetSpeed (Speed);
+
+	if (nTicks - m_nLastReport >= GOVERNOR_REPORT_MS * (CLOCKHZ / 1000))
+	{
+		m_nLastReport = nTicks;
+
+		Report ();
+	}
+
+	// Circle's own temperature check and the throttled handler, every 4 s
+	m_pThrottle->Update ();
+}
+
+void CCPUGovernor::AddDSPTime (unsigned nClockTicks, unsigned nFrames)
+{
+	s_nDSPClockTicks += nClockTicks;
+	s_nDSPFrames += nFrames;
+}
+
+TGovernorMode CCPUGovernor::ParseMode (const char *pName)
+{
+	if (pName == nullptr)
+		return GovernorAuto;
+
+	if (strcmp (pName, "off") == 0 || strcmp (pName, "0") == 0)
+		return GovernorOff;
+	if (strcmp (pName, "auto") == 0 || strcmp (pName, "1") == 0)
+		return GovernorAuto;
+	if (strcmp (pName, "max") == 0)
+		return GovernorMax;
+	if (strcmp (pName, "low") == 0)
+		return GovernorLow;
+
+	return GovernorUnknown;
+}
+
+const char *CCPUGovernor::GetModeName (TGovernorMode Mode)
+{
+	switch (Mode)
+	{
+	case GovernorOff:	return "off";
+	case GovernorAuto:	return "auto";
+	case GovernorMax:	return "max";
+	case GovernorLow:	return "low";
+	default:		return "unknown";
+	}
+}
+
+void CCPUGovernor::SetSpeed (TCPUSpeed Speed)
+{
+	if (Speed == m_Speed)
+	{
+		return;
+	}
+
+	// Don't wait for the clock to settle, audio keeps running meanwhile
+	if (m_pThrottle->SetSpeed (Speed, FALSE) != CPUSpeedUnknown)
+	{
+		m_Speed = Speed;
+	}
+
+	SendClock ();
+}
+
+// Send temperature and load to the patch, and keep the SoC below socmaxtemp
+void CCPUGovernor::Report (void)
+{
+	unsigned nTemperature = m_pThrottle->GetTemperature ();
+	if (nTemperature != 0)
+	{
+		m_nTemperature = nTemperature;
+	}
+
+	if (   !m_bHeldLow
+	    && m_nTemperature > m_nMaxTemperature)
+	{
+		m_bHeldLow = TRUE;
+		SetSpeed (CPUSpeedLow);
+
+		CLogger::Get ()->Write (FromGovernor, LogWarning,
+					"SoC at %u C, holding the clock low", m_nTemperature);
+		CInputRecorder::SendFloat (GOVERNOR_THROTTLED_SEND, (float) GOVERNOR_HELD_LOW);
+	}
+	else if (   m_bHeldLow
+		 && m_nTemperature + GOVERNOR_COOL_DOWN < m_nMaxTemperature)
+	{
+		m_bHeldLow = FALSE;
+
+		CInputRecorder::SendFloat (GOVERNOR_THROTTLED_SEND, 0.0f);
+	}
+
+	// The clock can also be changed by Circle's temperature check
+	SendClock ();
+
+	CInputRecorder::SendFloat (GOVERNOR_TEMP_SEND, (float) m_nTemperature);
+	CInputRecorder::SendFloat (GOVERNOR_LOAD_SEND, (float) m_nPeakLoad);
+
+	m_nPeakLoad = 0;
+}
+
+void CCPUGovernor::SendClock (void)
+{
+	unsigned nClockMHz = m_pThrottle->GetClockRate () / 1000000;
+	if (   nClockMHz != 0
+	    && nClockMHz != m_nClockMHz)
+	{
+		m_nClockMHz = nClockMHz;
+
+		CInputRecorder::SendFloat (GOVERNOR_CLOCK_SEND, (float) nClockMHz);
+	}
+}
+
+void CCPUGovernor::ThrottledHandler (TSystemThrottledState State, void *pParam)
+{
+	// TSystemThrottledState flags are bits 16-19 of the firmware's state
+	unsigned nFlags = (unsigned) State >> 16;
+
+	CLogger::Get ()->Write (FromGovernor, LogWarning, "System throttled (flags %u)", nFlags);
+	CInputRecorder::SendFloat (GOVERNOR_THROTTLED_SEND, (float) nFlags);
+}
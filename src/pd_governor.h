@@ -0,0 +1,108 @@
+//
+// pd_governor.h
+//
+// BarePD - CPU clock governor
+// Sets the ARM clock from the measured DSP load: the maximum rate as soon
+// as the patch needs it, the minimum rate after it has been idle for a
+// while. Circle's CCPUThrottle still lowers the clock when the SoC gets
+// hotter than "socmaxtemp", and the governor does not raise it again
+// until the SoC has cooled down.
+//
+// The patch can listen to what the governor sees:
+//   [r barepd-cpu-temp]	SoC temperature in degrees Celsius, every second
+//   [r barepd-dsp-load]	highest DSP load of the last second, in percent
+//   [r barepd-cpu-clock]	ARM clock in MHz, whenever it changes
+//   [r barepd-throttled]	flags when the firmware or the governor throttles:
+//				1 under-voltage, 2 frequency capped, 4 throttled,
+//				8 soft temperature limit, 16 held low by socmaxtemp
+// and [s barepd-governor] 1 holds the maximum clock, 0 returns to
+// automatic control.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_governor_h
+#define _pd_governor_h
+
+#include <circle/cputhrottle.h>
+#include <circle/types.h>
+
+#define GOVERNOR_RECEIVER	"barepd-governor"
+#define GOVERNOR_TEMP_SEND	"barepd-cpu-temp"
+#define GOVERNOR_LOAD_SEND	"barepd-dsp-load"
+#define GOVERNOR_CLOCK_SEND	"barepd-cpu-clock"
+#define GOVERNOR_THROTTLED_SEND	"barepd-throttled"
+
+#define GOVERNOR_DEFAULT_UP	60	// % DSP load to switch to the maximum clock
+#define GOVERNOR_DEFAULT_DOWN	20	// % DSP load below which the clock may drop
+#define GOVERNOR_DEFAULT_IDLE_MS 5000	// time below GOVERNOR_DEFAULT_DOWN before it does
+
+#define GOVERNOR_HELD_LOW	BIT (4)	// barepd-throttled flag of the governor itself
+
+enum TGovernorMode
+{
+	GovernorOff,		// never touch the clock
+	GovernorAuto,		// follow the DSP load
+	GovernorMax,		// always the maximum clock
+	GovernorLow,		// always the minimum clock
+	GovernorUnknown
+};
+
+class CCPUGovernor
+{
+public:
+	CCPUGovernor (void);
+	~CCPUGovernor (void);
+
+	// Take over the clock (after I2C setup of the audio device is done)
+	boolean Initialize (TGovernorMode Mode, unsigned nSampleRate,
+			    unsigned nUpPercent, unsigned nDownPercent, unsigned nIdleMs);
+
+	// From the Pd float hook: 1 holds the maximum clock, 0 is automatic
+	void SetHold (boolean bHold);
+
+	// From the main loop
+	void Update (void);
+
+	// From the sound devices, around each call to libpd_process_float()
+	// (may be called at interrupt level)
+	static void AddDSPTime (unsigned nClockTicks, unsigned nFrames);
+
+	static TGovernorMode ParseMode (const char *pName);
+	static const char *GetModeName (TGovernorMode Mode);
+
+private:
+	void SetSpeed (TCPUSpeed Speed);
+	void Report (void);
+	void SendClock (void);
+
+	static void ThrottledHandler (TSystemThrottledState State, void *pParam);
+
+private:
+	CCPUThrottle	*m_pThrottle;
+	TGovernorMode	 m_Mode;
+	boolean		 m_bHold;
+	TCPUSpeed	 m_Speed;
+
+	unsigned	 m_nUpPercent;
+	unsigned	 m_nDownPercent;
+	unsigned	 m_nIdleTicks;
+	unsigned	 m_nTicksPerFrame;	// pd_clock ticks, times 256
+	unsigned	 m_nMaxTemperature;	// socmaxtemp
+
+	unsigned	 m_nLastUpdate;		// CTimer clock ticks
+	unsigned	 m_nLastReport;
+	unsigned	 m_nLastBusy;		// last time the load was above m_nDownPercent
+	unsigned	 m_nPeakLoad;		// percent, since the last report
+	unsigned	 m_nClockMHz;		// last reported
+	unsigned	 m_nTemperature;
+	boolean		 m_bHeldLow;
+
+	void		*m_pReceiver;
+
+	static volatile unsigned s_nDSPClockTicks;
+	static volatile unsigned s_nDSPFrames;
+};
+
+#endif
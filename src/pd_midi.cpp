@@ -0,0 +1,264 @@
+//
+// pd_midi.cpp
+//
+// BarePD - MIDI ingress queue implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_midi.h"
+#include <circle/synchronize.h>
+#include <assert.h>
+
+extern "C" {
+#include "pd_clock.h"
+}
+
+CMIDIQueue::CMIDIQueue (void)
+:	m_nIn (0),
+	m_nOut (0),
+	m_nDropped (0)
+{
+}
+
+CMIDIQueue::~CMIDIQueue (void)
+{
+}
+
+boolean CMIDIQueue::Put (unsigned nPort, const u8 *pData, unsigned nLength)
+{
+	assert (pData != nullptr);
+	assert (1 <= nLength && nLength <= 3);
+
+	unsigned nIn = m_nIn;
+	if (nIn - m_nOut >= MIDI_QUEUE_SIZE)
+	{
+		m_nDropped++;
+
+		return FALSE;
+	}
+
+	TMIDIEvent *pEvent = &m_Events[nIn & (MIDI_QUEUE_SIZE-1)];
+	pEvent->nTimestamp = pd_clock_ticks ();
+	pEvent->ucPort = (u8) nPort;
+	pEvent->ucLength = (u8) nLength;
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		pEvent->Data[i] = pData[i];
+	}
+
+	// Publish the event only once it is complete
+	DataMemBarrier ();
+	m_nIn = nIn + 1;
+
+	return TRUE;
+}
+
+const TMIDIEvent *CMIDIQueue::Peek (void) const
+{
+	unsigned nOut = m_nOut;
+	if (nOut == m_nIn)
+	{
+		return nullptr;
+	}
+
+	DataMemBarrier ();
+
+	return &m_Events[nOut & (MIDI_QUEUE_SIZE-1)];
+}
+
+void CMIDIQueue::Remove (void)
+{
+	assert (m_nOut != m_nIn);
+
+	DataMemBarrier ();
+	m_nOut = m_nOut + 1;
+}
+
+CMIDIParser::CMIDIParser (CMIDIQueue *pQueue, unsigned nPort)
+:	m_pQueue (pQueue),
+	m_nPort (nPort),
+	m_nLength (0),
+	m_nExpected (0),
+	m_bSysEx (FALSE)
+{
+	assert (m_pQueue != nullptr);
+	m_Message[0] = 0;
+}
+
+CMIDIParser::~CMIDIParser (void)
+{
+	m_pQueue = nullptr;
+}
+
+void CMIDIParser::Parse (u8 ucByte)
+{
+	// Realtime messages may come anywhere, even inside SysEx
+	if (ucByte >= 0xF8)
+	{
+		Put (&ucByte, 1);
+
+		return;
+	}
+
+	if (m_bSysEx)
+	{
+		if (ucByte < 0x80 || ucByte == 0xF7)
+		{
+			// SysEx is passed on 3 bytes at a time
+			m_Message[m_nLength++] = ucByte;
+			if (m_nLength == 3 || ucByte == 0xF7)
+			{
+				Put (m_Message, m_nLength);
+				m_nLength = 0;
+			}
+
+			if (ucByte == 0xF7)
+			{
+				m_bSysEx = FALSE;
+				m_Message[0] = 0;
+			}
+
+			return;
+		}
+
+		// Any other status byte ends SysEx unterminated
+		if (m_nLength > 0)
+		{
+			Put (m_Message, m_nLength);
+		}
+		m_bSysEx = FALSE;
+	}
+
+	if (ucByte == 0xF0)
+	{
+		m_bSysEx = TRUE;
+		m_Message[0] = ucByte;
+		m_nLength = 1;
+
+		return;
+	}
+
+	if (ucByte & 0x80)
+	{
+		// System common messages cancel running status
+		m_Message[0] = ucByte;
+		m_nLength = 1;
+		m_nExpected = 1 + GetDataLength (ucByte);
+		if (m_nExpected == 1)
+		{
+			if (ucByte == 0xF6)		// tune request
+			{
+				Put (m_Message, 1);
+			}
+			m_Message[0] = 0;
+		}
+
+		return;
+	}
+
+	// A data byte without status (e.g. after an undefined one) is dropped
+	if (m_Message[0] == 0)
+	{
+		return;
+	}
+
+	m_Message[m_nLength++] = ucByte;
+	if (m_nLength == m_nExpected)
+	{
+		Put (m_Message, m_nLength);
+
+		// Channel messages keep their status for the next one
+		m_nLength = 1;
+		if (m_Message[0] >= 0xF0)
+		{
+			m_Message[0] = 0;
+		}
+	}
+}
+
+void CMIDIParser::Put (const u8 *pData, unsigned nLength)
+{
+	m_pQueue->Put (m_nPort, pData, nLength);
+}
+
+unsigned CMIDIParser::GetDataLength (u8 ucStatus)
+{
+	switch (ucStatus >> 4)
+	{
+	case 0xC:	// program change
+	case 0xD:	// channel aftertouch
+		return 1;
+
+	case 0xF:
+		switch (ucStatus)
+		{
+		case 0xF1:	// MTC quarter frame
+		case 0xF3:	// song select
+			return 1;
+
+		case 0xF2:	// song position
+			return 2;
+
+		default:
+			return 0;
+		}
+
+	default:
+		return 2;
+	}
+}
+
+CMIDIIngress::CMIDIIngress (void)
+{
+}
+
+CMIDIIngress::~CMIDIIngress (void)
+{
+}
+
+CMIDIQueue *CMIDIIngress::GetQueue (unsigned nSource)
+{
+	assert (nSource < MIDI_MAX_SOURCES);
+
+	return &m_Queues[nSource];
+}
+
+unsigned CMIDIIngress::Flush (TMIDIEventHandler *pHandler, void *pParam)
+{
+	assert (pHandler != nullptr);
+
+	// Events arriving meanwhile wait for the next call
+	unsigned long long nNow = pd_clock_ticks ();
+
+	unsigned nEvents = 0;
+	while (1)
+	{
+		const TMIDIEvent *pOldest = nullptr;
+		unsigned nOldest = 0;
+		for (unsigned nSource = 0; nSource < MIDI_MAX_SOURCES; nSource++)
+		{
+			const TMIDIEvent *pEvent = m_Queues[nSource].Peek ();
+			if (   pEvent != nullptr
+			    && pEvent->nTimestamp <= nNow
+			    && (   pOldest == nullptr
+				|| pEvent->nTimestamp < pOldest->nTimestamp))
+			{
+				pOldest = pEvent;
+				nOldest = nSource;
+			}
+		}
+
+		if (pOldest == nullptr)
+		{
+			break;
+		}
+
+		(*pHandler) (pOldest, pParam);
+
+		m_Queues[nOldest].Remove ();
+		nEvents++;
+	}
+
+	return nEvents;
+}
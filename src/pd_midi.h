@@ -0,0 +1,107 @@
+//
+// pd_midi.h
+//
+// BarePD - MIDI ingress queues
+// MIDI packet handlers run at interrupt level, where libpd must not be
+// entered while the main loop may be inside it. They only timestamp each
+// event into a ring buffer. Every device has a queue of its own. The
+// main loop merges the queues in order of arrival into libpd (or the
+// voice allocator) before rendering the next audio period.
+//
+// Events are single MIDI messages, or up to 3 bytes of a SysEx message
+// (a first byte of 0xF0 or below 0x80), as in USB MIDI event packets.
+// CMIDIParser turns a serial MIDI byte stream into such events.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_midi_h
+#define _pd_midi_h
+
+#include <circle/types.h>
+
+#define MIDI_QUEUE_SIZE		256	// events, power of 2
+#define MIDI_BATCH_SIZE		64	// events handed to libpd at once
+#define MIDI_MAX_PORTS		8	// Pd ports, channels 1-128
+#define MIDI_MAX_SOURCES	(MIDI_MAX_PORTS+1) // queues, one per USB MIDI device
+#define MIDI_SOURCE_SERIAL	MIDI_MAX_PORTS	// and one for DIN MIDI on the UART
+
+struct TMIDIEvent
+{
+	unsigned long long	nTimestamp;	// pd_clock ticks at arrival
+	u8			ucPort;		// Pd MIDI port (channel / 16)
+	u8			ucLength;	// 1-3
+	u8			Data[3];
+};
+
+typedef void TMIDIEventHandler (const TMIDIEvent *pEvent, void *pParam);
+
+class CMIDIQueue
+{
+public:
+	CMIDIQueue (void);
+	~CMIDIQueue (void);
+
+	// From interrupt level, one message of 1-3 bytes. There must be only
+	// one caller at a time. FALSE if the queue is full and the event was
+	// dropped.
+	boolean Put (unsigned nPort, const u8 *pData, unsigned nLength);
+
+	// From the main loop: the oldest event, nullptr if there is none
+	const TMIDIEvent *Peek (void) const;
+	void Remove (void);
+
+	unsigned GetDropped (void) const	{ return m_nDropped; }
+
+private:
+	TMIDIEvent		m_Events[MIDI_QUEUE_SIZE];
+	volatile unsigned	m_nIn;
+	volatile unsigned	m_nOut;
+	unsigned		m_nDropped;
+};
+
+class CMIDIParser
+{
+public:
+	CMIDIParser (CMIDIQueue *pQueue, unsigned nPort);
+	~CMIDIParser (void);
+
+	// From interrupt level, for each received byte. Handles running
+	// status, realtime messages in between the bytes of another message,
+	// and SysEx messages of any length.
+	void Parse (u8 ucByte);
+
+private:
+	void Put (const u8 *pData, unsigned nLength);
+
+	static unsigned GetDataLength (u8 ucStatus);
+
+private:
+	CMIDIQueue	*m_pQueue;
+	unsigned	 m_nPort;
+
+	u8		 m_Message[3];	// status (0 for none) and data
+	unsigned	 m_nLength;	// bytes in m_Message
+	unsigned	 m_nExpected;	// bytes of a complete message
+	boolean		 m_bSysEx;
+};
+
+class CMIDIIngress
+{
+public:
+	CMIDIIngress (void);
+	~CMIDIIngress (void);
+
+	// Each queue must be fed by one handler only
+	CMIDIQueue *GetQueue (unsigned nSource);
+
+	// From the main loop: hand the events that have arrived from all
+	// sources until now to pHandler, the oldest first. Returns their number.
+	unsigned Flush (TMIDIEventHandler *pHandler, void *pParam);
+
+private:
+	CMIDIQueue		m_Queues[MIDI_MAX_SOURCES];
+};
+
+#endif
@@ -0,0 +1,108 @@
+//
+// pd_overload.cpp
+//
+// BarePD - Overload guard implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_overload.h"
+#include "pd_record.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <assert.h>
+
+extern "C" {
+#include "z_libpd.h"
+}
+
+#define OVERLOAD_SHED_INTERVAL_MS	20	// let a shed voice take effect first
+#define OVERLOAD_HOLD_MS		1000	// calm time before the level drops to 0
+
+static const char FromOverload[] = "overload";
+
+COverloadGuard::COverloadGuard (void)
+:	m_pVoices (nullptr),
+	m_nWarnPercent (OVERLOAD_DEFAULT_WARN),
+	m_nShedPercent (OVERLOAD_DEFAULT_SHED),
+	m_nFadeMs (OVERLOAD_DEFAULT_FADE_MS),
+	m_Level (OverloadNone),
+	m_nLastOverload (0),
+	m_nLastShed (0)
+{
+}
+
+COverloadGuard::~COverloadGuard (void)
+{
+}
+
+void COverloadGuard::Initialize (CVoiceAllocator *pVoices, unsigned nWarnPercent,
+				 unsigned nShedPercent, unsigned nFadeMs)
+{
+	m_pVoices = pVoices != nullptr && pVoices->IsAttached () ? pVoices : nullptr;
+	m_nWarnPercent = nWarnPercent;
+	m_nShedPercent = nShedPercent > nWarnPercent ? nShedPercent : nWarnPercent;
+	m_nFadeMs = nFadeMs;
+
+	CLogger::Get ()->Write (FromOverload, LogNotice,
+				"Warning at %u%% load, %s at %u%%", m_nWarnPercent,
+				m_pVoices != nullptr ? "shedding voices" : "no voices to shed",
+				m_nShedPercent);
+}
+
+void COverloadGuard::Update (unsigned nPeakLoad, unsigned nSilences)
+{
+	unsigned nTicks = CTimer::GetClockTicks ();
+
+	if (nSilences > 0)
+	{
+		SetLevel (OverloadSilence, nTicks);
+	}
+
+	if (nPeakLoad >= m_nShedPercent)
+	{
+		// Shed a voice at a time until the load comes down
+		if (   m_pVoices != nullptr
+		    && nTicks - m_nLastShed >= OVERLOAD_SHED_INTERVAL_MS * (CLOCKHZ / 1000)
+		    && m_pVoices->Shed (m_nFadeMs))
+		{
+			m_nLastShed = nTicks;
+
+			SetLevel (OverloadShedding, nTicks);
+		}
+		else
+		{
+			SetLevel (OverloadWarning, nTicks);
+		}
+	}
+	else if (nPeakLoad >= m_nWarnPercent)
+	{
+		SetLevel (OverloadWarning, nTicks);
+	}
+	else if (   m_Level != OverloadNone
+		 && nTicks - m_nLastOverload >= OVERLOAD_HOLD_MS * (CLOCKHZ / 1000))
+	{
+		m_Level = OverloadNone;
+
+		CInputRecorder::SendFloat (OVERLOAD_SEND, 0.0f);
+	}
+}
+
+// Raise the level (it only drops back to none after OVERLOAD_HOLD_MS)
+void COverloadGuard::SetLevel (TOverloadLevel Level, unsigned nTicks)
+{
+	m_nLastOverload = nTicks;
+
+	if (Level <= m_Level)
+	{
+		return;
+	}
+	m_Level = Level;
+
+	CInputRecorder::SendFloat (OVERLOAD_SEND, (float) Level);
+
+	if (Level == OverloadSilence)
+	{
+		CLogger::Get ()->Write (FromOverload, LogWarning, "DSP overload, silence inserted");
+	}
+}
@@ -0,0 +1,70 @@
+//
+// pd_overload.h
+//
+// BarePD - Overload guard
+// Watches the DSP load of each DMA period and steps in before the I2S
+// queue runs dry, in order of increasing damage:
+//
+//   1 warning	the load has reached "overloadwarn" percent
+//   2 shedding	above "overloadshed" percent the oldest [clone] voices of
+//		the voice allocator get a note-off and sleep after a short fade
+//   3 silence	the queue was about to run dry, the device faded out and
+//		inserted silence (see CPdSoundI2S::SetOverloadSilence())
+//
+// Each change of level is sent to [r barepd-overload], and 0 once the
+// load has stayed below the warning level for a while.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_overload_h
+#define _pd_overload_h
+
+#include <circle/types.h>
+#include "pd_voice.h"
+
+#define OVERLOAD_SEND			"barepd-overload"
+
+#define OVERLOAD_DEFAULT_WARN		80	// % of a DMA period spent in Pd
+#define OVERLOAD_DEFAULT_SHED		95
+#define OVERLOAD_DEFAULT_FADE_MS	50	// note-off to sleep of a shed voice
+
+enum TOverloadLevel
+{
+	OverloadNone,
+	OverloadWarning,
+	OverloadShedding,
+	OverloadSilence
+};
+
+class COverloadGuard
+{
+public:
+	COverloadGuard (void);
+	~COverloadGuard (void);
+
+	void Initialize (CVoiceAllocator *pVoices, unsigned nWarnPercent,
+			 unsigned nShedPercent, unsigned nFadeMs);
+
+	// From the main loop, with the peak load and the number of silences
+	// the sound device has seen since the last call
+	void Update (unsigned nPeakLoad, unsigned nSilences);
+
+	TOverloadLevel GetLevel (void) const	{ return m_Level; }
+
+private:
+	void SetLevel (TOverloadLevel Level, unsigned nTicks);
+
+private:
+	CVoiceAllocator	*m_pVoices;
+	unsigned	 m_nWarnPercent;
+	unsigned	 m_nShedPercent;
+	unsigned	 m_nFadeMs;
+
+	TOverloadLevel	 m_Level;
+	unsigned	 m_nLastOverload;	// CTimer clock ticks
+	unsigned	 m_nLastShed;
+};
+
+#endif
@@ -0,0 +1,475 @@
+//
+// pd_pmu.cpp
+//
+// BarePD - Performance monitor counters per DSP tick implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_pmu.h"
+#include <circle/logger.h>
+#include <circle/macros.h>
+#include <circle/string.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+extern "C" {
+#include "g_canvas.h"
+}
+
+// PMCR bits
+#define PMCR_E			BIT (0)		// enable
+#define PMCR_P			BIT (1)		// reset the event counters
+#define PMCR_C			BIT (2)		// reset the cycle counter
+#define PMCR_D			BIT (3)		// cycle counter counts every 64th cycle
+#define PMCR_N(reg)		(((reg) >> 11) & 0x1F)
+
+#define PMU_CYCLE_COUNTER	31		// PMSELR selects PMCCFILTR with it
+
+static const char FromPMU[] = "pmu";
+
+// Cortex-A53 event numbers, in the order of the FUDI report
+static const u32 s_EventTypes[PMU_MAX_EVENTS] =
+{
+	0x08,		// INST_RETIRED
+	0x03,		// L1D_CACHE_REFILL
+	0x17,		// L2D_CACHE_REFILL
+	0x10,		// BR_MIS_PRED
+	0xE8,		// Wr stage stalled by a load miss (implementation defined)
+	0xE7		// interlock of a floating-point/SIMD operation (ditto)
+};
+
+volatile boolean CPerfMonitor::s_bEnabled = FALSE;
+unsigned CPerfMonitor::s_nEvents = 0;
+TPMUCounters CPerfMonitor::s_Start;
+TPMUTotals CPerfMonitor::s_Totals;
+unsigned CPerfMonitor::s_nTicks = 0;
+u32 CPerfMonitor::s_nMaxCycles = 0;
+boolean CPerfMonitor::s_bProfile = FALSE;
+TPMUTotals *CPerfMonitor::s_pRoutines = nullptr;
+unsigned CPerfMonitor::s_nRoutines = 0;
+unsigned CPerfMonitor::s_nProfileTicks = 0;
+
+#if RASPPI >= 2
+
+static inline u32 ReadPMCR (void)
+{
+	u32 nValue;
+#if AARCH == 32
+	asm volatile ("mrc p15, 0, %0, c9, c12, 0" : "=r" (nValue));
+#else
+	u64 nValue64;
+	asm volatile ("mrs %0, pmcr_el0" : "=r" (nValue64));
+	nValue = (u32) nValue64;
+#endif
+
+	return nValue;
+}
+
+static inline void WritePMCR (u32 nValue)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c9, c12, 0" : : "r" (nValue));
+#else
+	asm volatile ("msr pmcr_el0, %0" : : "r" ((u64) nValue));
+#endif
+	InstructionSyncBarrier ();
+}
+
+static inline void EnableCounters (u32 nMask)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c9, c12, 1" : : "r" (nMask));
+#else
+	asm volatile ("msr pmcntenset_el0, %0" : : "r" ((u64) nMask));
+#endif
+}
+
+static inline void SelectCounter (unsigned nCounter)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c9, c12, 5" : : "r" (nCounter));
+#else
+	asm volatile ("msr pmselr_el0, %0" : : "r" ((u64) nCounter));
+#endif
+	InstructionSyncBarrier ();
+}
+
+// Of the selected counter
+static inline void WriteEventType (u32 nType)
+{
+#if AARCH == 32
+	asm volatile ("mcr p15, 0, %0, c9, c13, 1" : : "r" (nType));
+#else
+	asm volatile ("msr pmxevtyper_el0, %0" : : "r" ((u64) nType));
+#endif
+}
+
+// Of the selected counter
+static inline u32 ReadEventCount (void)
+{
+	u32 nValue;
+#if AARCH == 32
+	asm volatile ("mrc p15, 0, %0, c9, c13, 2" : "=r" (nValue));
+#else
+	u64 nValue64;
+	asm volatile ("mrs %0, pmxevcntr_el0" : "=r" (nValue64));
+	nValue = (u32) nValue64;
+#endif
+
+	return nValue;
+}
+
+static inline u32 ReadCycleCount (void)
+{
+	u32 nValue;
+#if AARCH == 32
+	asm volatile ("mrc p15, 0, %0, c9, c13, 0" : "=r" (nValue));
+#else
+	u64 nValue64;
+	asm volatile ("mrs %0, pmccntr_el0" : "=r" (nValue64));
+	nValue = (u32) nValue64;
+#endif
+
+	return nValue;
+}
+
+#else
+
+// The ARM1176 (RASPPI=1) has no ARMv7 performance monitor, CP15 c9 is
+// something else there; Initialize() refuses to run
+static inline u32 ReadPMCR (void)			{ return 0; }
+static inline void WritePMCR (u32 nValue)		{ }
+static inline void EnableCounters (u32 nMask)		{ }
+static inline void SelectCounter (unsigned nCounter)	{ }
+static inline void WriteEventType (u32 nType)		{ }
+static inline u32 ReadEventCount (void)			{ return 0; }
+static inline u32 ReadCycleCount (void)			{ return 0; }
+
+#endif
+
+// Entry of the perform routine at chain position w, nMapSize if there is none
+static unsigned FindEntry (const t_int *pChain, const t_dspentry *pMap, unsigned nMapSize,
+			   const t_int *w)
+{
+	int nOnset = w - pChain;
+
+	unsigned nLow = 0;
+	unsigned nHigh = nMapSize;
+	while (nLow < nHigh)
+	{
+		unsigned nMid = (nLow + nHigh) / 2;
+		if (pMap[nMid].e_onset < nOnset)
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	return nLow < nMapSize && pMap[nLow].e_onset == nOnset ? nLow : nMapSize;
+}
+
+CPerfMonitor::CPerfMonitor (void)
+:	m_pFudi (nullptr),
+	m_nReportTicks (PMU_DEFAULT_REPORT_MS * (CLOCKHZ / 1000)),
+	m_nLastReport (0)
+{
+}
+
+CPerfMonitor::~CPerfMonitor (void)
+{
+	s_bEnabled = FALSE;
+
+	if (s_bProfile)
+	{
+		dsp_setchainhook (0);
+		dsp_setcompiled (0);
+		s_bProfile = FALSE;
+	}
+
+	delete [] s_pRoutines;
+	s_pRoutines = nullptr;
+	s_nRoutines = 0;
+
+	m_pFudi = nullptr;
+}
+
+boolean CPerfMonitor::Initialize (CFudiParser *pFudi, unsigned nReportMs, boolean bProfile)
+{
+	assert (pFudi != nullptr);
+	m_pFudi = pFudi;
+
+	if (nReportMs > 0)
+	{
+		m_nReportTicks = nReportMs * (CLOCKHZ / 1000);
+	}
+
+#if RASPPI == 1
+	CLogger::Get ()->Write (FromPMU, LogWarning, "Performance counters not supported on this model");
+
+	return FALSE;
+#endif
+
+	u32 nPMCR = ReadPMCR ();
+	s_nEvents = PMCR_N (nPMCR);
+	if (s_nEvents > PMU_MAX_EVENTS)
+	{
+		s_nEvents = PMU_MAX_EVENTS;
+	}
+
+	for (unsigned i = 0; i < s_nEvents; i++)
+	{
+		SelectCounter (i);
+		WriteEventType (s_EventTypes[i]);
+	}
+
+	// Count cycles in all modes
+	SelectCounter (PMU_CYCLE_COUNTER);
+	WriteEventType (0);
+
+	WritePMCR ((nPMCR & ~PMCR_D) | PMCR_E | PMCR_P | PMCR_C);
+	EnableCounters (BIT (PMU_CYCLE_COUNTER) | (BIT (s_nEvents) - 1));
+
+	memset (&s_Totals, 0, sizeof s_Totals);
+	s_nTicks = 0;
+	s_nMaxCycles = 0;
+
+	// Walk the chain ourselves each time DSP is switched on
+	s_bProfile = bProfile;
+	if (s_bProfile)
+	{
+		dsp_setchainhook (ChainHook);
+	}
+
+	m_nLastReport = CTimer::GetClockTicks ();
+	s_bEnabled = TRUE;
+
+	CLogger::Get ()->Write (FromPMU, s_nEvents < PMU_MAX_EVENTS ? LogWarning : LogNotice,
+				"%u of %u event counters, report every %u ms%s",
+				s_nEvents, PMU_MAX_EVENTS, m_nReportTicks / (CLOCKHZ / 1000),
+				s_bProfile ? ", profiling perform routines" : "");
+
+	return TRUE;
+}
+
+void CPerfMonitor::Update (void)
+{
+	if (!s_bEnabled)
+	{
+		return;
+	}
+
+	unsigned nNow = CTimer::GetClockTicks ();
+	if (nNow - m_nLastReport < m_nReportTicks)
+	{
+		return;
+	}
+	m_nLastReport = nNow;
+
+	EnterCritical ();
+	TPMUTotals Totals = s_Totals;
+	unsigned nTicks = s_nTicks;
+	u32 nMaxCycles = s_nMaxCycles;
+	memset (&s_Totals, 0, sizeof s_Totals);
+	s_nTicks = 0;
+	s_nMaxCycles = 0;
+	LeaveCritical ();
+
+	if (nTicks == 0)
+	{
+		return;
+	}
+
+	Report (&Totals, nTicks, nMaxCycles);
+
+	if (   s_bProfile
+	    && s_nProfileTicks > 0)
+	{
+		ReportRoutines (s_nProfileTicks);
+
+		memset (s_pRoutines, 0, s_nRoutines * sizeof (TPMUTotals));
+		s_nProfileTicks = 0;
+	}
+}
+
+void CPerfMonitor::EndDSP (unsigned nTicks)
+{
+	if (!s_bEnabled)
+	{
+		return;
+	}
+
+	TPMUCounters Now;
+	Read (&Now);
+	Add (&s_Totals, &s_Start, &Now);
+
+	u32 nCycles = (Now.nCycles - s_Start.nCycles) / (nTicks > 0 ? nTicks : 1);
+	if (nCycles > s_nMaxCycles)
+	{
+		s_nMaxCycles = nCycles;
+	}
+
+	s_nTicks += nTicks;
+}
+
+// Averages per Pd tick
+void CPerfMonitor::Report (const TPMUTotals *pTotals, unsigned nTicks, u32 nMaxCycles)
+{
+	assert (pTotals != nullptr);
+	assert (nTicks > 0);
+
+	CString Message;
+	Message.Format ("%u %u %u", nTicks, (unsigned) (pTotals->nCycles / nTicks), nMaxCycles);
+
+	for (unsigned i = 0; i < PMU_MAX_EVENTS; i++)
+	{
+		CString Value;
+		Value.Format (" %u", (unsigned) (pTotals->nEvents[i] / nTicks));
+		Message.Append (Value);
+	}
+
+	m_pFudi->SendMessage (PMU_SEND, Message);
+}
+
+// The routines that took the most cycles, the most first
+void CPerfMonitor::ReportRoutines (unsigned nTicks)
+{
+	assert (nTicks > 0);
+
+	t_int *pChain;
+	t_dspentry *pMap;
+	unsigned nMapSize = (unsigned) dsp_getmap (&pChain, &pMap);
+	if (nMapSize > s_nRoutines)
+	{
+		nMapSize = s_nRoutines;
+	}
+
+	unsigned Top[PMU_PROFILE_TOP];
+	unsigned nTop = 0;
+	for (unsigned i = 0; i < nMapSize; i++)
+	{
+		u64 nCycles = s_pRoutines[i].nCycles;
+		if (nCycles == 0)
+		{
+			continue;		// not run, e.g. switched off
+		}
+
+		unsigned j = nTop < PMU_PROFILE_TOP ? nTop++ : PMU_PROFILE_TOP;
+		for (; j > 0 && s_pRoutines[Top[j-1]].nCycles < nCycles; j--)
+		{
+			if (j < PMU_PROFILE_TOP)
+			{
+				Top[j] = Top[j-1];
+			}
+		}
+
+		if (j < PMU_PROFILE_TOP)
+		{
+			Top[j] = i;
+		}
+	}
+
+	for (unsigned nRank = 0; nRank < nTop; nRank++)
+	{
+		unsigned nEntry = Top[nRank];
+		const TPMUTotals *pRoutine = &s_pRoutines[nEntry];
+
+		CString Message;
+		Message.Format ("%u %s %u %u", nRank + 1,
+				pMap[nEntry].e_class != 0 ? pMap[nEntry].e_class->s_name : "pd",
+				nEntry, (unsigned) (pRoutine->nCycles / nTicks));
+
+		for (unsigned i = 0; i < PMU_MAX_EVENTS; i++)
+		{
+			CString Value;
+			Value.Format (" %u", (unsigned) (pRoutine->nEvents[i] / nTicks));
+			Message.Append (Value);
+		}
+
+		m_pFudi->SendMessage (PMU_ROUTINE_SEND, Message);
+	}
+}
+
+void CPerfMonitor::Read (TPMUCounters *pCounters)
+{
+	pCounters->nCycles = ReadCycleCount ();
+
+	for (unsigned i = 0; i < s_nEvents; i++)
+	{
+		SelectCounter (i);
+		pCounters->nEvents[i] = ReadEventCount ();
+	}
+}
+
+// The counters are 32 bits wide, the difference is right across a wrap
+void CPerfMonitor::Add (TPMUTotals *pTotals, const TPMUCounters *pFrom, const TPMUCounters *pTo)
+{
+	pTotals->nCycles += pTo->nCycles - pFrom->nCycles;
+
+	for (unsigned i = 0; i < s_nEvents; i++)
+	{
+		pTotals->nEvents[i] += pTo->nEvents[i] - pFrom->nEvents[i];
+	}
+}
+
+// Called by Pd when the DSP chain has been rebuilt
+void CPerfMonitor::ChainHook (void)
+{
+	t_int *pChain;
+	t_dspentry *pMap;
+	int nMapSize = dsp_getmap (&pChain, &pMap);
+	if (nMapSize <= 0)
+	{
+		return;
+	}
+
+	if ((unsigned) nMapSize != s_nRoutines)
+	{
+		delete [] s_pRoutines;
+		s_pRoutines = new TPMUTotals[nMapSize];
+		s_nRoutines = s_pRoutines != nullptr ? nMapSize : 0;
+	}
+
+	memset (s_pRoutines, 0, s_nRoutines * sizeof (TPMUTotals));
+	s_nProfileTicks = 0;
+
+	dsp_setcompiled (ProfileTick);
+}
+
+// Runs the chain like dsp_tick(), following jumps (as block~ and sleeping
+// subpatches do). The time to read the counters is part of each routine.
+void CPerfMonitor::ProfileTick (void)
+{
+	t_int *pChain;
+	t_dspentry *pMap;
+	unsigned nMapSize = (unsigned) dsp_getmap (&pChain, &pMap);
+
+	TPMUCounters Before, After;
+	Read (&Before);
+
+	unsigned nEntry = 0;
+	for (t_int *w = pChain; w != nullptr; nEntry++)
+	{
+		if (   nEntry >= nMapSize
+		    || pChain + pMap[nEntry].e_onset != w)
+		{
+			nEntry = FindEntry (pChain, pMap, nMapSize, w);
+		}
+
+		w = (*(t_perfroutine) *w) (w);
+
+		Read (&After);
+		if (nEntry < s_nRoutines)
+		{
+			Add (&s_pRoutines[nEntry], &Before, &After);
+		}
+		Before = After;
+	}
+
+	s_nProfileTicks++;
+}
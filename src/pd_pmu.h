@@ -0,0 +1,104 @@
+//
+// pd_pmu.h
+//
+// BarePD - Performance monitor counters per DSP tick
+// Programs the Cortex-A53's performance monitor unit to count cycles,
+// instructions, L1 data and L2 cache refills, branch mispredictions and
+// pipeline stalls, and reads the counters around each call to
+// libpd_process_float(). The averages per Pd tick (one block of 64
+// frames) are sent over FUDI (not on the Raspberry Pi 1 and Zero, whose
+// ARM1176 has no such unit):
+//   barepd-pmu ticks cycles maxcycles instructions l1d-refill l2-refill
+//		branch-miss load-stall fp-stall;
+//
+// In profiling mode the DSP chain is walked by this module instead of
+// dsp_tick(), reading the counters around each perform routine. The
+// routines that took the most cycles are sent after the totals:
+//   barepd-pmu-routine rank class index cycles instructions l1d-refill
+//		l2-refill branch-miss load-stall fp-stall;
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_pmu_h
+#define _pd_pmu_h
+
+#include <circle/types.h>
+#include "pd_fudi.h"
+
+#define PMU_SEND		"barepd-pmu"
+#define PMU_ROUTINE_SEND	"barepd-pmu-routine"
+
+#define PMU_MAX_EVENTS		6	// event counters of the Cortex-A53
+#define PMU_DEFAULT_REPORT_MS	1000
+#define PMU_PROFILE_TOP		8	// routines reported in profiling mode
+
+struct TPMUCounters
+{
+	u32	nCycles;
+	u32	nEvents[PMU_MAX_EVENTS];
+};
+
+struct TPMUTotals
+{
+	u64	nCycles;
+	u64	nEvents[PMU_MAX_EVENTS];
+};
+
+class CPerfMonitor
+{
+public:
+	CPerfMonitor (void);
+	~CPerfMonitor (void);
+
+	// Program the PMU and report to pFudi every nReportMs. With bProfile,
+	// also count each perform routine (before DSP is switched on).
+	boolean Initialize (CFudiParser *pFudi, unsigned nReportMs, boolean bProfile);
+
+	// From the main loop
+	void Update (void);
+
+	// From the sound devices, around each call to libpd_process_float()
+	// (may be called at interrupt level)
+	static void BeginDSP (void)
+	{
+		if (s_bEnabled)
+		{
+			Read (&s_Start);
+		}
+	}
+
+	static void EndDSP (unsigned nTicks);
+
+private:
+	void Report (const TPMUTotals *pTotals, unsigned nTicks, u32 nMaxCycles);
+	void ReportRoutines (unsigned nTicks);
+
+	static void Read (TPMUCounters *pCounters);
+	static void Add (TPMUTotals *pTotals, const TPMUCounters *pFrom, const TPMUCounters *pTo);
+
+	static void ChainHook (void);
+	static void ProfileTick (void);
+
+private:
+	CFudiParser	*m_pFudi;
+	unsigned	 m_nReportTicks;	// CTimer clock ticks
+	unsigned	 m_nLastReport;
+
+	static volatile boolean	s_bEnabled;
+	static unsigned		s_nEvents;	// counters in use
+
+	static TPMUCounters	s_Start;
+	static TPMUTotals	s_Totals;
+	static unsigned		s_nTicks;
+	static u32		s_nMaxCycles;	// per Pd tick
+
+	// Profiling mode, one entry for each routine of the DSP chain
+	static boolean		s_bProfile;
+	static TPMUTotals	*s_pRoutines;
+	static unsigned		s_nRoutines;
+	static unsigned		s_nProfileTicks;
+};
+
+#endif
@@ -0,0 +1,809 @@
+//
+// pd_preset.cpp
+//
+// BarePD - Preset snapshots implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_preset.h"
+#include <circle/logger.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+extern "C" {
+#include "g_canvas.h"
+}
+
+// presets.bin, little endian:
+//   "BPDP", version, 0, number of slots (u16), number of presets (u16), 0 (u16)
+//   each slot: name length (u8), name
+//   each preset: preset number (u8), each slot: type (u8) and value,
+//   a float (4 bytes) or a symbol (length u8, characters)
+#define PRESET_FILE_VERSION	1
+#define PRESET_FILE_HEADER	12
+#define PRESET_MAX_NAME		255	// characters of a receiver name or symbol
+
+#define PRESET_TYPE_NONE	0
+#define PRESET_TYPE_FLOAT	1
+#define PRESET_TYPE_SYMBOL	2
+
+// An object bound to a receiver, keeping what was sent to it
+struct TPresetSlot
+{
+	t_pd		 Pd;
+	CPresetBank	*pBank;
+	unsigned	 nSlot;
+	t_symbol	*pName;
+};
+
+// The object bound to PRESET_RECEIVER
+struct TPresetObject
+{
+	t_pd		 Pd;
+	CPresetBank	*pBank;
+	t_clock		*pClock;	// one fade step per DSP block
+};
+
+static const char FromPreset[] = "preset";
+
+static t_class *s_pSlotClass = nullptr;
+static t_class *s_pPresetClass = nullptr;
+
+static void SlotFloat (TPresetSlot *pSlot, t_floatarg fValue)
+{
+	t_atom Value;
+	SETFLOAT (&Value, fValue);
+	pSlot->pBank->SetValue (pSlot->nSlot, &Value);
+}
+
+static void SlotSymbol (TPresetSlot *pSlot, t_symbol *pValue)
+{
+	t_atom Value;
+	SETSYMBOL (&Value, pValue);
+	pSlot->pBank->SetValue (pSlot->nSlot, &Value);
+}
+
+// Bangs, lists and other messages are not part of a preset
+static void SlotBang (TPresetSlot *pSlot)
+{
+}
+
+static void SlotAnything (TPresetSlot *pSlot, t_symbol *pSelector, int nArgs, t_atom *pArgs)
+{
+}
+
+static boolean GetPresetNumber (t_floatarg fPreset, unsigned *pPreset)
+{
+	int nPreset = (int) fPreset;
+	if (nPreset < 0 || nPreset >= PRESET_MAX_PRESETS)
+	{
+		CLogger::Get ()->Write (FromPreset, LogWarning, "No preset %d (0-%d)",
+					nPreset, PRESET_MAX_PRESETS-1);
+		return FALSE;
+	}
+
+	*pPreset = (unsigned) nPreset;
+
+	return TRUE;
+}
+
+static void PresetStore (TPresetObject *pObject, t_floatarg fPreset)
+{
+	unsigned nPreset;
+	if (GetPresetNumber (fPreset, &nPreset))
+	{
+		pObject->pBank->Store (nPreset);
+	}
+}
+
+static void PresetRecall (TPresetObject *pObject, t_floatarg fPreset)
+{
+	unsigned nPreset;
+	if (GetPresetNumber (fPreset, &nPreset))
+	{
+		pObject->pBank->Recall (nPreset);
+	}
+}
+
+static void PresetMorph (TPresetObject *pObject, t_floatarg fFrom, t_floatarg fTo,
+			 t_floatarg fPosition)
+{
+	unsigned nFrom, nTo;
+	if (GetPresetNumber (fFrom, &nFrom) && GetPresetNumber (fTo, &nTo))
+	{
+		pObject->pBank->Morph (nFrom, nTo, fPosition);
+	}
+}
+
+static void PresetFade (TPresetObject *pObject, t_floatarg fPreset, t_floatarg fMs)
+{
+	unsigned nPreset;
+	if (GetPresetNumber (fPreset, &nPreset))
+	{
+		pObject->pBank->Fade (nPreset, fMs);
+	}
+}
+
+static void SetupClasses (void)
+{
+	if (s_pSlotClass != nullptr)
+	{
+		return;
+	}
+
+	s_pSlotClass = class_new (gensym ("barepd-preset-slot"), 0, 0,
+				  sizeof (TPresetSlot), CLASS_PD, A_NULL);
+	class_addfloat (s_pSlotClass, (t_method) SlotFloat);
+	class_addsymbol (s_pSlotClass, (t_method) SlotSymbol);
+	class_addbang (s_pSlotClass, (t_method) SlotBang);
+	class_addanything (s_pSlotClass, (t_method) SlotAnything);
+
+	s_pPresetClass = class_new (gensym ("barepd-preset"), 0, 0,
+				    sizeof (TPresetObject), CLASS_PD, A_NULL);
+	class_addfloat (s_pPresetClass, (t_method) PresetRecall);
+	class_addmethod (s_pPresetClass, (t_method) PresetStore, gensym ("store"), A_FLOAT, A_NULL);
+	class_addmethod (s_pPresetClass, (t_method) PresetRecall, gensym ("recall"), A_FLOAT, A_NULL);
+	class_addmethod (s_pPresetClass, (t_method) PresetMorph, gensym ("morph"),
+			 A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
+	class_addmethod (s_pPresetClass, (t_method) PresetFade, gensym ("fade"),
+			 A_FLOAT, A_DEFFLOAT, A_NULL);
+}
+
+CPresetBank::CPresetBank (void)
+:	m_pFileSystem (nullptr),
+	m_nSlots (0),
+	m_pPresets (nullptr),
+	m_pSaved (nullptr),
+	m_pObject (nullptr),
+	m_nFadeTo (PRESET_MAX_PRESETS),
+	m_fFadeStart (0.0),
+	m_fFadeMs (0.0f),
+	m_bDirty (FALSE),
+	m_nLastStore (0)
+{
+	memset (m_Current, 0, sizeof m_Current);
+	memset (m_bStored, 0, sizeof m_bStored);
+	memset (m_bSaved, 0, sizeof m_bSaved);
+}
+
+CPresetBank::~CPresetBank (void)
+{
+	if (m_pObject != nullptr)
+	{
+		sys_lock ();
+
+		pd_unbind (&m_pObject->Pd, gensym (PRESET_RECEIVER));
+		clock_free (m_pObject->pClock);
+		pd_free (&m_pObject->Pd);
+
+		for (unsigned i = 0; i < m_nSlots; i++)
+		{
+			pd_unbind (&m_pSlots[i]->Pd, m_pSlots[i]->pName);
+			pd_free (&m_pSlots[i]->Pd);
+		}
+
+		sys_unlock ();
+	}
+
+	delete [] m_pPresets;
+	delete [] m_pSaved;
+}
+
+boolean CPresetBank::Initialize (const char *pReceivers, t_canvas *pPatch,
+				 CFATFileSystem *pFileSystem)
+{
+	assert (pReceivers != nullptr);
+	assert (pFileSystem != nullptr);
+	m_pFileSystem = pFileSystem;
+
+	sys_lock ();
+
+	SetupClasses ();
+
+	if (strcmp (pReceivers, "all") == 0)
+	{
+		if (pPatch != nullptr)
+		{
+			AddPatchReceivers (pPatch);
+		}
+	}
+	else
+	{
+		// Comma separated receiver names
+		while (*pReceivers != '\0')
+		{
+			char Name[256];
+			unsigned nLength = 0;
+			while (*pReceivers != '\0' && *pReceivers != ',')
+			{
+				if (nLength < sizeof Name - 1)
+				{
+					Name[nLength++] = *pReceivers;
+				}
+				pReceivers++;
+			}
+			Name[nLength] = '\0';
+
+			if (*pReceivers == ',')
+			{
+				pReceivers++;
+			}
+
+			if (nLength > 0)
+			{
+				AddSlot (gensym (Name));
+			}
+		}
+	}
+
+	if (m_nSlots == 0)
+	{
+		sys_unlock ();
+
+		CLogger::Get ()->Write (FromPreset, LogWarning, "No receivers, presets disabled");
+		return FALSE;
+	}
+
+	m_pPresets = new t_atom[PRESET_MAX_PRESETS][PRESET_MAX_SLOTS];
+	memset (m_pPresets, 0, PRESET_MAX_PRESETS * sizeof *m_pPresets);
+	m_pSaved = new t_atom[PRESET_MAX_PRESETS][PRESET_MAX_SLOTS];
+
+	m_pObject = (TPresetObject *) pd_new (s_pPresetClass);
+	m_pObject->pBank = this;
+	m_pObject->pClock = clock_new (m_pObject, (t_method) FadeTick);
+	clock_setunit (m_pObject->pClock, sys_getblksize (), 1);
+	pd_bind (&m_pObject->Pd, gensym (PRESET_RECEIVER));
+
+	Load ();
+
+	sys_unlock ();
+
+	unsigned nPresets = 0;
+	for (unsigned i = 0; i < PRESET_MAX_PRESETS; i++)
+	{
+		nPresets += m_bStored[i] ? 1 : 0;
+	}
+
+	CLogger::Get ()->Write (FromPreset, LogNotice, "%u receivers, %u presets in %s",
+				m_nSlots, nPresets, PRESET_FILE_NAME);
+
+	return TRUE;
+}
+
+void CPresetBank::Update (void)
+{
+	if (   !m_bDirty
+	    || CTimer::GetClockTicks () - m_nLastStore < PRESET_SAVE_DELAY_MS * (CLOCKHZ / 1000))
+	{
+		return;
+	}
+
+	// Only the copy is taken with interrupts off, not the writing
+	EnterCritical ();
+
+	m_bDirty = FALSE;
+	memcpy (m_bSaved, m_bStored, sizeof m_bSaved);
+	for (unsigned i = 0; i < PRESET_MAX_PRESETS; i++)
+	{
+		if (m_bSaved[i])
+		{
+			memcpy (m_pSaved[i], m_pPresets[i], m_nSlots * sizeof (t_atom));
+		}
+	}
+
+	LeaveCritical ();
+
+	if (!Save ())
+	{
+		CLogger::Get ()->Write (FromPreset, LogError, "Cannot write %s", PRESET_FILE_NAME);
+	}
+}
+
+void CPresetBank::Store (unsigned nPreset)
+{
+	assert (nPreset < PRESET_MAX_PRESETS);
+
+	memcpy (m_pPresets[nPreset], m_Current, m_nSlots * sizeof (t_atom));
+	m_bStored[nPreset] = TRUE;
+
+	// Written by Update(), once no more stores follow
+	m_bDirty = TRUE;
+	m_nLastStore = CTimer::GetClockTicks ();
+}
+
+void CPresetBank::Recall (unsigned nPreset)
+{
+	assert (nPreset < PRESET_MAX_PRESETS);
+
+	if (!m_bStored[nPreset])
+	{
+		CLogger::Get ()->Write (FromPreset, LogWarning, "Preset %u is empty", nPreset);
+		return;
+	}
+
+	m_nFadeTo = PRESET_MAX_PRESETS;
+	clock_unset (m_pObject->pClock);
+
+	for (unsigned i = 0; i < m_nSlots; i++)
+	{
+		Send (i, &m_pPresets[nPreset][i]);
+	}
+}
+
+void CPresetBank::Morph (unsigned nFrom, unsigned nTo, float fPosition)
+{
+	assert (nFrom < PRESET_MAX_PRESETS);
+	assert (nTo < PRESET_MAX_PRESETS);
+
+	if (!m_bStored[nFrom] || !m_bStored[nTo])
+	{
+		CLogger::Get ()->Write (FromPreset, LogWarning, "Preset %u is empty",
+					m_bStored[nFrom] ? nTo : nFrom);
+		return;
+	}
+
+	if (fPosition < 0.0f)
+	{
+		fPosition = 0.0f;
+	}
+	else if (fPosition > 1.0f)
+	{
+		fPosition = 1.0f;
+	}
+
+	m_nFadeTo = PRESET_MAX_PRESETS;
+	clock_unset (m_pObject->pClock);
+
+	Interpolate (m_pPresets[nFrom], m_pPresets[nTo], fPosition);
+}
+
+void CPresetBank::Fade (unsigned nPreset, float fMs)
+{
+	assert (nPreset < PRESET_MAX_PRESETS);
+
+	if (fMs <= 0.0f || !m_bStored[nPreset])
+	{
+		Recall (nPreset);
+		return;
+	}
+
+	memcpy (m_FadeFrom, m_Current, m_nSlots * sizeof (t_atom));
+	m_nFadeTo = nPreset;
+	m_fFadeStart = clock_getlogicaltime ();
+	m_fFadeMs = fMs;
+
+	clock_delay (m_pObject->pClock, 1);
+}
+
+void CPresetBank::SetValue (unsigned nSlot, const t_atom *pValue)
+{
+	assert (nSlot < m_nSlots);
+
+	m_Current[nSlot] = *pValue;
+}
+
+boolean CPresetBank::AddSlot (t_symbol *pName)
+{
+	assert (pName != nullptr);
+
+	if (   m_nSlots >= PRESET_MAX_SLOTS
+	    || strlen (pName->s_name) > PRESET_MAX_NAME)
+	{
+		return FALSE;
+	}
+
+	for (unsigned i = 0; i < m_nSlots; i++)
+	{
+		if (m_pSlots[i]->pName == pName)
+		{
+			return TRUE;
+		}
+	}
+
+	TPresetSlot *pSlot = (TPresetSlot *) pd_new (s_pSlotClass);
+	pSlot->pBank = this;
+	pSlot->nSlot = m_nSlots;
+	pSlot->pName = pName;
+	pd_bind (&pSlot->Pd, pName);
+
+	m_pSlots[m_nSlots++] = pSlot;
+
+	return TRUE;
+}
+
+// Every [r name] of the canvas and its subpatches and abstractions,
+// except BarePD's own receivers
+void CPresetBank::AddPatchReceivers (t_canvas *pCanvas)
+{
+	for (t_gobj *pObject = pCanvas->gl_list; pObject != nullptr; pObject = pObject->g_next)
+	{
+		if (pd_class (&pObject->g_pd) == canvas_class)
+		{
+			AddPatchReceivers ((t_canvas *) pObject);
+
+			continue;
+		}
+
+		if (strcmp (class_getname (pd_class (&pObject->g_pd)), "receive") != 0)
+		{
+			continue;
+		}
+
+		// Only [r name], not [r] with a right inlet for the name
+		t_object *pText = pd_checkobject (&pObject->g_pd);
+		if (pText == nullptr || binbuf_getnatom (pText->te_binbuf) != 2)
+		{
+			continue;
+		}
+
+		t_atom *pArg = binbuf_getvec (pText->te_binbuf) + 1;
+		t_symbol *pName;
+		if (pArg->a_type == A_SYMBOL)
+		{
+			pName = pArg->a_w.w_symbol;
+		}
+		else if (pArg->a_type == A_DOLLSYM)
+		{
+			pName = canvas_realizedollar (pCanvas, pArg->a_w.w_symbol);
+		}
+		else
+		{
+			continue;
+		}
+
+		if (strncmp (pName->s_name, "barepd-", 7) != 0)
+		{
+			AddSlot (pName);
+		}
+	}
+}
+
+void CPresetBank::Send (unsigned nSlot, const t_atom *pValue)
+{
+	t_pd *pTarget = m_pSlots[nSlot]->pName->s_thing;
+	if (pTarget == nullptr)
+	{
+		return;
+	}
+
+	// The slot is bound to the name as well and updates m_Current
+	if (pValue->a_type == A_FLOAT)
+	{
+		pd_float (pTarget, pValue->a_w.w_float);
+	}
+	else if (pValue->a_type == A_SYMBOL)
+	{
+		pd_symbol (pTarget, pValue->a_w.w_symbol);
+	}
+}
+
+// Floats take the values in between, anything else switches halfway.
+// Only values that change are sent.
+void CPresetBank::Interpolate (const t_atom *pFrom, const t_atom *pTo, float fPosition)
+{
+	for (unsigned i = 0; i < m_nSlots; i++)
+	{
+		t_atom Value;
+		if (pFrom[i].a_type == A_FLOAT && pTo[i].a_type == A_FLOAT)
+		{
+			t_float fFrom = pFrom[i].a_w.w_float;
+			SETFLOAT (&Value, fFrom + (pTo[i].a_w.w_float - fFrom) * fPosition);
+		}
+		else if (fPosition < 0.5f && pFrom[i].a_type != A_NULL)
+		{
+			Value = pFrom[i];
+		}
+		else if (pTo[i].a_type != A_NULL)
+		{
+			Value = pTo[i];
+		}
+		else
+		{
+			continue;
+		}
+
+		if (   Value.a_type != m_Current[i].a_type
+		    || (  Value.a_type == A_FLOAT
+			? Value.a_w.w_float != m_Current[i].a_w.w_float
+			: Value.a_w.w_symbol != m_Current[i].a_w.w_symbol))
+		{
+			Send (i, &Value);
+		}
+	}
+}
+
+void CPresetBank::FadeStep (void)
+{
+	if (m_nFadeTo >= PRESET_MAX_PRESETS)
+	{
+		return;
+	}
+
+	float fPosition = clock_gettimesince (m_fFadeStart) / m_fFadeMs;
+	unsigned nTo = m_nFadeTo;
+	if (fPosition >= 1.0f)
+	{
+		fPosition = 1.0f;
+		m_nFadeTo = PRESET_MAX_PRESETS;
+	}
+	else
+	{
+		clock_delay (m_pObject->pClock, 1);
+	}
+
+	Interpolate (m_FadeFrom, m_pPresets[nTo], fPosition);
+}
+
+void CPresetBank::FadeTick (TPresetObject *pObject)
+{
+	pObject->pBank->FadeStep ();
+}
+
+// Returns the number of bytes read, up to nCount
+static unsigned ReadFile (CFATFileSystem *pFileSystem, unsigned hFile, u8 *pBuffer, unsigned nCount)
+{
+	unsigned nSize = 0;
+	unsigned nRead;
+	while (   nSize < nCount
+	       && (nRead = pFileSystem->FileRead (hFile, pBuffer + nSize, nCount - nSize)) != 0
+	       && nRead != FS_ERROR)
+	{
+		nSize += nRead;
+	}
+
+	return nSize;
+}
+
+boolean CPresetBank::Load (void)
+{
+	unsigned hFile = m_pFileSystem->FileOpen (PRESET_FILE_NAME);
+	if (hFile == 0)
+	{
+		return FALSE;
+	}
+
+	// The header tells how large the rest can be at most: every name
+	// and every symbol of PRESET_MAX_NAME characters (about 4 MB for
+	// all slots and presets). A header beyond the limits is invalid.
+	u8 Header[PRESET_FILE_HEADER];
+	unsigned nSize = ReadFile (m_pFileSystem, hFile, Header, sizeof Header);
+	unsigned nMaxSize = nSize;
+	if (nSize == PRESET_FILE_HEADER)
+	{
+		unsigned nFileSlots = Header[6] | Header[7] << 8;
+		unsigned nPresets = Header[8] | Header[9] << 8;
+		if (nFileSlots <= PRESET_MAX_SLOTS && nPresets <= PRESET_MAX_PRESETS)
+		{
+			nMaxSize += nFileSlots * (1 + PRESET_MAX_NAME)
+				  + nPresets * (1 + nFileSlots * (2 + PRESET_MAX_NAME));
+		}
+	}
+
+	u8 *pBuffer = new u8[nMaxSize > 0 ? nMaxSize : 1];
+	memcpy (pBuffer, Header, nSize);
+	nSize += ReadFile (m_pFileSystem, hFile, pBuffer + nSize, nMaxSize - nSize);
+	m_pFileSystem->FileClose (hFile);
+
+	boolean bOK = FALSE;
+	const u8 *p = pBuffer;
+	const u8 *pEnd = pBuffer + nSize;
+	unsigned nFileSlots = 0;
+	unsigned nPresets = 0;
+	int *pSlotMap = nullptr;
+
+	if (   nSize >= PRESET_FILE_HEADER
+	    && memcmp (p, "BPDP", 4) == 0
+	    && p[4] == PRESET_FILE_VERSION)
+	{
+		nFileSlots = p[6] | p[7] << 8;
+		nPresets = p[8] | p[9] << 8;
+		p += PRESET_FILE_HEADER;
+
+		// Map the receivers of the file to ours, by name
+		pSlotMap = new int[nFileSlots+1];
+		bOK = TRUE;
+		for (unsigned i = 0; i < nFileSlots && bOK; i++)
+		{
+			if (p >= pEnd || p + 1 + *p > pEnd)
+			{
+				bOK = FALSE;
+				break;
+			}
+
+			char Name[256];
+			memcpy (Name, p + 1, *p);
+			Name[*p] = '\0';
+			p += 1 + *p;
+
+			t_symbol *pName = gensym (Name);
+			pSlotMap[i] = -1;
+			for (unsigned j = 0; j < m_nSlots; j++)
+			{
+				if (m_pSlots[j]->pName == pName)
+				{
+					pSlotMap[i] = j;
+					break;
+				}
+			}
+		}
+	}
+
+	for (unsigned i = 0; i < nPresets && bOK; i++)
+	{
+		if (p >= pEnd || *p >= PRESET_MAX_PRESETS)
+		{
+			bOK = FALSE;
+			break;
+		}
+		unsigned nPreset = *p++;
+
+		t_atom *pValues = m_pPresets[nPreset];
+		for (unsigned j = 0; j < nFileSlots; j++)
+		{
+			t_atom Value;
+			if (p >= pEnd)
+			{
+				bOK = FALSE;
+				break;
+			}
+
+			switch (*p++)
+			{
+			case PRESET_TYPE_NONE:
+				memset (&Value, 0, sizeof Value);	// A_NULL
+				break;
+
+			case PRESET_TYPE_FLOAT:
+				if (p + 4 > pEnd)
+				{
+					bOK = FALSE;
+					break;
+				}
+				{
+					float fValue;
+					memcpy (&fValue, p, 4);
+					SETFLOAT (&Value, fValue);
+				}
+				p += 4;
+				break;
+
+			case PRESET_TYPE_SYMBOL:
+				if (p >= pEnd || p + 1 + *p > pEnd)
+				{
+					bOK = FALSE;
+					break;
+				}
+				{
+					char Symbol[256];
+					memcpy (Symbol, p + 1, *p);
+					Symbol[*p] = '\0';
+					SETSYMBOL (&Value, gensym (Symbol));
+				}
+				p += 1 + p[0];
+				break;
+
+			default:
+				bOK = FALSE;
+				break;
+			}
+
+			if (!bOK)
+			{
+				break;
+			}
+
+			if (pSlotMap[j] >= 0)
+			{
+				pValues[pSlotMap[j]] = Value;
+			}
+		}
+
+		m_bStored[nPreset] = bOK;
+	}
+
+	delete [] pSlotMap;
+	delete [] pBuffer;
+
+	if (!bOK)
+	{
+		CLogger::Get ()->Write (FromPreset, LogWarning, "%s is invalid", PRESET_FILE_NAME);
+	}
+
+	return bOK;
+}
+
+boolean CPresetBank::Save (void)
+{
+	unsigned nSize = Serialize (nullptr);
+	u8 *pBuffer = new u8[nSize];
+	Serialize (pBuffer);
+
+	boolean bOK = FALSE;
+	unsigned hFile = m_pFileSystem->FileCreate (PRESET_FILE_NAME);
+	if (hFile != 0)
+	{
+		bOK = m_pFileSystem->FileWrite (hFile, pBuffer, nSize) == nSize;
+		bOK = m_pFileSystem->FileClose (hFile) != 0 && bOK;
+	}
+
+	delete [] pBuffer;
+
+	return bOK;
+}
+
+// Returns the size of the file, only counts the bytes if pBuffer is nullptr
+unsigned CPresetBank::Serialize (u8 *pBuffer) const
+{
+	unsigned nSize = 0;
+#define PUT(b)	do { if (pBuffer != nullptr) pBuffer[nSize] = (u8) (b); nSize++; } while (0)
+
+	unsigned nPresets = 0;
+	for (unsigned i = 0; i < PRESET_MAX_PRESETS; i++)
+	{
+		nPresets += m_bSaved[i] ? 1 : 0;
+	}
+
+	PUT ('B'); PUT ('P'); PUT ('D'); PUT ('P');
+	PUT (PRESET_FILE_VERSION); PUT (0);
+	PUT (m_nSlots); PUT (m_nSlots >> 8);
+	PUT (nPresets); PUT (nPresets >> 8);
+	PUT (0); PUT (0);
+
+	for (unsigned i = 0; i < m_nSlots; i++)
+	{
+		const char *pName = m_pSlots[i]->pName->s_name;
+		unsigned nLength = strlen (pName);
+		PUT (nLength);
+		for (unsigned j = 0; j < nLength; j++)
+		{
+			PUT (pName[j]);
+		}
+	}
+
+	for (unsigned i = 0; i < PRESET_MAX_PRESETS; i++)
+	{
+		if (!m_bSaved[i])
+		{
+			continue;
+		}
+
+		PUT (i);
+		for (unsigned j = 0; j < m_nSlots; j++)
+		{
+			const t_atom *pValue = &m_pSaved[i][j];
+			if (pValue->a_type == A_FLOAT)
+			{
+				float fValue = pValue->a_w.w_float;
+				u8 Bytes[4];
+				memcpy (Bytes, &fValue, 4);
+				PUT (PRESET_TYPE_FLOAT);
+				PUT (Bytes[0]); PUT (Bytes[1]); PUT (Bytes[2]); PUT (Bytes[3]);
+			}
+			else if (pValue->a_type == A_SYMBOL)
+			{
+				const char *pSymbol = pValue->a_w.w_symbol->s_name;
+				unsigned nLength = strlen (pSymbol);
+				if (nLength > PRESET_MAX_NAME)
+				{
+					nLength = PRESET_MAX_NAME;
+				}
+				PUT (PRESET_TYPE_SYMBOL);
+				PUT (nLength);
+				for (unsigned k = 0; k < nLength; k++)
+				{
+					PUT (pSymbol[k]);
+				}
+			}
+			else
+			{
+				PUT (PRESET_TYPE_NONE);
+			}
+		}
+	}
+
+#undef PUT
+	return nSize;
+}
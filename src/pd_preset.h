@@ -0,0 +1,110 @@
+//
+// pd_preset.h
+//
+// BarePD - Preset snapshots of patch parameters
+// Keeps the last float or symbol sent to each registered receiver, from
+// the patch, FUDI or MIDI alike. A snapshot of these values is a preset.
+// Presets are recalled inside Pd by sending the values straight to the
+// bound objects, without going through FUDI or the libpd API.
+//
+// The receivers are named in "presets" (comma separated), or "all" for
+// every [r name] of the patch. The patch controls the presets with
+// messages to [s barepd-preset]:
+//   store N		snapshot the current values as preset N
+//   recall N (or N)	send the values of preset N
+//   morph A B x	interpolate floats between presets A and B,
+//			x from 0 to 1 (symbols switch at 0.5)
+//   fade N ms		go from the current values to preset N in ms
+//
+// The presets are kept in the file presets.bin in the SD card's root.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_preset_h
+#define _pd_preset_h
+
+#include <circle/fs/fat/fatfs.h>
+#include <circle/types.h>
+
+extern "C" {
+#include "m_pd.h"
+}
+
+#define PRESET_RECEIVER		"barepd-preset"
+#define PRESET_FILE_NAME	"presets.bin"
+
+#define PRESET_MAX_PRESETS	64
+#define PRESET_MAX_SLOTS	256	// receivers
+#define PRESET_SAVE_DELAY_MS	1000	// after the last store, before writing the file
+
+struct TPresetObject;
+struct TPresetSlot;
+
+class CPresetBank
+{
+public:
+	CPresetBank (void);
+	~CPresetBank (void);
+
+	// Bind the receivers in pReceivers ("all" for those of pPatch) and
+	// load the presets file
+	boolean Initialize (const char *pReceivers, t_canvas *pPatch,
+			    CFATFileSystem *pFileSystem);
+	boolean IsActive (void) const		{ return m_nSlots > 0; }
+
+	// From the main loop: write stored presets to the SD card
+	void Update (void);
+
+	// From Pd (Pd lock held)
+	void Store (unsigned nPreset);
+	void Recall (unsigned nPreset);
+	void Morph (unsigned nFrom, unsigned nTo, float fPosition);
+	void Fade (unsigned nPreset, float fMs);
+	void SetValue (unsigned nSlot, const t_atom *pValue);
+
+	unsigned GetSlots (void) const		{ return m_nSlots; }
+
+private:
+	boolean AddSlot (t_symbol *pName);
+	void AddPatchReceivers (t_canvas *pCanvas);
+
+	void Send (unsigned nSlot, const t_atom *pValue);
+	void Interpolate (const t_atom *pFrom, const t_atom *pTo, float fPosition);
+	void FadeStep (void);
+
+	boolean Load (void);
+	boolean Save (void);
+	unsigned Serialize (u8 *pBuffer) const;	// of m_pSaved
+
+	static void FadeTick (TPresetObject *pObject);
+
+private:
+	CFATFileSystem	*m_pFileSystem;
+
+	TPresetSlot	*m_pSlots[PRESET_MAX_SLOTS];
+	unsigned	 m_nSlots;
+
+	t_atom		 m_Current[PRESET_MAX_SLOTS];	// A_NULL until a value is sent
+	t_atom		(*m_pPresets)[PRESET_MAX_SLOTS];	// PRESET_MAX_PRESETS of them
+	boolean		 m_bStored[PRESET_MAX_PRESETS];
+
+	// Copy of the presets written by Save(), as Store() may run at
+	// interrupt level (PWM output) while the file is written
+	t_atom		(*m_pSaved)[PRESET_MAX_SLOTS];
+	boolean		 m_bSaved[PRESET_MAX_PRESETS];
+
+	TPresetObject	*m_pObject;		// bound to PRESET_RECEIVER
+
+	// Fade in progress (m_nFadeTo < PRESET_MAX_PRESETS)
+	t_atom		 m_FadeFrom[PRESET_MAX_SLOTS];
+	unsigned	 m_nFadeTo;
+	double		 m_fFadeStart;		// Pd logical time
+	float		 m_fFadeMs;
+
+	boolean		 m_bDirty;
+	unsigned	 m_nLastStore;		// CTimer clock ticks
+};
+
+#endif
@@ -0,0 +1,355 @@
+//
+// pd_record.cpp
+//
+// BarePD - Input recorder implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_record.h"
+#include <circle/logger.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+extern "C" {
+#include "z_libpd.h"
+}
+
+static const char FromRecord[] = "record";
+
+volatile boolean CInputRecorder::s_bRecording = FALSE;
+boolean CInputRecorder::s_bDSPInterrupt = FALSE;
+volatile boolean CInputRecorder::s_bOverflow = FALSE;
+volatile unsigned CInputRecorder::s_nTicks = 0;
+
+u8 CInputRecorder::s_Buffer[RECORD_BUFFER_SIZE];
+volatile unsigned CInputRecorder::s_nIn = 0;
+volatile unsigned CInputRecorder::s_nOut = 0;
+
+CInputRecorder::CInputRecorder (void)
+:	m_pFileSystem (nullptr),
+	m_hFile (0),
+	m_pReceiver (nullptr),
+	m_bStopOnOverload (FALSE),
+	m_bOverload (FALSE),
+	m_nOverloadTime (0),
+	m_nBytesWritten (0),
+	m_bStopRequested (FALSE)
+{
+}
+
+CInputRecorder::~CInputRecorder (void)
+{
+	s_bRecording = FALSE;
+
+	if (m_pReceiver != nullptr)
+	{
+		libpd_unbind (m_pReceiver);
+		m_pReceiver = nullptr;
+	}
+
+	if (m_hFile != 0)
+	{
+		m_pFileSystem->FileClose (m_hFile);
+		m_hFile = 0;
+	}
+
+	m_pFileSystem = nullptr;
+}
+
+boolean CInputRecorder::Initialize (CFATFileSystem *pFileSystem, boolean bStopOnOverload,
+				    boolean bDSPInterrupt)
+{
+	assert (pFileSystem != nullptr);
+	m_pFileSystem = pFileSystem;
+	m_bStopOnOverload = bStopOnOverload;
+	s_bDSPInterrupt = bDSPInterrupt;
+
+	m_hFile = m_pFileSystem->FileCreate (RECORD_FILE_NAME);
+	if (m_hFile == 0)
+	{
+		CLogger::Get ()->Write (FromRecord, LogError, "Cannot create %s", RECORD_FILE_NAME);
+
+		return FALSE;
+	}
+
+	unsigned nSampleRate = (unsigned) sys_getsr ();
+	unsigned nBlockSize = libpd_blocksize ();
+
+	u8 Header[RECORD_HEADER_SIZE] =
+	{
+		'B', 'P', 'D', 'R', RECORD_FILE_VERSION, 0,
+		(u8) nSampleRate, (u8) (nSampleRate >> 8),
+		(u8) (nSampleRate >> 16), (u8) (nSampleRate >> 24),
+		(u8) nBlockSize, (u8) (nBlockSize >> 8),
+		(u8) sys_get_inchannels (), (u8) sys_get_outchannels (),
+		0, 0
+	};
+
+	s_nIn = 0;
+	s_nOut = 0;
+	s_nTicks = 0;
+	s_bOverflow = FALSE;
+	Put (Header, sizeof Header);
+
+	m_pReceiver = libpd_bind (RECORD_RECEIVER);
+
+	s_bRecording = TRUE;
+
+	CLogger::Get ()->Write (FromRecord, LogNotice, "Recording inputs to %s%s", RECORD_FILE_NAME,
+				bStopOnOverload ? " until an overload" : "");
+
+	return TRUE;
+}
+
+void CInputRecorder::Update (void)
+{
+	if (m_hFile == 0)
+	{
+		return;
+	}
+
+	if (s_bOverflow)
+	{
+		CLogger::Get ()->Write (FromRecord, LogWarning,
+					"Inputs came in faster than the SD card took them");
+		Finish ();
+
+		return;
+	}
+
+	if (   m_bStopRequested
+	    || (   m_bOverload
+		&& CTimer::GetClockTicks () - m_nOverloadTime >= RECORD_OVERLOAD_MS * (CLOCKHZ / 1000)))
+	{
+		Finish ();
+
+		return;
+	}
+
+	// A sector at a time, so that the audio queue does not run dry meanwhile
+	if (   s_nIn - s_nOut >= RECORD_WRITE_CHUNK
+	    && !Write (RECORD_WRITE_CHUNK))
+	{
+		CLogger::Get ()->Write (FromRecord, LogError, "Cannot write %s", RECORD_FILE_NAME);
+
+		s_bRecording = FALSE;
+		m_pFileSystem->FileClose (m_hFile);
+		m_hFile = 0;
+	}
+}
+
+void CInputRecorder::Stop (void)
+{
+	m_bStopRequested = TRUE;
+}
+
+void CInputRecorder::Overload (void)
+{
+	if (   !m_bStopOnOverload
+	    || m_hFile == 0
+	    || m_bOverload)
+	{
+		return;
+	}
+
+	m_bOverload = TRUE;
+	m_nOverloadTime = CTimer::GetClockTicks ();
+
+	CLogger::Get ()->Write (FromRecord, LogNotice, "Overload at tick %u, stopping in %u ms",
+				s_nTicks, RECORD_OVERLOAD_MS);
+}
+
+void CInputRecorder::BeginDSP (unsigned nTicks, const float *pInBuffer, unsigned nInChannels)
+{
+	if (   !s_bRecording
+	    || pInBuffer == nullptr
+	    || nInChannels == 0)
+	{
+		s_nTicks += nTicks;
+
+		return;
+	}
+
+	// A record for each tick of input, unless it is silent
+	unsigned nSamples = libpd_blocksize () * nInChannels;
+	for (unsigned nTick = 0; nTick < nTicks; nTick++)
+	{
+		for (unsigned i = 0; i < nSamples; i++)
+		{
+			if (pInBuffer[i] != 0.0f)
+			{
+				Append (RecordTypeADC, pInBuffer, nSamples * sizeof (float));
+
+				break;
+			}
+		}
+
+		pInBuffer += nSamples;
+		s_nTicks++;
+	}
+}
+
+boolean CInputRecorder::BeginInput (void)
+{
+	if (!s_bRecording || !s_bDSPInterrupt)
+	{
+		return FALSE;
+	}
+
+	EnterCritical ();
+
+	return TRUE;
+}
+
+void CInputRecorder::EndInput (boolean bHeld)
+{
+	if (bHeld)
+	{
+		LeaveCritical ();
+	}
+}
+
+void CInputRecorder::RecordFudi (const char *pBuffer, unsigned nLength)
+{
+	if (s_bRecording)
+	{
+		Append (RecordTypeFudi, pBuffer, nLength);
+	}
+}
+
+void CInputRecorder::RecordMIDI (const TMIDIEvent *pEvent)
+{
+	if (s_bRecording)
+	{
+		Append (RecordTypeMIDI, &pEvent->ucPort, 1, pEvent->Data, pEvent->ucLength);
+	}
+}
+
+void CInputRecorder::SendFloat (const char *pReceiver, float fValue)
+{
+	boolean bHeld = BeginInput ();
+
+	if (s_bRecording)
+	{
+		Append (RecordTypeFloat, &fValue, sizeof fValue, pReceiver, strlen (pReceiver));
+	}
+
+	libpd_float (pReceiver, fValue);
+
+	EndInput (bHeld);
+}
+
+void CInputRecorder::Finish (void)
+{
+	// Nothing may follow the end, not even adc~ input at interrupt level
+	EnterCritical ();
+	Append (RecordTypeEnd, nullptr, 0);
+	s_bRecording = FALSE;
+	LeaveCritical ();
+
+	boolean bOK = TRUE;
+	while (   bOK
+	       && s_nIn != s_nOut)
+	{
+		bOK = Write (RECORD_BUFFER_SIZE);
+	}
+
+	bOK = m_pFileSystem->FileClose (m_hFile) != 0 && bOK;
+	m_hFile = 0;
+
+	// The board is likely switched off next
+	m_pFileSystem->Synchronize ();
+
+	if (bOK)
+	{
+		CLogger::Get ()->Write (FromRecord, LogNotice, "%u ticks, %u bytes written to %s",
+					s_nTicks, m_nBytesWritten, RECORD_FILE_NAME);
+	}
+	else
+	{
+		CLogger::Get ()->Write (FromRecord, LogError, "Cannot write %s", RECORD_FILE_NAME);
+	}
+}
+
+// Write the oldest records, up to the end of the buffer
+boolean CInputRecorder::Write (unsigned nMaxBytes)
+{
+	unsigned nOut = s_nOut;
+	unsigned nOffset = nOut & (RECORD_BUFFER_SIZE-1);
+
+	unsigned nBytes = s_nIn - nOut;
+	if (nBytes > RECORD_BUFFER_SIZE - nOffset)
+	{
+		nBytes = RECORD_BUFFER_SIZE - nOffset;
+	}
+	if (nBytes > nMaxBytes)
+	{
+		nBytes = nMaxBytes;
+	}
+
+	if (m_pFileSystem->FileWrite (m_hFile, &s_Buffer[nOffset], nBytes) != nBytes)
+	{
+		return FALSE;
+	}
+
+	s_nOut = nOut + nBytes;
+	m_nBytesWritten += nBytes;
+
+	return TRUE;
+}
+
+void CInputRecorder::Append (TRecordType Type, const void *pData, unsigned nLength,
+			     const void *pData2, unsigned nLength2)
+{
+	unsigned nPayload = nLength + nLength2;
+	assert (nPayload <= 0xFFFF);
+
+	EnterCritical ();
+
+	if (!s_bRecording)
+	{
+		LeaveCritical ();
+
+		return;
+	}
+
+	// The replay would not be exact with a record missing, stop instead
+	if (RECORD_ENTRY_SIZE + nPayload > RECORD_BUFFER_SIZE - (s_nIn - s_nOut))
+	{
+		s_bRecording = FALSE;
+		s_bOverflow = TRUE;
+		LeaveCritical ();
+
+		return;
+	}
+
+	unsigned nTick = s_nTicks;
+	u8 Entry[RECORD_ENTRY_SIZE] =
+	{
+		(u8) nTick, (u8) (nTick >> 8), (u8) (nTick >> 16), (u8) (nTick >> 24),
+		(u8) Type, 0,
+		(u8) nPayload, (u8) (nPayload >> 8)
+	};
+
+	Put (Entry, sizeof Entry);
+	Put (pData, nLength);
+	Put (pData2, nLength2);
+
+	LeaveCritical ();
+}
+
+void CInputRecorder::Put (const void *pData, unsigned nLength)
+{
+	const u8 *pFrom = (const u8 *) pData;
+	unsigned nIn = s_nIn;
+
+	while (nLength--)
+	{
+		s_Buffer[nIn++ & (RECORD_BUFFER_SIZE-1)] = *pFrom++;
+	}
+
+	s_nIn = nIn;
+}
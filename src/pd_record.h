@@ -0,0 +1,125 @@
+//
+// pd_record.h
+//
+// BarePD - Input recorder for replay on the host
+// Records everything that reaches the patch from outside (FUDI bytes,
+// MIDI events, the floats BarePD sends to the patch itself, adc~ blocks)
+// to the SD card. Each record is stamped with the number of Pd ticks
+// processed before it was handed to libpd, not with the time, so that
+// tools/pdc's replay can hand the same inputs to the same patch at the
+// same ticks and an overload in the field can be reproduced and profiled
+// off the device.
+//
+// Recording starts with DSP and stops on [s barepd-record] 0, a second
+// after the overload guard had to insert silence (if enabled), or when
+// the inputs come in faster than the SD card takes them.
+//
+// File format (little endian):
+//   "BPDR", version, 0, sample rate (4), block size (2),
+//   adc~ channels (1), dac~ channels (1),
+//   then records of tick (4), type (1), 0, length (2), payload.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_record_h
+#define _pd_record_h
+
+#include <circle/fs/fat/fatfs.h>
+#include <circle/types.h>
+#include "pd_midi.h"
+
+#define RECORD_RECEIVER		"barepd-record"
+#define RECORD_FILE_NAME	"record.bpr"
+#define RECORD_FILE_VERSION	1
+
+#define RECORD_BUFFER_SIZE	0x10000	// bytes not yet written, power of 2
+#define RECORD_WRITE_CHUNK	512	// bytes written from the main loop at once
+#define RECORD_OVERLOAD_MS	1000	// recorded after silence was inserted
+
+#define RECORD_HEADER_SIZE	16
+#define RECORD_ENTRY_SIZE	8	// before the payload
+
+enum TRecordType
+{
+	RecordTypeFudi = 1,	// bytes received on the UART
+	RecordTypeMIDI,		// port, 1-3 bytes
+	RecordTypeFloat,	// value (4), receiver name
+	RecordTypeADC,		// interleaved float samples of one tick
+	RecordTypeEnd,		// stamped with the number of ticks recorded
+	RecordTypeUnknown
+};
+
+class CInputRecorder
+{
+public:
+	CInputRecorder (void);
+	~CInputRecorder (void);
+
+	// Create RECORD_FILE_NAME and start recording at tick 0 (after the
+	// audio device was set up, before DSP is switched on). bDSPInterrupt
+	// if the sound device runs libpd at interrupt level (PWM output).
+	boolean Initialize (CFATFileSystem *pFileSystem, boolean bStopOnOverload,
+			    boolean bDSPInterrupt);
+
+	// From the main loop: write the records to the SD card
+	void Update (void);
+
+	// From the Pd float hook
+	void Stop (void);
+
+	// From the main loop, when the overload guard inserted silence
+	void Overload (void);
+
+	boolean IsRecording (void) const	{ return m_hFile != 0; }
+
+	// From the sound devices, before each call to libpd_process_float()
+	// (may be called at interrupt level)
+	static void BeginDSP (unsigned nTicks, const float *pInBuffer, unsigned nInChannels);
+
+	// Around recording an input and handing it to libpd: with DSP at
+	// interrupt level a tick could come in between and the stamp would
+	// be one off, so while recording the interrupt is held off until
+	// EndInput(). Returns what EndInput() needs.
+	static boolean BeginInput (void);
+	static void EndInput (boolean bHeld);
+
+	// Record an input, before it is handed to libpd
+	static void RecordFudi (const char *pBuffer, unsigned nLength);
+	static void RecordMIDI (const TMIDIEvent *pEvent);
+
+	// libpd_float(), recorded: for values that BarePD sends to the patch
+	static void SendFloat (const char *pReceiver, float fValue);
+
+private:
+	void Finish (void);
+	boolean Write (unsigned nMaxBytes);
+
+	static void Append (TRecordType Type, const void *pData, unsigned nLength,
+			    const void *pData2 = nullptr, unsigned nLength2 = 0);
+	static void Put (const void *pData, unsigned nLength);
+
+private:
+	CFATFileSystem	*m_pFileSystem;
+	unsigned	 m_hFile;
+	void		*m_pReceiver;		// bound to RECORD_RECEIVER
+
+	boolean		 m_bStopOnOverload;
+	boolean		 m_bOverload;		// stop pending
+	unsigned	 m_nOverloadTime;	// CTimer clock ticks
+
+	unsigned	 m_nBytesWritten;
+	boolean		 m_bStopRequested;
+
+	static volatile boolean	s_bRecording;
+	static boolean		s_bDSPInterrupt;
+	static volatile boolean	s_bOverflow;
+	static volatile unsigned s_nTicks;	// Pd ticks processed since the start
+
+	static u8		s_Buffer[RECORD_BUFFER_SIZE];
+	static volatile unsigned s_nIn;
+	static volatile unsigned s_nOut;
+};
+
+#endif
@@ -0,0 +1,336 @@
+//
+// pd_trace.cpp
+//
+// BarePD - Event trace buffer implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_trace.h"
+#include <circle/logger.h>
+#include <assert.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+#include <circle/multicore.h>
+#endif
+
+extern "C" {
+#include "z_libpd.h"
+#include "pd_clock.h"
+}
+
+#define TRACE_DUMP_CHUNK	(SERIAL_BUF_SIZE / 2)	// bytes written at once
+
+static const char FromTrace[] = "trace";
+
+static const char *s_pEventName[TraceEventUnknown] =
+{
+	"dsp",
+	"underrun",
+	"silence",
+	"midi in",
+	"midi flush",
+	"fudi",
+	"usb plug and play",
+	"sd open",
+	"sd read",
+	"log"
+};
+
+CEventTrace::TTraceRing CEventTrace::s_Rings[TRACE_MAX_CORES];
+
+volatile boolean CEventTrace::s_bRecording = FALSE;
+boolean CEventTrace::s_bDumpOnUnderrun = FALSE;
+volatile boolean CEventTrace::s_bUnderrun = FALSE;
+unsigned long long CEventTrace::s_nUnderrunTime = 0;
+
+CEventTrace::CEventTrace (void)
+:	m_pSerial (nullptr),
+	m_pReceiver (nullptr),
+	m_bDumpRequested (FALSE),
+	m_bDumping (FALSE),
+	m_bResume (FALSE),
+	m_nDumpCore (0),
+	m_nDumpNext (0),
+	m_nDumpEnd (0),
+	m_nDumpBase (0),
+	m_bDumpHeader (FALSE),
+	m_bDumpFooter (FALSE),
+	m_nDumpedEvents (0)
+{
+}
+
+CEventTrace::~CEventTrace (void)
+{
+	s_bRecording = FALSE;
+
+	if (m_pReceiver != nullptr)
+	{
+		libpd_unbind (m_pReceiver);
+		m_pReceiver = nullptr;
+	}
+
+	m_pSerial = nullptr;
+}
+
+boolean CEventTrace::Initialize (CSerialDevice *pSerial, boolean bDumpOnUnderrun)
+{
+	assert (pSerial != nullptr);
+	m_pSerial = pSerial;
+
+	s_bDumpOnUnderrun = bDumpOnUnderrun;
+
+	CLogger::Get ()->RegisterEventNotificationHandler (LogEventHandler);
+
+	m_pReceiver = libpd_bind (TRACE_RECEIVER);
+
+	s_bRecording = TRUE;
+
+	CLogger::Get ()->Write (FromTrace, LogNotice, "%u events per core%s",
+				TRACE_RING_SIZE, bDumpOnUnderrun ? ", dump on underrun" : "");
+
+	return TRUE;
+}
+
+void CEventTrace::Update (void)
+{
+	if (m_pSerial == nullptr)
+	{
+		return;
+	}
+
+	if (!m_bDumping)
+	{
+		if (m_bDumpRequested)
+		{
+			m_bDumpRequested = FALSE;
+		}
+		else if (   !s_bUnderrun
+			 ||   pd_clock_ticks () - s_nUnderrunTime
+			    < (unsigned long long) pd_clock_frequency () * TRACE_DUMP_DELAY_MS / 1000)
+		{
+			return;
+		}
+
+		StartDump ();
+	}
+
+	// Never wait for the serial port, audio must go on meanwhile. Once it
+	// has sent everything, fill half of its buffer (the driver inserts a
+	// CR before each NL).
+	if (m_pSerial->IsTransmitting ())
+	{
+		return;
+	}
+
+	unsigned nBytes = 0;
+	while (1)
+	{
+		if (   m_Line.GetLength () == 0
+		    && !FormatNext ())
+		{
+			break;
+		}
+
+		nBytes += m_Line.GetLength () + 1;
+		if (nBytes > TRACE_DUMP_CHUNK)
+		{
+			return;
+		}
+
+		m_pSerial->Write ((const char *) m_Line, m_Line.GetLength ());
+		m_Line = "";
+	}
+
+	// Done, start over with an empty trace
+	for (unsigned nCore = 0; nCore < TRACE_MAX_CORES; nCore++)
+	{
+		s_Rings[nCore].nIn = 0;
+	}
+
+	m_bDumping = FALSE;
+	s_bUnderrun = FALSE;
+	s_bRecording = m_bResume;
+
+	CLogger::Get ()->Write (FromTrace, LogNotice, "%u events written", m_nDumpedEvents);
+}
+
+void CEventTrace::RequestDump (void)
+{
+	if (m_pSerial != nullptr && !m_bDumping)
+	{
+		m_bDumpRequested = TRUE;
+	}
+}
+
+void CEventTrace::SetRecording (boolean bRecording)
+{
+	if (m_pSerial == nullptr)
+	{
+		return;
+	}
+
+	if (m_bDumping)
+	{
+		m_bResume = bRecording;
+	}
+	else
+	{
+		s_bRecording = bRecording;
+	}
+}
+
+void CEventTrace::Span (TTraceEvent Event, unsigned long long nStart, unsigned nArg)
+{
+	if (s_bRecording)
+	{
+		Record (Event, 'B', nArg, nStart);
+		Record (Event, 'E', nArg);
+	}
+}
+
+void CEventTrace::Underrun (TTraceEvent Event, unsigned nArg)
+{
+	if (!s_bRecording)
+	{
+		return;
+	}
+
+	Record (Event, 'i', nArg);
+
+	// The first one only, the events after it are recorded too
+	if (s_bDumpOnUnderrun && !s_bUnderrun)
+	{
+		s_nUnderrunTime = pd_clock_ticks ();
+		s_bUnderrun = TRUE;
+	}
+}
+
+const char *CEventTrace::GetEventName (TTraceEvent Event)
+{
+	if (Event >= TraceEventUnknown)
+	{
+		return "unknown";
+	}
+
+	return s_pEventName[Event];
+}
+
+void CEventTrace::Record (TTraceEvent Event, char chPhase, unsigned nArg)
+{
+	Record (Event, chPhase, nArg, pd_clock_ticks ());
+}
+
+void CEventTrace::Record (TTraceEvent Event, char chPhase, unsigned nArg,
+			  unsigned long long nTimestamp)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	TTraceRing *pRing = &s_Rings[CMultiCoreSupport::ThisCore ()];
+#else
+	TTraceRing *pRing = &s_Rings[0];
+#endif
+
+	// Reserve the slot first, an interrupt meanwhile takes the next one
+	// (with a timestamp that may be a little older than this one's)
+	unsigned nIn = __atomic_fetch_add (&pRing->nIn, 1, __ATOMIC_RELAXED);
+
+	TTraceRecord *pRecord = &pRing->Records[nIn & (TRACE_RING_SIZE-1)];
+	pRecord->nTimestamp = nTimestamp;
+	pRecord->nArg = nArg;
+	pRecord->ucEvent = (u8) Event;
+	pRecord->chPhase = chPhase;
+}
+
+// Called by the logger for each message, whether it is shown or not
+void CEventTrace::LogEventHandler (void)
+{
+	Instant (TraceLog);
+}
+
+void CEventTrace::StartDump (void)
+{
+	m_bResume = s_bRecording;
+	s_bRecording = FALSE;
+
+	m_bDumping = TRUE;
+	m_bDumpHeader = TRUE;
+	m_bDumpFooter = TRUE;
+	m_nDumpedEvents = 0;
+	m_Line = "";
+
+	// Start at the oldest event of the first core,
+	// timestamps are relative to the oldest event of all
+	m_nDumpBase = (unsigned long long) -1;
+	for (unsigned nCore = 0; nCore < TRACE_MAX_CORES; nCore++)
+	{
+		unsigned nIn = s_Rings[nCore].nIn;
+		if (nIn == 0)
+		{
+			continue;
+		}
+
+		unsigned nOldest = nIn > TRACE_RING_SIZE ? nIn - TRACE_RING_SIZE : 0;
+		unsigned long long nTimestamp =
+			s_Rings[nCore].Records[nOldest & (TRACE_RING_SIZE-1)].nTimestamp;
+		if (nTimestamp < m_nDumpBase)
+		{
+			m_nDumpBase = nTimestamp;
+		}
+	}
+
+	m_nDumpCore = 0;
+	m_nDumpEnd = s_Rings[0].nIn;
+	m_nDumpNext = m_nDumpEnd > TRACE_RING_SIZE ? m_nDumpEnd - TRACE_RING_SIZE : 0;
+}
+
+// One JSON line at a time. Each event ends with a comma, the metadata
+// event at the end closes the array.
+boolean CEventTrace::FormatNext (void)
+{
+	if (m_bDumpHeader)
+	{
+		m_bDumpHeader = FALSE;
+		m_Line = "{\"traceEvents\":[\n";
+
+		return TRUE;
+	}
+
+	while (m_nDumpNext == m_nDumpEnd)
+	{
+		if (++m_nDumpCore >= TRACE_MAX_CORES)
+		{
+			if (!m_bDumpFooter)
+			{
+				return FALSE;
+			}
+
+			m_bDumpFooter = FALSE;
+			m_Line = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+				 "\"args\":{\"name\":\"BarePD\"}}]}\n";
+
+			return TRUE;
+		}
+
+		m_nDumpEnd = s_Rings[m_nDumpCore].nIn;
+		m_nDumpNext = m_nDumpEnd > TRACE_RING_SIZE ? m_nDumpEnd - TRACE_RING_SIZE : 0;
+	}
+
+	const TTraceRecord *pRecord =
+		&s_Rings[m_nDumpCore].Records[m_nDumpNext++ & (TRACE_RING_SIZE-1)];
+
+	// In microseconds with three decimals, as Chrome trace wants them
+	unsigned nFrequency = pd_clock_frequency ();
+	unsigned long long nMicro = (pRecord->nTimestamp - m_nDumpBase) * 1000000ULL;
+	unsigned nMicroseconds = (unsigned) (nMicro / nFrequency);
+	unsigned nNanoseconds = (unsigned) (nMicro % nFrequency * 1000 / nFrequency);
+
+	m_Line.Format ("{\"name\":\"%s\",\"ph\":\"%c\"%s,\"ts\":%u.%03u,\"pid\":1,\"tid\":%u,"
+		       "\"args\":{\"arg\":%u}},\n",
+		       GetEventName ((TTraceEvent) pRecord->ucEvent), pRecord->chPhase,
+		       pRecord->chPhase == 'i' ? ",\"s\":\"t\"" : "",
+		       nMicroseconds, nNanoseconds, m_nDumpCore, pRecord->nArg);
+
+	m_nDumpedEvents++;
+
+	return TRUE;
+}
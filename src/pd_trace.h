@@ -0,0 +1,157 @@
+//
+// pd_trace.h
+//
+// BarePD - Event trace buffer
+// Records timestamped events (DSP ticks, MIDI and FUDI input, USB plug
+// and play, SD card access, log messages, underruns) into a ring buffer
+// per core, to see what the CPU was doing around a glitch. Recording
+// only reserves a slot in the ring of the calling core and fills it in,
+// so it may be done from anywhere, at interrupt level too.
+//
+// The last events are written to the serial port in the Chrome trace
+// format, to be opened with Perfetto (ui.perfetto.dev) or
+// chrome://tracing: on a bang to [s barepd-trace], and shortly after an
+// audio underrun if enabled. [s barepd-trace] 0 stops recording, 1
+// starts it again. Recording is stopped while the dump is written.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_trace_h
+#define _pd_trace_h
+
+#include <circle/serial.h>
+#include <circle/sysconfig.h>
+#include <circle/memorymap.h>
+#include <circle/string.h>
+#include <circle/types.h>
+
+#define TRACE_RECEIVER		"barepd-trace"
+
+#define TRACE_RING_SIZE		4096	// events per core, power of 2
+#ifdef ARM_ALLOW_MULTI_CORE
+#define TRACE_MAX_CORES		CORES
+#else
+#define TRACE_MAX_CORES		1
+#endif
+#define TRACE_DUMP_DELAY_MS	100	// events recorded after an underrun
+
+enum TTraceEvent
+{
+	TraceDSPTick,		// libpd_process_float(), arg: frames
+	TraceUnderrun,		// the audio queue ran dry, arg: queue frames
+	TraceSilence,		// overload silence inserted, arg: frames rendered
+	TraceMIDIReceive,	// MIDI packet or byte at interrupt level, arg: port
+	TraceMIDIFlush,		// MIDI ingress handed to libpd, arg: events
+	TraceFudiReceive,	// FUDI bytes parsed, arg: bytes
+	TraceUSBPlugAndPlay,	// USB MIDI devices updated
+	TraceSDOpen,		// file opened on the SD card, arg: size
+	TraceSDRead,		// file read from the SD card, arg: bytes
+	TraceLog,		// message written to the log
+	TraceEventUnknown
+};
+
+struct TTraceRecord
+{
+	unsigned long long	nTimestamp;	// pd_clock ticks
+	unsigned		nArg;
+	u8			ucEvent;	// TTraceEvent
+	char			chPhase;	// 'B'egin, 'E'nd or 'i'nstant
+};
+
+class CEventTrace
+{
+public:
+	CEventTrace (void);
+	~CEventTrace (void);
+
+	// Start recording (after libpd_init()). Dump to pSerial, automatically
+	// after an underrun if bDumpOnUnderrun.
+	boolean Initialize (CSerialDevice *pSerial, boolean bDumpOnUnderrun);
+
+	// From the main loop: write the dump, a line at a time as the
+	// serial port takes it
+	void Update (void);
+
+	// From the Pd bang and float hooks
+	void RequestDump (void);
+	void SetRecording (boolean bRecording);
+
+	// Other output to the serial port must wait while dumping
+	boolean IsDumping (void) const		{ return m_bDumping; }
+
+	// Record an event (may be called at interrupt level)
+	static void Begin (TTraceEvent Event, unsigned nArg = 0)
+	{
+		if (s_bRecording)
+		{
+			Record (Event, 'B', nArg);
+		}
+	}
+
+	static void End (TTraceEvent Event, unsigned nArg = 0)
+	{
+		if (s_bRecording)
+		{
+			Record (Event, 'E', nArg);
+		}
+	}
+
+	static void Instant (TTraceEvent Event, unsigned nArg = 0)
+	{
+		if (s_bRecording)
+		{
+			Record (Event, 'i', nArg);
+		}
+	}
+
+	// Record Begin at nStart (pd_clock ticks) and End now, for work that
+	// is only worth recording once it is known to have been done
+	static void Span (TTraceEvent Event, unsigned long long nStart, unsigned nArg = 0);
+
+	// Record an underrun, and dump the trace a little later if enabled
+	static void Underrun (TTraceEvent Event, unsigned nArg);
+
+	static const char *GetEventName (TTraceEvent Event);
+
+private:
+	static void Record (TTraceEvent Event, char chPhase, unsigned nArg);
+	static void Record (TTraceEvent Event, char chPhase, unsigned nArg,
+			    unsigned long long nTimestamp);
+	static void LogEventHandler (void);
+
+	void StartDump (void);
+	boolean FormatNext (void);	// into m_Line, FALSE when done
+
+private:
+	CSerialDevice	*m_pSerial;
+	void		*m_pReceiver;		// bound to TRACE_RECEIVER
+
+	boolean		 m_bDumpRequested;
+	boolean		 m_bDumping;
+	boolean		 m_bResume;		// recording after the dump
+	unsigned	 m_nDumpCore;
+	unsigned	 m_nDumpNext;		// index into the ring of m_nDumpCore
+	unsigned	 m_nDumpEnd;
+	unsigned long long m_nDumpBase;		// timestamp of the oldest event
+	boolean		 m_bDumpHeader;
+	boolean		 m_bDumpFooter;
+	CString		 m_Line;		// not yet written
+	unsigned	 m_nDumpedEvents;
+
+	struct TTraceRing
+	{
+		TTraceRecord		Records[TRACE_RING_SIZE];
+		volatile unsigned	nIn;
+	};
+
+	static TTraceRing s_Rings[TRACE_MAX_CORES];
+
+	static volatile boolean s_bRecording;
+	static boolean s_bDumpOnUnderrun;
+	static volatile boolean s_bUnderrun;	// dump pending after an underrun
+	static unsigned long long s_nUnderrunTime;
+};
+
+#endif
@@ -0,0 +1,392 @@
+//
+// pd_voice.cpp
+//
+// BarePD - Polyphonic voice allocator implementation
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_voice.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+extern "C" {
+#include "z_libpd.h"
+#include "g_canvas.h"
+}
+
+static const char FromVoice[] = "voice";
+
+CVoiceAllocator::CVoiceAllocator (void)
+:	m_pClone (nullptr),
+	m_nVoices (0),
+	m_nStartVoice (0),
+	m_nReleaseTicks (0),
+	m_nShedTicks (0),
+	m_nSerial (0),
+	m_nActive (0),
+	m_pDoneReceiver (nullptr)
+{
+	memset (m_Voices, 0, sizeof m_Voices);
+	memset (m_bSustain, 0, sizeof m_bSustain);
+}
+
+CVoiceAllocator::~CVoiceAllocator (void)
+{
+	if (m_pDoneReceiver != nullptr)
+	{
+		libpd_unbind (m_pDoneReceiver);
+	}
+}
+
+boolean CVoiceAllocator::Attach (const char *pAbstraction, unsigned nReleaseMs)
+{
+	sys_lock ();
+
+	t_pd *pClone = clone_find (gensym (pAbstraction));
+	if (   pClone == nullptr
+	    || clone_get_n ((t_gobj *) pClone) == 0)
+	{
+		sys_unlock ();
+
+		CLogger::Get ()->Write (FromVoice, LogWarning,
+					"No [clone %s] in patch, voice allocation disabled", pAbstraction);
+		return FALSE;
+	}
+
+	m_nVoices = clone_get_n ((t_gobj *) pClone);
+	if (m_nVoices > VOICE_MAX_VOICES)
+	{
+		m_nVoices = VOICE_MAX_VOICES;
+	}
+	m_nStartVoice = clone_get_startvoice (pClone);
+
+	// All voices start idle and asleep
+	clone_setsleepable (pClone, 1);
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		m_Voices[i].State = VoiceIdle;
+		clone_voice_sleep (pClone, i, 1);
+	}
+
+	m_pClone = pClone;
+
+	sys_unlock ();
+
+	m_nReleaseTicks = nReleaseMs * (CLOCKHZ / 1000);
+
+	m_pDoneReceiver = libpd_bind (VOICE_DONE_RECEIVER);
+
+	CLogger::Get ()->Write (FromVoice, LogNotice, "Allocating %u voices of [clone %s], release %u ms",
+				m_nVoices, pAbstraction, nReleaseMs);
+
+	return TRUE;
+}
+
+void CVoiceAllocator::NoteOn (u8 ucChannel, u8 ucNote, u8 ucVelocity)
+{
+	if (m_pClone == nullptr)
+	{
+		return;
+	}
+
+	if (ucVelocity == 0)
+	{
+		NoteOff (ucChannel, ucNote);
+
+		return;
+	}
+
+	sys_lock ();
+
+	// A repeated note retriggers the voice already playing it
+	unsigned nVoice;
+	for (nVoice = 0; nVoice < m_nVoices; nVoice++)
+	{
+		if (   m_Voices[nVoice].State != VoiceIdle
+		    && m_Voices[nVoice].ucChannel == ucChannel
+		    && m_Voices[nVoice].ucNote == ucNote)
+		{
+			break;
+		}
+	}
+
+	if (nVoice == m_nVoices)
+	{
+		nVoice = Allocate ();
+
+		TVoice *pVoice = &m_Voices[nVoice];
+		if (pVoice->State == VoiceIdle)
+		{
+			m_nActive++;
+		}
+		else if (   pVoice->State != VoiceReleased
+			 && pVoice->State != VoiceShed)
+		{
+			// Stolen while sounding: end the old note first
+			SendNote (nVoice, pVoice->ucNote, 0);
+		}
+	}
+
+	TVoice *pVoice = &m_Voices[nVoice];
+	pVoice->State = VoiceHeld;
+	pVoice->ucChannel = ucChannel;
+	pVoice->ucNote = ucNote;
+	pVoice->nSerial = ++m_nSerial;
+
+	SendNote (nVoice, ucNote, ucVelocity);
+
+	sys_unlock ();
+}
+
+void CVoiceAllocator::NoteOff (u8 ucChannel, u8 ucNote)
+{
+	if (m_pClone == nullptr)
+	{
+		return;
+	}
+
+	sys_lock ();
+
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		TVoice *pVoice = &m_Voices[i];
+		if (   pVoice->State == VoiceHeld
+		    && pVoice->ucChannel == ucChannel
+		    && pVoice->ucNote == ucNote)
+		{
+			if (m_bSustain[ucChannel & 0x0F])
+			{
+				pVoice->State = VoiceSustained;
+			}
+			else
+			{
+				Release (i);
+			}
+		}
+	}
+
+	sys_unlock ();
+}
+
+void CVoiceAllocator::Sustain (u8 ucChannel, boolean bOn)
+{
+	ucChannel &= 0x0F;
+	m_bSustain[ucChannel] = bOn;
+
+	if (m_pClone == nullptr || bOn)
+	{
+		return;
+	}
+
+	sys_lock ();
+
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		if (   m_Voices[i].State == VoiceSustained
+		    && m_Voices[i].ucChannel == ucChannel)
+		{
+			Release (i);
+		}
+	}
+
+	sys_unlock ();
+}
+
+void CVoiceAllocator::AllNotesOff (u8 ucChannel)
+{
+	ucChannel &= 0x0F;
+	m_bSustain[ucChannel] = FALSE;
+
+	if (m_pClone == nullptr)
+	{
+		return;
+	}
+
+	sys_lock ();
+
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		if (   (   m_Voices[i].State == VoiceHeld
+			|| m_Voices[i].State == VoiceSustained)
+		    && m_Voices[i].ucChannel == ucChannel)
+		{
+			Release (i);
+		}
+	}
+
+	sys_unlock ();
+}
+
+void CVoiceAllocator::VoiceDone (int nVoiceNumber)
+{
+	int nVoice = nVoiceNumber - m_nStartVoice;
+	if (   m_pClone == nullptr
+	    || nVoice < 0
+	    || nVoice >= (int) m_nVoices)
+	{
+		return;
+	}
+
+	// Only a released voice may go to sleep; a voice that has
+	// been retriggered in the meantime keeps running.
+	if (   m_Voices[nVoice].State == VoiceReleased
+	    || m_Voices[nVoice].State == VoiceShed)
+	{
+		Sleep (nVoice);
+	}
+}
+
+void CVoiceAllocator::Update (void)
+{
+	if (m_pClone == nullptr)
+	{
+		return;
+	}
+
+	unsigned nTicks = CTimer::GetClockTicks ();
+
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		TVoiceState State = m_Voices[i].State;
+		if (   (   State == VoiceReleased
+			&& m_nReleaseTicks != 0
+			&& nTicks - m_Voices[i].nReleaseTicks >= m_nReleaseTicks)
+		    || (   State == VoiceShed
+			&& nTicks - m_Voices[i].nReleaseTicks >= m_nShedTicks))
+		{
+			sys_lock ();
+
+			// Check again, MIDI input may have retriggered the voice
+			if (m_Voices[i].State == State)
+			{
+				Sleep (i);
+			}
+
+			sys_unlock ();
+		}
+	}
+}
+
+boolean CVoiceAllocator::Shed (unsigned nFadeMs)
+{
+	if (m_pClone == nullptr)
+	{
+		return FALSE;
+	}
+
+	sys_lock ();
+
+	// Releasing voices are the least missed, then the oldest notes
+	unsigned nVoice = m_nVoices;
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		const TVoice *pVoice = &m_Voices[i];
+		if (   pVoice->State == VoiceIdle
+		    || pVoice->State == VoiceShed)
+		{
+			continue;
+		}
+
+		if (nVoice == m_nVoices)
+		{
+			nVoice = i;
+			continue;
+		}
+
+		const TVoice *pOldest = &m_Voices[nVoice];
+		boolean bReleased = pVoice->State == VoiceReleased;
+		boolean bOldestReleased = pOldest->State == VoiceReleased;
+		if (   (bReleased && !bOldestReleased)
+		    || (   bReleased == bOldestReleased
+			&& (int) (pVoice->nSerial - pOldest->nSerial) < 0))
+		{
+			nVoice = i;
+		}
+	}
+
+	if (nVoice < m_nVoices)
+	{
+		TVoice *pVoice = &m_Voices[nVoice];
+		if (pVoice->State != VoiceReleased)
+		{
+			SendNote (nVoice, pVoice->ucNote, 0);
+		}
+
+		pVoice->State = VoiceShed;
+		pVoice->nReleaseTicks = CTimer::GetClockTicks ();
+		m_nShedTicks = nFadeMs * (CLOCKHZ / 1000);
+	}
+
+	sys_unlock ();
+
+	return nVoice < m_nVoices;
+}
+
+// Pick a voice for a new note: a free one if there is any, else steal the
+// oldest releasing voice, else the oldest held or sustained one.
+unsigned CVoiceAllocator::Allocate (void)
+{
+	unsigned nOldestReleased = m_nVoices;
+	unsigned nOldestSounding = m_nVoices;
+
+	for (unsigned i = 0; i < m_nVoices; i++)
+	{
+		const TVoice *pVoice = &m_Voices[i];
+
+		switch (pVoice->State)
+		{
+		case VoiceIdle:
+			return i;
+
+		case VoiceReleased:
+		case VoiceShed:
+			if (   nOldestReleased == m_nVoices
+			    || (int) (pVoice->nSerial - m_Voices[nOldestReleased].nSerial) < 0)
+			{
+				nOldestReleased = i;
+			}
+			break;
+
+		default:
+			if (   nOldestSounding == m_nVoices
+			    || (int) (pVoice->nSerial - m_Voices[nOldestSounding].nSerial) < 0)
+			{
+				nOldestSounding = i;
+			}
+			break;
+		}
+	}
+
+	return nOldestReleased < m_nVoices ? nOldestReleased : nOldestSounding;
+}
+
+void CVoiceAllocator::Release (unsigned nVoice)
+{
+	TVoice *pVoice = &m_Voices[nVoice];
+
+	pVoice->State = VoiceReleased;
+	pVoice->nReleaseTicks = CTimer::GetClockTicks ();
+
+	SendNote (nVoice, pVoice->ucNote, 0);
+}
+
+void CVoiceAllocator::Sleep (unsigned nVoice)
+{
+	m_Voices[nVoice].State = VoiceIdle;
+	clone_voice_sleep ((t_pd *) m_pClone, nVoice, 1);
+
+	assert (m_nActive > 0);
+	m_nActive--;
+}
+
+void CVoiceAllocator::SendNote (unsigned nVoice, u8 ucNote, u8 ucVelocity)
+{
+	t_atom Atoms[2];
+	SETFLOAT (&Atoms[0], ucNote);
+	SETFLOAT (&Atoms[1], ucVelocity);
+
+	clone_voice_send ((t_pd *) m_pClone, nVoice, 0, 2, Atoms);
+}
@@ -0,0 +1,98 @@
+//
+// pd_voice.h
+//
+// BarePD - Polyphonic voice allocator
+// Feeds MIDI notes straight into the instances of a [clone] and takes
+// idle instances out of the DSP chain, so CPU load follows the number
+// of sounding voices instead of the size of the clone.
+//
+// The voice abstraction receives "note velocity" lists on its first
+// inlet, exactly as from [poly] -> [clone]. It may report the end of
+// its release phase with [s barepd-voice-done] (sending its voice
+// number $1); otherwise the voice is put to sleep after a timeout.
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _pd_voice_h
+#define _pd_voice_h
+
+#include <circle/types.h>
+
+#define VOICE_MAX_VOICES        64
+#define VOICE_DONE_RECEIVER     "barepd-voice-done"
+#define VOICE_DEFAULT_RELEASE_MS 2000
+
+#define MIDI_CC_SUSTAIN         64
+#define MIDI_CC_ALL_NOTES_OFF   123
+
+enum TVoiceState
+{
+	VoiceIdle,		// asleep, available
+	VoiceHeld,		// key down
+	VoiceSustained,		// key up, held by the sustain pedal
+	VoiceReleased,		// note-off sent, release phase running
+	VoiceShed		// note-off sent on overload, sleeps after a short fade
+};
+
+struct TVoice
+{
+	TVoiceState	State;
+	u8		ucChannel;
+	u8		ucNote;
+	unsigned	nSerial;	// allocation order, for oldest-first stealing
+	unsigned	nReleaseTicks;	// CTimer clock ticks at note-off (or at shedding)
+};
+
+class CVoiceAllocator
+{
+public:
+	CVoiceAllocator (void);
+	~CVoiceAllocator (void);
+
+	// Locate the [clone] of pAbstraction in the loaded patch
+	boolean Attach (const char *pAbstraction, unsigned nReleaseMs);
+	boolean IsAttached (void) const		{ return m_pClone != nullptr; }
+
+	// MIDI input (takes the Pd lock)
+	void NoteOn (u8 ucChannel, u8 ucNote, u8 ucVelocity);
+	void NoteOff (u8 ucChannel, u8 ucNote);
+	void Sustain (u8 ucChannel, boolean bOn);
+	void AllNotesOff (u8 ucChannel);
+
+	// From the Pd float hook (Pd lock already held)
+	void VoiceDone (int nVoiceNumber);
+
+	// From the main loop: sleep voices whose release timed out
+	void Update (void);
+
+	// On overload: end the oldest sounding voice and sleep it after
+	// nFadeMs, releasing voices first. FALSE if no voice was left.
+	boolean Shed (unsigned nFadeMs);
+
+	unsigned GetActiveVoices (void) const	{ return m_nActive; }
+
+private:
+	unsigned Allocate (void);
+	void Release (unsigned nVoice);
+	void Sleep (unsigned nVoice);
+	void SendNote (unsigned nVoice, u8 ucNote, u8 ucVelocity);
+
+private:
+	void		*m_pClone;		// t_clone *
+	unsigned	 m_nVoices;
+	int		 m_nStartVoice;		// clone's first voice number ($1)
+	unsigned	 m_nReleaseTicks;
+	unsigned	 m_nShedTicks;
+
+	TVoice		 m_Voices[VOICE_MAX_VOICES];
+	unsigned	 m_nSerial;
+	unsigned	 m_nActive;
+
+	boolean		 m_bSustain[16];
+
+	void		*m_pDoneReceiver;
+};
+
+#endif
@@ -7,6 +7,10 @@
 // Licensed under GPLv3
 //
 #include "pdsounddevice.h"
+#include "pd_governor.h"
+#include "pd_pmu.h"
+#include "pd_record.h"
+#include "pd_trace.h"
 #include <circle/logger.h>
 #include <circle/util.h>
 #include <circle/sched/scheduler.h>
@@ -14,6 +18,7 @@
 
 extern "C" {
 #include "z_libpd.h"
+#include "pd_clock.h"
 }
 
 static const char FromPdSound[] = "pdsound";
@@ -92,8 +97,15 @@ unsigned CPdSoundPWM::GetChunk (u32 *pBuffer, unsigned nChunkSize)
 		memset(m_pInBuffer, 0, nProcessFrames * m_nInChannels * sizeof(float));
 	}
 	
-	// Process audio through libpd
+	// Process audio through libpd, timed for the CPU governor
+	CInputRecorder::BeginDSP(nTicks, m_pInBuffer, m_nInChannels);
+	CEventTrace::Begin(TraceDSPTick, nProcessFrames);
+	CPerfMonitor::BeginDSP();
+	unsigned long long nStart = pd_clock_ticks();
 	libpd_process_float(nTicks, m_pInBuffer, m_pOutBuffer);
+	CCPUGovernor::AddDSPTime((unsigned)(pd_clock_ticks() - nStart), nProcessFrames);
+	CPerfMonitor::EndDSP(nTicks);
+	CEventTrace::End(TraceDSPTick, nProcessFrames);
 	
 	// Convert to u32 for PWM (range is GetRangeMin() to GetRangeMax())
 	int nRangeMin = GetRangeMin();
@@ -151,11 +163,13 @@ unsigned CPdSoundPWM::GetChunk (u32 *pBuffer, unsigned nChunkSize)
 // - Smaller queue = lower latency but risk of underruns
 // - Smaller chunks = more responsive but more CPU overhead
 // At 48kHz: 1ms = 48 samples, 10ms = 480 samples
-#define I2S_CHUNK_SIZE     256         // ~5ms chunks for low latency
+// The DMA period follows Pd's block size (PD_BLOCKSIZE in the Makefile),
+// e.g. 128 frames (2.7ms) for 64-sample blocks, 32 frames for 16.
+#define I2S_CHUNK_BLOCKS   2           // Pd blocks per DMA period
 #define I2S_QUEUE_SIZE_MS  50          // 50ms buffer (was 500ms)
 
 CPdSoundI2S::CPdSoundI2S (CInterruptSystem *pInterrupt, CI2CMaster *pI2CMaster, 
-                          unsigned nSampleRate)
+                          unsigned nSampleRate, unsigned nQueueFrames)
 :	m_pDevice (nullptr),
 	m_pInterrupt (pInterrupt),
 	m_pI2CMaster (pI2CMaster),
@@ -165,7 +179,14 @@ CPdSoundI2S::CPdSoundI2S (CInterruptSystem *pInterrupt, CI2CMaster *pI2CMaster,
 	m_nInChannels (0),
 	m_nOutChannels (2),
 	m_nSampleRate (nSampleRate),
-	m_nChunkSize (I2S_CHUNK_SIZE)
+	m_nChunkSize (I2S_CHUNK_BLOCKS * libpd_blocksize() * 2),
+	m_nQueueFrames (nQueueFrames),
+	m_nTicksPerFrame ((unsigned)(((unsigned long long) pd_clock_frequency() << 8) / nSampleRate)),
+	m_nPeakLoad (0),
+	m_nLastLoad (0),
+	m_nSilences (0),
+	m_bOverloadSilence (FALSE),
+	m_bFadeIn (FALSE)
 {
 }
 
@@ -194,7 +215,10 @@ boolean CPdSoundI2S::Initialize (void)
 	CLogger::Get()->Write(FromPdSound, LogNotice, "I2S: Allocating queue...");
 	
 	// Use queue-based API like Circle's sample
-	if (!m_pDevice->AllocateQueue(I2S_QUEUE_SIZE_MS))
+	boolean bQueueOK = m_nQueueFrames > 0
+			 ? m_pDevice->AllocateQueueFrames(m_nQueueFrames)
+			 : m_pDevice->AllocateQueue(I2S_QUEUE_SIZE_MS);
+	if (!bQueueOK)
 	{
 		CLogger::Get()->Write(FromPdSound, LogError, "I2S: Failed to allocate queue");
 		return FALSE;
@@ -224,6 +248,9 @@ boolean CPdSoundI2S::Initialize (void)
 	
 	CLogger::Get()->Write(FromPdSound, LogNotice, 
 		"I2S audio (PCM5102A): %u Hz, %u channels", m_nSampleRate, m_nOutChannels);
+	CLogger::Get()->Write(FromPdSound, LogNotice,
+		"I2S: Pd block %u, DMA period %u frames, queue %u frames",
+		libpd_blocksize(), m_nChunkSize / 2, m_pDevice->GetQueueSizeFrames());
 	
 	return TRUE;
 }
@@ -259,22 +286,62 @@ boolean CPdSoundI2S::IsActive (void) const
 
 void CPdSoundI2S::FillQueue (unsigned nFrames)
 {
-	unsigned nFramesPerWrite = 256;  // Match chunk size for efficiency
+	unsigned nFramesPerWrite = m_nChunkSize / 2;  // Match chunk size for efficiency
+	unsigned nBlockSize = libpd_blocksize();
+	
+	// Only whole Pd blocks can be rendered; the rest is written next time
+	nFrames -= nFrames % nBlockSize;
 	
 	while (nFrames > 0)
 	{
 		unsigned nWriteFrames = nFrames < nFramesPerWrite ? nFrames : nFramesPerWrite;
 		unsigned nSamples = nWriteFrames * m_nOutChannels;
 		
-		// Process audio through libpd
-		unsigned nBlockSize = libpd_blocksize();
+		// The queue has to last until this chunk is written: the frames
+		// rendering it takes at the last chunk's load, and a Pd block to
+		// spare. If it won't, fade out and let the CPU catch up in
+		// silence, rather than run dry in the middle of a waveform. The
+		// margin is kept below half the queue, so that a short queue
+		// doesn't stay silent.
+		boolean bSilence = FALSE;
+		if (m_bOverloadSilence && m_pDevice->IsActive())
+		{
+			unsigned nMargin = (unsigned)(((unsigned long long) nWriteFrames * m_nLastLoad)
+			                              / 100) + nBlockSize;
+			unsigned nMaxMargin = m_pDevice->GetQueueSizeFrames() / 2;
+			if (nMargin > nMaxMargin)
+				nMargin = nMaxMargin;
+			bSilence = m_pDevice->GetQueueFramesAvail() < nMargin;
+		}
+		
+		// Process audio through libpd, timed for the CPU governor
+		// and the overload guard, counted by the PMU
 		unsigned nTicks = nWriteFrames / nBlockSize;
-		if (nTicks == 0) nTicks = 1;
 		
 		if (m_pInBuffer && m_nInChannels > 0)
 			memset(m_pInBuffer, 0, nWriteFrames * m_nInChannels * sizeof(float));
 		
+		CInputRecorder::BeginDSP(nTicks, m_pInBuffer, m_nInChannels);
+		CEventTrace::Begin(TraceDSPTick, nWriteFrames);
+		CPerfMonitor::BeginDSP();
+		unsigned long long nStart = pd_clock_ticks();
 		libpd_process_float(nTicks, m_pInBuffer, m_pOutBuffer);
+		unsigned nDSPTicks = (unsigned)(pd_clock_ticks() - nStart);
+		CPerfMonitor::EndDSP(nTicks);
+		CEventTrace::End(TraceDSPTick, nWriteFrames);
+		CCPUGovernor::AddDSPTime(nDSPTicks, nWriteFrames);
+		
+		unsigned nLoad = (unsigned)(((unsigned long long) nDSPTicks * 100 << 8)
+		                            / ((unsigned long long) nWriteFrames * m_nTicksPerFrame));
+		if (nLoad > m_nPeakLoad)
+			m_nPeakLoad = nLoad;
+		m_nLastLoad = nLoad;
+		
+		if (bSilence)
+			Fade(nWriteFrames, FALSE);
+		else if (m_bFadeIn)
+			Fade(nWriteFrames, TRUE);
+		m_bFadeIn = bSilence;
 		
 		// Convert float samples to 16-bit signed
 		for (unsigned i = 0; i < nSamples; i++)
@@ -290,13 +357,68 @@ void CPdSoundI2S::FillQueue (unsigned nFrames)
 		unsigned nBytes = nSamples * sizeof(s16);
 		m_pDevice->Write(m_pWriteBuffer, nBytes);
 		
+		if (bSilence)
+		{
+			CEventTrace::Underrun(TraceSilence, nWriteFrames);
+			WriteSilence();
+			m_nSilences++;
+			return;
+		}
+		
 		nFrames -= nWriteFrames;
+	}
+}
+
+// Ramp the rendered chunk from silence (bIn) or down to silence
+void CPdSoundI2S::Fade (unsigned nFrames, boolean bIn)
+{
+	float fStep = 1.0f / nFrames;
+	float fGain = bIn ? 0.0f : 1.0f;
+	if (!bIn)
+		fStep = -fStep;
+	
+	float *pSample = m_pOutBuffer;
+	for (unsigned i = 0; i < nFrames; i++)
+	{
+		fGain += fStep;
+		for (unsigned j = 0; j < m_nOutChannels; j++)
+			*pSample++ *= fGain;
+	}
+}
+
+// Fill the free space in the queue with silence, without running Pd
+void CPdSoundI2S::WriteSilence (void)
+{
+	unsigned nFramesPerWrite = m_nChunkSize / 2;
+	unsigned nFrames = m_pDevice->GetQueueSizeFrames() - m_pDevice->GetQueueFramesAvail();
+	
+	memset(m_pWriteBuffer, 0, nFramesPerWrite * m_nOutChannels * sizeof(s16));
+	
+	while (nFrames > 0)
+	{
+		unsigned nWriteFrames = nFrames < nFramesPerWrite ? nFrames : nFramesPerWrite;
+		m_pDevice->Write(m_pWriteBuffer, nWriteFrames * m_nOutChannels * sizeof(s16));
 		
-		// Yield to allow other tasks to run
-		CScheduler::Get()->Yield();
+		nFrames -= nWriteFrames;
 	}
 }
 
+unsigned CPdSoundI2S::ReadPeakLoad (void)
+{
+	unsigned nLoad = m_nPeakLoad;
+	m_nPeakLoad = 0;
+	
+	return nLoad;
+}
+
+unsigned CPdSoundI2S::ReadSilences (void)
+{
+	unsigned nSilences = m_nSilences;
+	m_nSilences = 0;
+	
+	return nSilences;
+}
+
 void CPdSoundI2S::Process (void)
 {
 	if (!m_pDevice || !m_pDevice->IsActive())
@@ -307,6 +429,12 @@ void CPdSoundI2S::Process (void)
 	unsigned nAvailFrames = m_pDevice->GetQueueFramesAvail();
 	unsigned nFreeFrames = nQueueFrames - nAvailFrames;
 	
+	// The queue is filled before the start, empty means it ran dry
+	if (nAvailFrames == 0)
+	{
+		CEventTrace::Underrun(TraceUnderrun, nQueueFrames);
+	}
+	
 	if (nFreeFrames > 0)
 	{
 		FillQueue(nFreeFrames);
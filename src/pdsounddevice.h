@@ -67,7 +67,8 @@ class CPdSoundI2S
 public:
 	CPdSoundI2S (CInterruptSystem *pInterrupt,
 	             CI2CMaster *pI2CMaster,
-	             unsigned nSampleRate = DEFAULT_SAMPLE_RATE);
+	             unsigned nSampleRate = DEFAULT_SAMPLE_RATE,
+	             unsigned nQueueFrames = 0);	// 0 for the default queue length
 	~CPdSoundI2S (void);
 
 	boolean Initialize (void);
@@ -79,9 +80,19 @@ public:
 	
 	// Call this periodically from main loop to feed audio
 	void Process (void);
+	
+	// Insert silence with a short fade when the queue is about to run dry
+	void SetOverloadSilence (boolean bEnable) { m_bOverloadSilence = bEnable; }
+	
+	// Highest DSP load of a DMA period in percent, and the number of
+	// silences inserted, since the last call
+	unsigned ReadPeakLoad (void);
+	unsigned ReadSilences (void);
 
 private:
 	void FillQueue (unsigned nFrames);
+	void Fade (unsigned nFrames, boolean bIn);
+	void WriteSilence (void);
 
 	CI2SSoundBaseDevice *m_pDevice;
 	CInterruptSystem *m_pInterrupt;
@@ -94,7 +105,15 @@ private:
 	unsigned m_nInChannels;
 	unsigned m_nOutChannels;
 	unsigned m_nSampleRate;
-	unsigned m_nChunkSize;
+	unsigned m_nChunkSize;		// DMA period in words (2 per frame)
+	unsigned m_nQueueFrames;
+	
+	unsigned m_nTicksPerFrame;	// pd_clock ticks, times 256
+	unsigned m_nPeakLoad;
+	unsigned m_nLastLoad;		// of the last chunk, in percent
+	unsigned m_nSilences;
+	boolean m_bOverloadSilence;
+	boolean m_bFadeIn;
 };
 
 //
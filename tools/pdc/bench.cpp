@@ -0,0 +1,142 @@
+//
+// bench.cpp
+//
+// BarePD - Compare a compiled DSP chain with libpd's on the host
+// Runs the patch twice from a fresh load, first with libpd's chain walk
+// and then with the code pdc generated for it, and reports the time per
+// DSP tick and the largest difference between the two outputs.
+//
+//   pdcbench patch.pd [ticks]
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_compiled.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+extern "C" {
+#include "z_libpd.h"
+#include "pd_conv.h"
+}
+
+#define CHANNELS	2
+#define ROUNDS		5
+
+static double Now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void Print (const char *pMessage)
+{
+	fputs (pMessage, stderr);
+}
+
+// Load the patch, run it for nTicks and return the time per tick in us
+static double Run (const char *pDir, const char *pFile, unsigned nTicks, float *pOut)
+{
+	float InBuffer[DEFDACBLKSIZE * CHANNELS] = {0};
+
+	void *pPatch = libpd_openfile (pFile, pDir);
+	if (pPatch == 0)
+	{
+		fprintf (stderr, "pdcbench: %s/%s: can't open\n", pDir, pFile);
+		exit (1);
+	}
+
+	libpd_start_message (1);
+	libpd_add_float (1);
+	libpd_finish_message ("pd", "dsp");
+
+	double fStart = Now ();
+	for (unsigned i = 0; i < nTicks; i++)
+	{
+		libpd_process_float (1, InBuffer, pOut + i * DEFDACBLKSIZE * CHANNELS);
+	}
+	double fTime = Now () - fStart;
+
+	libpd_start_message (1);
+	libpd_add_float (0);
+	libpd_finish_message ("pd", "dsp");
+	libpd_closefile (pPatch);
+
+	return fTime * 1e6 / nTicks;
+}
+
+int main (int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf (stderr, "usage: pdcbench patch.pd [ticks]\n");
+		return 1;
+	}
+	unsigned nTicks = argc > 2 ? atoi (argv[2]) : 10000;
+
+	char Dir[MAXPDSTRING] = ".";
+	const char *pFile = argv[1];
+	const char *pSlash = strrchr (argv[1], '/');
+	if (pSlash != 0)
+	{
+		snprintf (Dir, sizeof Dir, "%.*s", (int) (pSlash - argv[1]), argv[1]);
+		pFile = pSlash + 1;
+	}
+
+	libpd_set_printhook (Print);
+	libpd_init ();
+	conv_tilde_setup ();
+	libpd_init_audio (0, CHANNELS, 48000);
+
+	size_t nSamples = (size_t) nTicks * DEFDACBLKSIZE * CHANNELS;
+	float *pInterpreted = (float *) calloc (nSamples, sizeof (float));
+	float *pCompiled = (float *) calloc (nSamples, sizeof (float));
+
+	// Alternate the two and keep the best of a few rounds, so that neither
+	// gets the warm caches or the quiet machine to itself
+	double fInterpreted = 0, fCompiled = 0;
+	int bActive = 0;
+	for (unsigned nRound = 0; nRound < ROUNDS; nRound++)
+	{
+		double fTime = Run (Dir, pFile, nTicks, pInterpreted);
+		if (nRound == 0 || fTime < fInterpreted)
+		{
+			fInterpreted = fTime;
+		}
+
+		pd_compiled_enable (1);
+		fTime = Run (Dir, pFile, nTicks, pCompiled);
+		bActive = pd_compiled_active ();
+		pd_compiled_enable (0);
+		if (nRound == 0 || fTime < fCompiled)
+		{
+			fCompiled = fTime;
+		}
+	}
+
+	double fMaxDiff = 0;
+	for (size_t i = 0; i < nSamples; i++)
+	{
+		double fDiff = fabs (pInterpreted[i] - pCompiled[i]);
+		if (fDiff > fMaxDiff)
+		{
+			fMaxDiff = fDiff;
+		}
+	}
+
+	printf ("%s: %u ticks of %d samples\n", argv[1], nTicks, DEFDACBLKSIZE);
+	printf ("  libpd     %8.2f us/tick\n", fInterpreted);
+	printf ("  compiled  %8.2f us/tick%s\n", fCompiled, bActive ? "" : " (not bound, ran libpd)");
+	printf ("  speedup   %8.2fx, max difference %g\n", fInterpreted / fCompiled, fMaxDiff);
+
+	free (pInterpreted);
+	free (pCompiled);
+
+	return 0;
+}
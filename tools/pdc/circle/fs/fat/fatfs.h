@@ -0,0 +1,80 @@
+//
+// fatfs.h
+//
+// BarePD - Circle's FAT file system for host-side tools, on the files of
+// a directory
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _circle_fs_fat_fatfs_h
+#define _circle_fs_fat_fatfs_h
+
+#include <stdio.h>
+
+#define FS_ERROR	0xFFFFFFFF
+
+#define FAT_FILES	4
+
+class CFATFileSystem
+{
+public:
+	CFATFileSystem (const char *pDirectory = ".")
+	:	m_pDirectory (pDirectory)
+	{
+		for (unsigned i = 0; i < FAT_FILES; i++)
+		{
+			m_pFiles[i] = nullptr;
+		}
+	}
+
+	// Returns a file handle, 0 on error
+	unsigned FileOpen (const char *pTitle)		{ return Open (pTitle, "rb"); }
+	unsigned FileCreate (const char *pTitle)	{ return Open (pTitle, "wb"); }
+
+	unsigned FileClose (unsigned hFile)
+	{
+		int nResult = fclose (m_pFiles[hFile-1]);
+		m_pFiles[hFile-1] = nullptr;
+
+		return nResult == 0;
+	}
+
+	unsigned FileRead (unsigned hFile, void *pBuffer, unsigned nCount)
+	{
+		size_t nRead = fread (pBuffer, 1, nCount, m_pFiles[hFile-1]);
+
+		return nRead == 0 && ferror (m_pFiles[hFile-1]) ? FS_ERROR : (unsigned) nRead;
+	}
+
+	unsigned FileWrite (unsigned hFile, const void *pBuffer, unsigned nCount)
+	{
+		size_t nWritten = fwrite (pBuffer, 1, nCount, m_pFiles[hFile-1]);
+
+		return nWritten == nCount ? nCount : FS_ERROR;
+	}
+
+private:
+	unsigned Open (const char *pTitle, const char *pMode)
+	{
+		for (unsigned i = 0; i < FAT_FILES; i++)
+		{
+			if (m_pFiles[i] == nullptr)
+			{
+				char Path[1024];
+				snprintf (Path, sizeof Path, "%s/%s", m_pDirectory, pTitle);
+				m_pFiles[i] = fopen (Path, pMode);
+
+				return m_pFiles[i] != nullptr ? i + 1 : 0;
+			}
+		}
+
+		return 0;
+	}
+
+private:
+	const char	*m_pDirectory;
+	FILE		*m_pFiles[FAT_FILES];
+};
+
+#endif
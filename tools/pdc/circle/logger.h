@@ -0,0 +1,47 @@
+//
+// logger.h
+//
+// BarePD - Circle's logger for host-side tools, writes to stderr
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _circle_logger_h
+#define _circle_logger_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+enum TLogSeverity
+{
+	LogPanic,
+	LogError,
+	LogWarning,
+	LogNotice,
+	LogDebug
+};
+
+class CLogger
+{
+public:
+	static CLogger *Get (void)
+	{
+		static CLogger Logger;
+
+		return &Logger;
+	}
+
+	void Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+	{
+		va_list var;
+		va_start (var, pMessage);
+
+		fprintf (stderr, "%s: ", pSource);
+		vfprintf (stderr, pMessage, var);
+		fputc ('\n', stderr);
+
+		va_end (var);
+	}
+};
+
+#endif
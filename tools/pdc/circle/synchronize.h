@@ -0,0 +1,18 @@
+//
+// synchronize.h
+//
+// BarePD - Circle's synchronization for host-side tools, which have no
+// interrupts to hold off
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _circle_synchronize_h
+#define _circle_synchronize_h
+
+inline void EnterCritical (void)	{}
+inline void LeaveCritical (void)	{}
+
+#define DataMemBarrier()	__sync_synchronize ()
+
+#endif
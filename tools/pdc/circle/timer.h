@@ -0,0 +1,28 @@
+//
+// timer.h
+//
+// BarePD - Circle's timer for host-side tools, on the monotonic clock
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _circle_timer_h
+#define _circle_timer_h
+
+#include <time.h>
+
+#define CLOCKHZ	1000000
+
+class CTimer
+{
+public:
+	static unsigned GetClockTicks (void)
+	{
+		struct timespec Time;
+		clock_gettime (CLOCK_MONOTONIC, &Time);
+
+		return (unsigned) (Time.tv_sec * CLOCKHZ + Time.tv_nsec / 1000);
+	}
+};
+
+#endif
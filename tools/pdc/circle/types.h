@@ -0,0 +1,28 @@
+//
+// types.h
+//
+// BarePD - Circle's types for host-side tools
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _circle_types_h
+#define _circle_types_h
+
+#include <stddef.h>
+
+typedef unsigned char		u8;
+typedef unsigned short		u16;
+typedef unsigned int		u32;
+typedef unsigned long long	u64;
+
+typedef signed char		s8;
+typedef signed short		s16;
+typedef signed int		s32;
+typedef signed long long	s64;
+
+typedef bool		boolean;
+#define FALSE		false
+#define TRUE		true
+
+#endif
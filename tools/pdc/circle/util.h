@@ -0,0 +1,14 @@
+//
+// util.h
+//
+// BarePD - Circle's utility functions for host-side tools
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#ifndef _circle_util_h
+#define _circle_util_h
+
+#include <string.h>
+
+#endif
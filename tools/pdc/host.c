@@ -0,0 +1,37 @@
+/*
+ * host.c
+ *
+ * BarePD - what the kernel provides to libpd, for host-side tools
+ * Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+ *
+ * On the Pi these come from pd_fileio.cpp and pd_clock.cpp.
+ *
+ * Licensed under GPLv3
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+
+int barepd_open(const char *path, int oflag)
+{
+    return (open(path, oflag));
+}
+
+FILE *barepd_fopen(const char *filename, const char *mode)
+{
+    return (fopen(filename, mode));
+}
+
+double barepd_getrealtime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + 1e-9 * ts.tv_nsec);
+}
+
+    /* the rate of the clock above (CLOCKHZ in x_misc.c) */
+unsigned pd_clock_frequency(void)
+{
+    return (1000000000);
+}
@@ -0,0 +1,297 @@
+/*
+ * pdc.c
+ *
+ * BarePD - compile a patch's DSP chain to C++
+ * Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+ *
+ * Loads a patch with the same libpd sources as the kernel, turns DSP on
+ * and writes the resulting chain out as C++ for src/pd_compiled.h:
+ *
+ *   pdc [-c outchannels] [-i inchannels] [-r samplerate] [-s dspsleep]
+ *       [-v voices] [-o out.cpp] patch.pd
+ *
+ * Use the channel count, sample rate, dspsleep and voices settings the Pi
+ * runs with; if the kernel builds a different chain it falls back to libpd.
+ *
+ * Licensed under GPLv3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "z_libpd.h"
+#include "m_pd.h"
+#include "g_canvas.h"
+#include "pd_conv.h"
+
+    /* perform routines with fixed-size versions in pd_compiled.h; all are
+       global in Pd */
+t_int *minus_perform(t_int *w), *minus_perf8(t_int *w);
+t_int *times_perform(t_int *w), *times_perf8(t_int *w);
+t_int *max_perform(t_int *w), *max_perf8(t_int *w);
+t_int *min_perform(t_int *w), *min_perf8(t_int *w);
+t_int *scalarplus_perform(t_int *w), *scalarplus_perf8(t_int *w);
+t_int *scalarminus_perform(t_int *w), *scalarminus_perf8(t_int *w);
+t_int *reversescalarminus_perform(t_int *w);
+t_int *reversescalarminus_perf8(t_int *w);
+t_int *scalartimes_perform(t_int *w), *scalartimes_perf8(t_int *w);
+t_int *scalarmax_perform(t_int *w), *scalarmax_perf8(t_int *w);
+t_int *scalarmin_perform(t_int *w), *scalarmin_perf8(t_int *w);
+t_int *minus_perfblk(t_int *w), *times_perfblk(t_int *w);
+t_int *max_perfblk(t_int *w), *min_perfblk(t_int *w);
+t_int *scalarplus_perfblk(t_int *w), *scalarminus_perfblk(t_int *w);
+t_int *reversescalarminus_perfblk(t_int *w), *scalartimes_perfblk(t_int *w);
+t_int *scalarmax_perfblk(t_int *w), *scalarmin_perfblk(t_int *w);
+
+typedef struct _pdckernel
+{
+    t_perfroutine k_routine;
+    const char *k_name;
+    const char *k_code;     /* template, "%d" is the vector size */
+    int k_nargs;
+    int k_sizearg;
+} t_pdckernel;
+
+#define KERNEL(name, code, nargs) \
+    {name, #name, code, nargs, nargs}
+
+static const t_pdckernel pdc_kernels[] =
+{
+    KERNEL(plus_perform, "PDCVectorOp<TPDCAdd, %d>", 4),
+    KERNEL(plus_perf8, "PDCVectorOp<TPDCAdd, %d>", 4),
+    KERNEL(plus_perfblk, "PDCVectorOp<TPDCAdd, %d>", 4),
+    KERNEL(minus_perform, "PDCVectorOp<TPDCSub, %d>", 4),
+    KERNEL(minus_perf8, "PDCVectorOp<TPDCSub, %d>", 4),
+    KERNEL(minus_perfblk, "PDCVectorOp<TPDCSub, %d>", 4),
+    KERNEL(times_perform, "PDCVectorOp<TPDCMul, %d>", 4),
+    KERNEL(times_perf8, "PDCVectorOp<TPDCMul, %d>", 4),
+    KERNEL(times_perfblk, "PDCVectorOp<TPDCMul, %d>", 4),
+    KERNEL(max_perform, "PDCVectorOp<TPDCMax, %d>", 4),
+    KERNEL(max_perf8, "PDCVectorOp<TPDCMax, %d>", 4),
+    KERNEL(max_perfblk, "PDCVectorOp<TPDCMax, %d>", 4),
+    KERNEL(min_perform, "PDCVectorOp<TPDCMin, %d>", 4),
+    KERNEL(min_perf8, "PDCVectorOp<TPDCMin, %d>", 4),
+    KERNEL(min_perfblk, "PDCVectorOp<TPDCMin, %d>", 4),
+    KERNEL(scalarplus_perform, "PDCScalarOp<TPDCAdd, %d>", 4),
+    KERNEL(scalarplus_perf8, "PDCScalarOp<TPDCAdd, %d>", 4),
+    KERNEL(scalarplus_perfblk, "PDCScalarOp<TPDCAdd, %d>", 4),
+    KERNEL(scalarminus_perform, "PDCScalarOp<TPDCSub, %d>", 4),
+    KERNEL(scalarminus_perf8, "PDCScalarOp<TPDCSub, %d>", 4),
+    KERNEL(scalarminus_perfblk, "PDCScalarOp<TPDCSub, %d>", 4),
+    KERNEL(reversescalarminus_perform, "PDCScalarOp<TPDCReverseSub, %d>", 4),
+    KERNEL(reversescalarminus_perf8, "PDCScalarOp<TPDCReverseSub, %d>", 4),
+    KERNEL(reversescalarminus_perfblk, "PDCScalarOp<TPDCReverseSub, %d>", 4),
+    KERNEL(scalartimes_perform, "PDCScalarOp<TPDCMul, %d>", 4),
+    KERNEL(scalartimes_perf8, "PDCScalarOp<TPDCMul, %d>", 4),
+    KERNEL(scalartimes_perfblk, "PDCScalarOp<TPDCMul, %d>", 4),
+    KERNEL(scalarmax_perform, "PDCScalarOp<TPDCScalarMax, %d>", 4),
+    KERNEL(scalarmax_perf8, "PDCScalarOp<TPDCScalarMax, %d>", 4),
+    KERNEL(scalarmax_perfblk, "PDCScalarOp<TPDCScalarMax, %d>", 4),
+    KERNEL(scalarmin_perform, "PDCScalarOp<TPDCScalarMin, %d>", 4),
+    KERNEL(scalarmin_perf8, "PDCScalarOp<TPDCScalarMin, %d>", 4),
+    KERNEL(scalarmin_perfblk, "PDCScalarOp<TPDCScalarMin, %d>", 4),
+    KERNEL(zero_perform, "PDCZero<%d>", 2),
+    KERNEL(zero_perf8, "PDCZero<%d>", 2),
+    KERNEL(zero_perfblk, "PDCZero<%d>", 2),
+    KERNEL(copy_perform, "PDCCopy<%d>", 3),
+    KERNEL(copy_perf8, "PDCCopy<%d>", 3),
+    KERNEL(copy_perfblk, "PDCCopy<%d>", 3),
+    KERNEL(scalarcopy_perform, "PDCScalarCopy<%d>", 3),
+    KERNEL(scalarcopy_perf8, "PDCScalarCopy<%d>", 3),
+    KERNEL(scalarcopy_perfblk, "PDCScalarCopy<%d>", 3),
+};
+
+#define NKERNELS (sizeof(pdc_kernels) / sizeof(*pdc_kernels))
+
+static const t_pdckernel *pdc_findkernel(const t_int *w, int nargs)
+{
+    unsigned int i;
+    for (i = 0; i < NKERNELS; i++)
+        if ((t_perfroutine)w[0] == pdc_kernels[i].k_routine &&
+            nargs == pdc_kernels[i].k_nargs)
+                return (&pdc_kernels[i]);
+    return (0);
+}
+
+    /* class names as C string literals */
+static void pdc_putstring(FILE *fd, const char *s)
+{
+    putc('"', fd);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            putc('\\', fd);
+        putc(*s, fd);
+    }
+    putc('"', fd);
+}
+
+static void pdc_write(FILE *fd, const char *patch, int nchout, int nchin,
+    int sr, int sleepblocks, const char *voices)
+{
+    t_int *chain;
+    t_dspentry *map;
+    int n = dsp_getmap(&chain, &map), ncalls = 0, i;
+    const t_pdckernel **kernels =
+        (const t_pdckernel **)calloc(n + 1, sizeof(*kernels));
+
+    for (i = 0; i < n; i++)
+        if (!(kernels[i] = pdc_findkernel(chain + map[i].e_onset,
+            map[i].e_nargs)))
+                ncalls++;
+
+    fprintf(fd, "//\n// Generated by pdc from %s - do not edit\n", patch);
+    fprintf(fd, "// Block size %d, %d in / %d out channels, %d Hz, "
+        "dspsleep %d", DEFDACBLKSIZE, nchin, nchout, sr, sleepblocks);
+    if (voices)
+        fprintf(fd, ", voices %s", voices);
+    fprintf(fd, "\n//\n\n");
+    fprintf(fd, "#include \"pd_compiled.h\"\n\n");
+
+    fprintf(fd, "extern \"C\" {\n");
+    for (i = 0; i < (int)NKERNELS; i++)
+    {
+        int j;
+        for (j = 0; j < n; j++)
+            if (kernels[j] == &pdc_kernels[i])
+                break;
+        if (j < n)
+            fprintf(fd, "t_int *%s (t_int *w);\n", pdc_kernels[i].k_name);
+    }
+    fprintf(fd, "}\n\n");
+
+    fprintf(fd, "static const TCompiledEntry Entries[] =\n{\n");
+    for (i = 0; i < n; i++)
+    {
+        const t_pdckernel *k = kernels[i];
+        fprintf(fd, "\t{%s, ", (k ? k->k_name : "0"));
+        if (map[i].e_class)
+            pdc_putstring(fd, map[i].e_class->s_name);
+        else fprintf(fd, "0");
+        if (k)
+            fprintf(fd, ", %d, %d, %d},\n", map[i].e_nargs, k->k_sizearg,
+                (int)chain[map[i].e_onset + k->k_sizearg]);
+        else fprintf(fd, ", %d, 0, 0},\n", map[i].e_nargs);
+    }
+    if (!n)
+        fprintf(fd, "\t{0, 0, 0, 0, 0}\n");
+    fprintf(fd, "};\n\n");
+
+    fprintf(fd, "static t_int *s_pEntry[%d];\n\n", n + 1);
+    fprintf(fd, "static void Tick (void);\n\n");
+    fprintf(fd, "const TCompiledPatch CompiledPatch =\n{\n");
+    fprintf(fd, "\t");
+    pdc_putstring(fd, patch);
+    fprintf(fd, ", %d, %d, Entries, s_pEntry, Tick\n};\n\n", DEFDACBLKSIZE, n);
+
+        /* routines that may jump (block~, switch~) are all called */
+    fprintf(fd, "static void Tick (void)\n{\n");
+    if (ncalls)
+        fprintf(fd, "\tt_int *w;\n\tunsigned nEntry = 0;\n\n"
+            "resume:\n\tswitch (nEntry)\n\t{\n");
+    else fprintf(fd, "\tswitch (0)\n\t{\n");
+    for (i = 0; i < n; i++)
+    {
+        const t_pdckernel *k = kernels[i];
+        fprintf(fd, "\tcase %d:\t\t// %s\n", i,
+            (map[i].e_class ? map[i].e_class->s_name : "(Pd)"));
+        if (k)
+        {
+            fprintf(fd, "\t\t");
+            fprintf(fd, k->k_code,
+                (int)chain[map[i].e_onset + k->k_sizearg]);
+            fprintf(fd, " (PDC_ENTRY (%d));\n", i);
+        }
+        else fprintf(fd, "\t\tPDC_CALL (%d);\n", i);
+        fprintf(fd, "\t\t// fall through\n");
+    }
+    fprintf(fd, "\tdefault:\n\t\tbreak;\n\t}\n}\n");
+    free(kernels);
+}
+
+static void pdc_print(const char *s)
+{
+    fputs(s, stderr);
+}
+
+static void pdc_usage(void)
+{
+    fprintf(stderr, "usage: pdc [-c outchannels] [-i inchannels] "
+        "[-r samplerate] [-s dspsleep] [-v voices] [-o out.cpp] patch.pd\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int nchout = 2, nchin = 0, sr = 48000, sleepblocks = 0, ch;
+    const char *outfile = 0, *voices = 0, *slash;
+    char dir[MAXPDSTRING];
+    FILE *fd = stdout;
+
+    while ((ch = getopt(argc, argv, "c:i:r:s:v:o:")) != -1)
+    {
+        switch (ch)
+        {
+        case 'c': nchout = atoi(optarg); break;
+        case 'i': nchin = atoi(optarg); break;
+        case 'r': sr = atoi(optarg); break;
+        case 's': sleepblocks = atoi(optarg); break;
+        case 'v': voices = optarg; break;
+        case 'o': outfile = optarg; break;
+        default: pdc_usage();
+        }
+    }
+    if (optind != argc - 1)
+        pdc_usage();
+
+    libpd_set_printhook(pdc_print);
+    libpd_init();
+    conv_tilde_setup();
+    if (sleepblocks > 0)
+    {
+        libpd_start_message(1);
+        libpd_add_float(sleepblocks);
+        libpd_finish_message("pd", "dspsleep");
+    }
+    libpd_init_audio(nchin, nchout, sr);
+
+    if ((slash = strrchr(argv[optind], '/')))
+    {
+        snprintf(dir, MAXPDSTRING, "%.*s",
+            (int)(slash - argv[optind]), argv[optind]);
+        slash++;
+    }
+    else strcpy(dir, "."), slash = argv[optind];
+    if (!libpd_openfile(slash, dir))
+    {
+        fprintf(stderr, "pdc: %s: can't open\n", argv[optind]);
+        return (1);
+    }
+        /* as the kernel's voice allocator does: each voice of the [clone]
+        gets the hidden switch~ that puts it to sleep */
+    if (voices)
+    {
+        t_pd *clone = clone_find(gensym(voices));
+        if (!clone)
+        {
+            fprintf(stderr, "pdc: no [clone %s] in %s\n", voices,
+                argv[optind]);
+            return (1);
+        }
+        clone_setsleepable(clone, 1);
+    }
+    libpd_start_message(1);
+    libpd_add_float(1);
+    libpd_finish_message("pd", "dsp");
+
+    if (outfile && !(fd = fopen(outfile, "w")))
+    {
+        perror(outfile);
+        return (1);
+    }
+    pdc_write(fd, slash, nchout, nchin, sr, sleepblocks, voices);
+    if (fd != stdout)
+        fclose(fd);
+    return (0);
+}
@@ -0,0 +1,555 @@
+//
+// replay.cpp
+//
+// BarePD - Replay inputs recorded on the Pi (record=1) on the host
+// Runs the patch the way the kernel does and hands it the FUDI bytes,
+// MIDI events, floats and adc~ blocks of the recording before the same
+// Pd ticks as on the Pi. Each round loads the patch in a process of its
+// own, forked from libpd as it is after starting up, so that the seeds of
+// [noise~] and [random] don't carry over from the round before. The
+// output of every round must be the same, which is checked with a hash
+// of it (the exit status is 1 if it is not). Reports the time per tick
+// with its inputs, the best of all rounds, and the slowest ticks with
+// their time in the recording, so that an overload in the field can be
+// found and profiled (e.g. with perf).
+//
+//   pdreplay [-r rounds] [-d dspsleep] record.bpr patch.pd
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include "pd_record.h"
+#include "pd_fudi.h"
+#include "pd_preset.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern "C" {
+#include "z_libpd.h"
+#include "pd_conv.h"
+}
+
+#define SLOWEST		10	// ticks reported
+
+struct TRecording
+{
+	const u8	*pData;
+	size_t		 nSize;
+
+	unsigned	 nSampleRate;
+	unsigned	 nInChannels;
+	unsigned	 nOutChannels;
+};
+
+static double Now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void Print (const char *pMessage)
+{
+	fputs (pMessage, stderr);
+}
+
+static unsigned GetLE (const u8 *pData, unsigned nBytes)
+{
+	unsigned nValue = 0;
+	while (nBytes--)
+	{
+		nValue = nValue << 8 | pData[nBytes];
+	}
+
+	return nValue;
+}
+
+static void Load (const char *pPath, TRecording *pRecording)
+{
+	FILE *pFile = fopen (pPath, "rb");
+	if (pFile == 0)
+	{
+		fprintf (stderr, "pdreplay: %s: can't open\n", pPath);
+		exit (1);
+	}
+
+	fseek (pFile, 0, SEEK_END);
+	size_t nSize = ftell (pFile);
+	fseek (pFile, 0, SEEK_SET);
+
+	u8 *pData = (u8 *) malloc (nSize);
+	if (   pData == 0
+	    || fread (pData, 1, nSize, pFile) != nSize)
+	{
+		fprintf (stderr, "pdreplay: %s: can't read\n", pPath);
+		exit (1);
+	}
+	fclose (pFile);
+
+	if (   nSize < RECORD_HEADER_SIZE
+	    || memcmp (pData, "BPDR", 4) != 0
+	    || pData[4] != RECORD_FILE_VERSION)
+	{
+		fprintf (stderr, "pdreplay: %s: not a recording of this version\n", pPath);
+		exit (1);
+	}
+
+	unsigned nBlockSize = GetLE (pData + 10, 2);
+	if (nBlockSize != DEFDACBLKSIZE)
+	{
+		fprintf (stderr, "pdreplay: recorded with a block size of %u, "
+			 "run \"make clean\" and build with PD_BLOCKSIZE=%u\n", nBlockSize, nBlockSize);
+		exit (1);
+	}
+
+	pRecording->pData = pData;
+	pRecording->nSize = nSize;
+	pRecording->nSampleRate = GetLE (pData + 6, 4);
+	pRecording->nInChannels = pData[12];
+	pRecording->nOutChannels = pData[13];
+}
+
+// Preset recall, morphs and fades are done by the kernel (CPresetBank),
+// which is not part of the replay. Only the patch itself is searched, not
+// its abstractions.
+static boolean UsesPresets (const char *pPath)
+{
+	FILE *pFile = fopen (pPath, "rb");
+	if (pFile == 0)
+	{
+		return FALSE;
+	}
+
+	fseek (pFile, 0, SEEK_END);
+	size_t nSize = ftell (pFile);
+	fseek (pFile, 0, SEEK_SET);
+
+	boolean bFound = FALSE;
+	char *pText = (char *) malloc (nSize + 1);
+	if (   pText != 0
+	    && fread (pText, 1, nSize, pFile) == nSize)
+	{
+		pText[nSize] = '\0';
+		bFound = strstr (pText, PRESET_RECEIVER) != 0;
+	}
+
+	free (pText);
+	fclose (pFile);
+
+	return bFound;
+}
+
+// Hand the records stamped nTick to libpd, like the kernel did before
+// that tick. Returns FALSE at the end of the recording.
+static boolean Deliver (const TRecording *pRecording, size_t *pPos, unsigned nTick,
+			CFudiParser *pFudi, float *pInBuffer)
+{
+	size_t nPos = *pPos;
+	while (nPos + RECORD_ENTRY_SIZE <= pRecording->nSize)
+	{
+		const u8 *pEntry = pRecording->pData + nPos;
+		if (GetLE (pEntry, 4) > nTick)
+		{
+			break;
+		}
+
+		unsigned nLength = GetLE (pEntry + 6, 2);
+		const u8 *pPayload = pEntry + RECORD_ENTRY_SIZE;
+		if (nPos + RECORD_ENTRY_SIZE + nLength > pRecording->nSize)
+		{
+			break;
+		}
+		nPos += RECORD_ENTRY_SIZE + nLength;
+
+		switch (pEntry[4])
+		{
+		case RecordTypeFudi:
+			pFudi->ProcessBuffer ((const char *) pPayload, nLength);
+			break;
+
+		case RecordTypeMIDI:
+			if (nLength >= 2 && nLength <= 4)
+			{
+				t_libpd_midimsg Msg;
+				Msg.m_port = pPayload[0];
+				Msg.m_length = nLength - 1;
+				memset (Msg.m_data, 0, sizeof Msg.m_data);
+				memcpy (Msg.m_data, pPayload + 1, nLength - 1);
+				libpd_midi_batch (1, &Msg);
+			}
+			break;
+
+		case RecordTypeFloat:
+			if (nLength > sizeof (float))
+			{
+				float fValue;
+				memcpy (&fValue, pPayload, sizeof fValue);
+
+				char Receiver[MAXPDSTRING];
+				snprintf (Receiver, sizeof Receiver, "%.*s",
+					  (int) (nLength - sizeof fValue), pPayload + sizeof fValue);
+				libpd_float (Receiver, fValue);
+			}
+			break;
+
+		case RecordTypeADC:
+			if (nLength == DEFDACBLKSIZE * pRecording->nInChannels * sizeof (float))
+			{
+				memcpy (pInBuffer, pPayload, nLength);
+			}
+			break;
+
+		case RecordTypeEnd:
+			*pPos = nPos;
+			return FALSE;
+
+		default:
+			break;
+		}
+	}
+
+	*pPos = nPos;
+
+	return nPos + RECORD_ENTRY_SIZE <= pRecording->nSize;
+}
+
+// One round from a fresh load of the patch, returns the number of ticks
+static unsigned Run (const TRecording *pRecording, const char *pDir, const char *pFile,
+		     double *pTickTimes, unsigned nMaxTicks, u64 *pHash)
+{
+	void *pPatch = libpd_openfile (pFile, pDir);
+	if (pPatch == 0)
+	{
+		fprintf (stderr, "pdreplay: %s/%s: can't open\n", pDir, pFile);
+		exit (1);
+	}
+
+	libpd_start_message (1);
+	libpd_add_float (1);
+	libpd_finish_message ("pd", "dsp");
+
+	CFudiParser Fudi;
+
+	unsigned nInSamples = DEFDACBLKSIZE * pRecording->nInChannels;
+	unsigned nOutSamples = DEFDACBLKSIZE * pRecording->nOutChannels;
+	float *pInBuffer = (float *) calloc (nInSamples + 1, sizeof (float));
+	float *pOutBuffer = (float *) calloc (nOutSamples + 1, sizeof (float));
+
+	// FNV-1a of the output samples
+	u64 nHash = 0xCBF29CE484222325ULL;
+
+	size_t nPos = RECORD_HEADER_SIZE;
+	unsigned nTick = 0;
+	while (nTick < nMaxTicks)
+	{
+		// The messages take from the tick's time on the Pi too
+		double fStart = Now ();
+		if (!Deliver (pRecording, &nPos, nTick, &Fudi, pInBuffer))
+		{
+			break;
+		}
+
+		libpd_process_float (1, pInBuffer, pOutBuffer);
+		double fTime = Now () - fStart;
+
+		if (fTime < pTickTimes[nTick])
+		{
+			pTickTimes[nTick] = fTime;
+		}
+
+		const u8 *pOut = (const u8 *) pOutBuffer;
+		for (unsigned i = 0; i < nOutSamples * sizeof (float); i++)
+		{
+			nHash = (nHash ^ pOut[i]) * 0x100000001B3ULL;
+		}
+
+		memset (pInBuffer, 0, nInSamples * sizeof (float));
+		nTick++;
+	}
+
+	free (pInBuffer);
+	free (pOutBuffer);
+
+	libpd_start_message (1);
+	libpd_add_float (0);
+	libpd_finish_message ("pd", "dsp");
+	libpd_closefile (pPatch);
+
+	*pHash = nHash;
+
+	return nTick;
+}
+
+static boolean ReadAll (int nFD, void *pBuffer, size_t nSize)
+{
+	u8 *p = (u8 *) pBuffer;
+	while (nSize > 0)
+	{
+		ssize_t nRead = read (nFD, p, nSize);
+		if (nRead <= 0)
+		{
+			return FALSE;
+		}
+		p += nRead;
+		nSize -= nRead;
+	}
+
+	return TRUE;
+}
+
+static void WriteAll (int nFD, const void *pBuffer, size_t nSize)
+{
+	const u8 *p = (const u8 *) pBuffer;
+	while (nSize > 0)
+	{
+		ssize_t nWritten = write (nFD, p, nSize);
+		if (nWritten <= 0)
+		{
+			_exit (1);
+		}
+		p += nWritten;
+		nSize -= nWritten;
+	}
+}
+
+// Run() in a child process, which sends back the hash and the tick times.
+// The best time of each tick is kept in pTickTimes.
+static unsigned RunRound (const TRecording *pRecording, const char *pDir, const char *pFile,
+			  double *pTickTimes, unsigned nMaxTicks, u64 *pHash)
+{
+	size_t nTimesSize = (nMaxTicks + 1) * sizeof (double);
+	double *pTimes = (double *) malloc (nTimesSize);
+	for (unsigned i = 0; i <= nMaxTicks; i++)
+	{
+		pTimes[i] = 1e9;
+	}
+
+	int Pipe[2];
+	if (pipe (Pipe) != 0)
+	{
+		perror ("pdreplay: pipe");
+		exit (1);
+	}
+
+	fflush (stdout);
+	pid_t nChild = fork ();
+	if (nChild < 0)
+	{
+		perror ("pdreplay: fork");
+		exit (1);
+	}
+
+	if (nChild == 0)
+	{
+		close (Pipe[0]);
+
+		u64 nHash;
+		unsigned nTicks = Run (pRecording, pDir, pFile, pTimes, nMaxTicks, &nHash);
+
+		WriteAll (Pipe[1], &nHash, sizeof nHash);
+		WriteAll (Pipe[1], &nTicks, sizeof nTicks);
+		WriteAll (Pipe[1], pTimes, nTicks * sizeof (double));
+		_exit (0);
+	}
+
+	close (Pipe[1]);
+
+	unsigned nTicks = 0;
+	boolean bOK =    ReadAll (Pipe[0], pHash, sizeof *pHash)
+		      && ReadAll (Pipe[0], &nTicks, sizeof nTicks)
+		      && nTicks <= nMaxTicks
+		      && ReadAll (Pipe[0], pTimes, nTicks * sizeof (double));
+	close (Pipe[0]);
+
+	int nStatus;
+	waitpid (nChild, &nStatus, 0);
+	if (!bOK || !WIFEXITED (nStatus) || WEXITSTATUS (nStatus) != 0)
+	{
+		fprintf (stderr, "pdreplay: the replay failed (status %d)\n", nStatus);
+		exit (1);
+	}
+
+	for (unsigned i = 0; i < nTicks; i++)
+	{
+		if (pTimes[i] < pTickTimes[i])
+		{
+			pTickTimes[i] = pTimes[i];
+		}
+	}
+
+	free (pTimes);
+
+	return nTicks;
+}
+
+// The stamp of the end record, or of the last record of a recording that
+// was cut short
+static unsigned CountTicks (const TRecording *pRecording, boolean *pbComplete)
+{
+	unsigned nTicks = 0;
+	*pbComplete = FALSE;
+
+	size_t nPos = RECORD_HEADER_SIZE;
+	while (nPos + RECORD_ENTRY_SIZE <= pRecording->nSize)
+	{
+		const u8 *pEntry = pRecording->pData + nPos;
+		nTicks = GetLE (pEntry, 4);
+		if (pEntry[4] == RecordTypeEnd)
+		{
+			*pbComplete = TRUE;
+			break;
+		}
+
+		nPos += RECORD_ENTRY_SIZE + GetLE (pEntry + 6, 2);
+	}
+
+	return nTicks;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 3;
+	unsigned nDSPSleepBlocks = 0;
+
+	int nOption;
+	while ((nOption = getopt (argc, argv, "r:d:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'r':
+			nRounds = atoi (optarg);
+			break;
+
+		case 'd':
+			nDSPSleepBlocks = atoi (optarg);
+			break;
+
+		default:
+			nRounds = 0;
+			break;
+		}
+	}
+
+	if (nRounds == 0 || argc - optind != 2)
+	{
+		fprintf (stderr, "usage: pdreplay [-r rounds] [-d dspsleep] record.bpr patch.pd\n");
+		return 1;
+	}
+	const char *pRecordPath = argv[optind];
+	const char *pPatchPath = argv[optind + 1];
+
+	TRecording Recording;
+	Load (pRecordPath, &Recording);
+
+	boolean bComplete;
+	unsigned nTicks = CountTicks (&Recording, &bComplete);
+	if (!bComplete)
+	{
+		fprintf (stderr, "pdreplay: %s has no end, replaying up to the last input\n",
+			 pRecordPath);
+	}
+
+	char Dir[MAXPDSTRING] = ".";
+	const char *pFile = pPatchPath;
+	const char *pSlash = strrchr (pPatchPath, '/');
+	if (pSlash != 0)
+	{
+		snprintf (Dir, sizeof Dir, "%.*s", (int) (pSlash - pPatchPath), pPatchPath);
+		pFile = pSlash + 1;
+	}
+
+	if (UsesPresets (pPatchPath))
+	{
+		fprintf (stderr, "pdreplay: %s uses %s, presets are not recalled, "
+			 "morphed or faded in the replay\n", pPatchPath, PRESET_RECEIVER);
+	}
+
+	// Set up like the kernel
+	libpd_set_printhook (Print);
+	libpd_init ();
+	conv_tilde_setup ();
+	if (nDSPSleepBlocks > 0)
+	{
+		libpd_start_message (1);
+		libpd_add_float ((float) nDSPSleepBlocks);
+		libpd_finish_message ("pd", "dspsleep");
+	}
+	libpd_init_audio (Recording.nInChannels, Recording.nOutChannels, Recording.nSampleRate);
+
+	double *pTickTimes = (double *) malloc ((nTicks + 1) * sizeof (double));
+	for (unsigned i = 0; i <= nTicks; i++)
+	{
+		pTickTimes[i] = 1e9;
+	}
+
+	u64 nFirstHash = 0;
+	boolean bDeterministic = TRUE;
+	unsigned nReplayed = 0;
+	for (unsigned nRound = 0; nRound < nRounds; nRound++)
+	{
+		u64 nHash;
+		nReplayed = RunRound (&Recording, Dir, pFile, pTickTimes, nTicks, &nHash);
+
+		if (nRound == 0)
+		{
+			nFirstHash = nHash;
+		}
+		else if (nHash != nFirstHash)
+		{
+			fprintf (stderr, "pdreplay: round %u has a different output, "
+				 "the patch is not deterministic\n", nRound + 1);
+			bDeterministic = FALSE;
+		}
+	}
+
+	// The time of the audio a tick renders
+	double fBudget = (double) DEFDACBLKSIZE / Recording.nSampleRate;
+
+	double fTotal = 0;
+	unsigned nOverBudget = 0;
+	for (unsigned i = 0; i < nReplayed; i++)
+	{
+		fTotal += pTickTimes[i];
+		if (pTickTimes[i] > fBudget)
+		{
+			nOverBudget++;
+		}
+	}
+
+	printf ("%s: %u ticks of %d samples at %u Hz (%.1f s), best of %u rounds\n",
+		pRecordPath, nReplayed, DEFDACBLKSIZE, Recording.nSampleRate,
+		nReplayed * fBudget, nRounds);
+	printf ("  output hash  %016llx\n", (unsigned long long) nFirstHash);
+	printf ("  mean     %8.2f us/tick (%.1f%% of real time)\n",
+		nReplayed > 0 ? fTotal * 1e6 / nReplayed : 0.0,
+		nReplayed > 0 ? fTotal * 100 / (nReplayed * fBudget) : 0.0);
+	printf ("  over budget  %u ticks\n", nOverBudget);
+
+	printf ("  slowest ticks:\n");
+	for (unsigned nRank = 0; nRank < SLOWEST && nRank < nReplayed; nRank++)
+	{
+		unsigned nSlowest = 0;
+		for (unsigned i = 1; i < nReplayed; i++)
+		{
+			if (pTickTimes[i] > pTickTimes[nSlowest])
+			{
+				nSlowest = i;
+			}
+		}
+
+		printf ("    tick %8u at %8.3f s  %8.2f us\n",
+			nSlowest, nSlowest * fBudget, pTickTimes[nSlowest] * 1e6);
+		pTickTimes[nSlowest] = -1;
+	}
+
+	free (pTickTimes);
+	free ((void *) Recording.pData);
+
+	return bDeterministic ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+//
+// sfbench.cpp
+//
+// BarePD - Measure how fast soundfiler loads WAV files on the host
+// Writes 16 and 24-bit mono and stereo WAV files of noise to a temporary
+// directory, loads each into arrays with "soundfiler read -resize" and
+// reports the throughput next to that of just reading the file, so the
+// difference is the cost of converting the samples.
+//
+//   sfbench [seconds]
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+extern "C" {
+#include "z_libpd.h"
+}
+
+#define SAMPLERATE	48000
+#define ROUNDS		5
+#define READSIZE	1024		// like soundfiler's SAMPBUFSIZE
+
+static const char Patch[] =
+	"#N canvas 0 0 450 300 12;\n"
+	"#X array left 1 float 0;\n"
+	"#X array right 1 float 0;\n"
+	"#X obj 10 10 r sfbench;\n"
+	"#X obj 10 40 soundfiler;\n"
+	"#X connect 2 0 3 0;\n";
+
+static double Now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void Print (const char *pMessage)
+{
+	fputs (pMessage, stderr);
+}
+
+static void PutLE (FILE *pFile, unsigned nValue, unsigned nBytes)
+{
+	while (nBytes--)
+	{
+		fputc (nValue & 0xFF, pFile);
+		nValue >>= 8;
+	}
+}
+
+// Write nFrames of noise as a PCM WAV file, return its size in bytes
+static size_t WriteWave (const char *pPath, unsigned nChannels, unsigned nBytes, unsigned nFrames)
+{
+	FILE *pFile = fopen (pPath, "wb");
+	if (pFile == 0)
+	{
+		fprintf (stderr, "sfbench: %s: can't create\n", pPath);
+		exit (1);
+	}
+
+	unsigned nDataSize = nFrames * nChannels * nBytes;
+	fputs ("RIFF", pFile);
+	PutLE (pFile, 36 + nDataSize, 4);
+	fputs ("WAVEfmt ", pFile);
+	PutLE (pFile, 16, 4);
+	PutLE (pFile, 1, 2);
+	PutLE (pFile, nChannels, 2);
+	PutLE (pFile, SAMPLERATE, 4);
+	PutLE (pFile, SAMPLERATE * nChannels * nBytes, 4);
+	PutLE (pFile, nChannels * nBytes, 2);
+	PutLE (pFile, nBytes * 8, 2);
+	fputs ("data", pFile);
+	PutLE (pFile, nDataSize, 4);
+
+	unsigned nSeed = 1;
+	for (unsigned i = 0; i < nFrames * nChannels; i++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		PutLE (pFile, nSeed >> 8, nBytes);
+	}
+
+	fclose (pFile);
+
+	return 44 + nDataSize;
+}
+
+// Time reading the file in soundfiler's chunks, without converting
+static double ReadRaw (const char *pPath)
+{
+	char Buffer[READSIZE];
+
+	double fStart = Now ();
+	int fd = open (pPath, O_RDONLY);
+	while (read (fd, Buffer, sizeof Buffer) > 0)
+	{
+	}
+	close (fd);
+
+	return Now () - fStart;
+}
+
+static double ReadSoundfiler (const char *pPath, unsigned nChannels)
+{
+	double fStart = Now ();
+	libpd_start_message (4);
+	libpd_add_symbol ("-resize");
+	libpd_add_symbol (pPath);
+	libpd_add_symbol ("left");
+	if (nChannels > 1)
+	{
+		libpd_add_symbol ("right");
+	}
+	libpd_finish_message ("sfbench", "read");
+
+	return Now () - fStart;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nSeconds = argc > 1 ? atoi (argv[1]) : 60;
+	if (nSeconds == 0)
+	{
+		fprintf (stderr, "usage: sfbench [seconds]\n");
+		return 1;
+	}
+
+	char Dir[] = "/tmp/sfbenchXXXXXX";
+	if (mkdtemp (Dir) == 0)
+	{
+		perror ("sfbench");
+		return 1;
+	}
+
+	char PatchPath[sizeof Dir + 16];
+	snprintf (PatchPath, sizeof PatchPath, "%s/sfbench.pd", Dir);
+	FILE *pFile = fopen (PatchPath, "w");
+	fputs (Patch, pFile);
+	fclose (pFile);
+
+	libpd_set_printhook (Print);
+	libpd_init ();
+	void *pPatch = libpd_openfile ("sfbench.pd", Dir);
+	if (pPatch == 0)
+	{
+		fprintf (stderr, "sfbench: can't open %s\n", PatchPath);
+		return 1;
+	}
+
+	printf ("%u s at %u Hz, best of %u, MB/s of file\n", nSeconds, SAMPLERATE, ROUNDS);
+	printf ("  format           read  soundfiler\n");
+
+	static const struct { unsigned nChannels, nBytes; } Formats[] =
+		{{1, 2}, {2, 2}, {1, 3}, {2, 3}};
+	for (unsigned f = 0; f < sizeof Formats / sizeof Formats[0]; f++)
+	{
+		unsigned nChannels = Formats[f].nChannels;
+		unsigned nBytes = Formats[f].nBytes;
+
+		char Path[sizeof Dir + 32];
+		snprintf (Path, sizeof Path, "%s/%u-%u.wav", Dir, nBytes * 8, nChannels);
+		double fMB = WriteWave (Path, nChannels, nBytes, nSeconds * SAMPLERATE) / 1e6;
+
+		// Alternate the two and keep the best of each
+		double fRaw = 0, fSoundfiler = 0;
+		for (unsigned nRound = 0; nRound < ROUNDS; nRound++)
+		{
+			double fTime = ReadRaw (Path);
+			if (nRound == 0 || fTime < fRaw)
+			{
+				fRaw = fTime;
+			}
+
+			fTime = ReadSoundfiler (Path, nChannels);
+			if (nRound == 0 || fTime < fSoundfiler)
+			{
+				fSoundfiler = fTime;
+			}
+		}
+
+		printf ("  %2u-bit %-6s %8.0f  %10.0f\n", nBytes * 8,
+			nChannels == 1 ? "mono" : "stereo", fMB / fRaw, fMB / fSoundfiler);
+
+		unlink (Path);
+	}
+
+	libpd_closefile (pPatch);
+	unlink (PatchPath);
+	rmdir (Dir);
+
+	return 0;
+}
@@ -0,0 +1,450 @@
+//
+// test.cpp
+//
+// BarePD - Regression tests for the BarePD changes to libpd, on the host
+// Each test runs a patch from the tests directory the way the kernel does
+// and checks what comes out of it.
+//
+//   pdtest [tests directory]
+//
+// Copyright (C) 2024 Daniel Górny <PlayableElectronics>
+// Licensed under GPLv3
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pd_fudi.h"
+#include "pd_preset.h"
+
+extern "C" {
+#include "z_libpd.h"
+#include "pd_conv.h"
+}
+
+#define SAMPLERATE	48000
+#define OUTCHANNELS	2
+
+#define SORT_TICKS	20
+
+#define STACK_DIRT	0x10000		// bytes of stack filled with garbage
+
+static float s_fFudiResult;
+static float s_fPresetA, s_fPresetB;
+static char s_PresetSymbol[MAXPDSTRING];
+
+static const char *s_pDir = "tests";
+
+static void Print (const char *pMessage)
+{
+	fputs (pMessage, stderr);
+}
+
+static void FloatHook (const char *pReceiver, float fValue)
+{
+	if (strcmp (pReceiver, "fudi-result") == 0)
+	{
+		s_fFudiResult += fValue;
+	}
+	else if (strcmp (pReceiver, "preset-a") == 0)
+	{
+		s_fPresetA = fValue;
+	}
+	else if (strcmp (pReceiver, "preset-b") == 0)
+	{
+		s_fPresetB = fValue;
+	}
+}
+
+static void SymbolHook (const char *pReceiver, const char *pSymbol)
+{
+	if (strcmp (pReceiver, "preset-sym") == 0)
+	{
+		snprintf (s_PresetSymbol, sizeof s_PresetSymbol, "%s", pSymbol);
+	}
+}
+
+// Leave garbage where the next test's locals will be, as on the Pi, where
+// nothing is cleared before the kernel's objects are constructed
+static void DirtyStack (void)
+{
+	volatile unsigned char Dirt[STACK_DIRT];
+	for (unsigned i = 0; i < sizeof Dirt; i++)
+	{
+		Dirt[i] = 0xA5;
+	}
+}
+
+static void SendDSP (float fOn)
+{
+	libpd_start_message (1);
+	libpd_add_float (fOn);
+	libpd_finish_message ("pd", "dsp");
+}
+
+static void SendDSPSleep (float fBlocks)
+{
+	libpd_start_message (1);
+	libpd_add_float (fBlocks);
+	libpd_finish_message ("pd", "dspsleep");
+}
+
+static void SendRecursiveSort (float fOn)
+{
+	libpd_start_message (1);
+	libpd_add_float (fOn);
+	libpd_finish_message ("pd", "recursivesort");
+}
+
+static void *Open (const char *pFile)
+{
+	void *pPatch = libpd_openfile (pFile, s_pDir);
+	if (pPatch == 0)
+	{
+		fprintf (stderr, "pdtest: %s/%s: can't open\n", s_pDir, pFile);
+		exit (1);
+	}
+
+	SendDSP (1);
+
+	return pPatch;
+}
+
+static void Close (void *pPatch)
+{
+	SendDSP (0);
+	libpd_closefile (pPatch);
+}
+
+// Run nTicks, returns the peak of the output
+static float Process (unsigned nTicks, float *pOutput = 0)
+{
+	float Buffer[DEFDACBLKSIZE * OUTCHANNELS];
+	float fPeak = 0;
+
+	for (unsigned nTick = 0; nTick < nTicks; nTick++)
+	{
+		libpd_process_float (1, 0, Buffer);
+
+		for (unsigned i = 0; i < DEFDACBLKSIZE * OUTCHANNELS; i++)
+		{
+			float fValue = Buffer[i] < 0 ? -Buffer[i] : Buffer[i];
+			if (fValue > fPeak)
+			{
+				fPeak = fValue;
+			}
+		}
+
+		if (pOutput != 0)
+		{
+			memcpy (pOutput, Buffer, sizeof Buffer);
+			pOutput += DEFDACBLKSIZE * OUTCHANNELS;
+		}
+	}
+
+	return fPeak;
+}
+
+// A subpatch reading a delay line written outside must not fall asleep
+// for good when the delay line goes silent for a while
+static bool TestSleepDelay (void)
+{
+	SendDSPSleep (4);
+	void *pPatch = Open ("sleep_delay.pd");
+
+	float fSilent = Process (20);
+	libpd_float ("sleep-gate", 1);
+	float fPeak = Process (20);
+
+	Close (pPatch);
+	SendDSPSleep (0);
+
+	return fSilent == 0 && fPeak > 0.5f;
+}
+
+// A subpatch driven by an [r] inside it has to stay awake, as messages
+// to the [r] don't come through an inlet and wouldn't wake it
+static bool TestSleepReceive (void)
+{
+	SendDSPSleep (4);
+	void *pPatch = Open ("sleep_receive.pd");
+
+	float fSilent = Process (20);
+	libpd_float ("sleep-level", 1);
+	float fPeak = Process (20);
+
+	Close (pPatch);
+	SendDSPSleep (0);
+
+	return fSilent == 0 && fPeak > 0.5f;
+}
+
+// A [delay] going off in a sleeping subpatch wakes it up (after 100 ms,
+// 75 blocks)
+static bool TestSleepClock (void)
+{
+	SendDSPSleep (4);
+	void *pPatch = Open ("sleep_clock.pd");
+
+	float fSilent = Process (70);
+	Process (10);
+	float fPeak = Process (20);
+
+	Close (pPatch);
+	SendDSPSleep (0);
+
+	return fSilent == 0 && fPeak > 0.5f;
+}
+
+static void SendConvSet (const char *pArray)
+{
+	libpd_start_message (1);
+	libpd_add_symbol (pArray);
+	libpd_finish_message ("conv-cmd", "set");
+}
+
+// [conv~] set to an array that doesn't exist while DSP runs is silent,
+// and comes back with the next good array
+static bool TestConvSet (void)
+{
+	void *pPatch = Open ("conv_set.pd");
+
+	float fBefore = Process (10);
+	SendConvSet ("nosuch");
+	float fMissing = Process (10);
+	SendConvSet ("conv-ir");
+	float fAfter = Process (10);
+
+	Close (pPatch);
+
+	return fBefore > 0.5f && fMissing == 0 && fAfter > 0.5f;
+}
+
+// Loading compact samples into an array that [tabreceive~] and [tabosc4~]
+// read as floats converts them back while the DSP chain is rebuilt, not in
+// the next tick, and after they are loaded (the file holds 259 x 0.5)
+static bool TestCompactExpand (void)
+{
+	void *pPatch = Open ("compact.pd");
+
+	libpd_start_message (5);
+	libpd_add_symbol ("-compact");
+	libpd_add_float (16);
+	libpd_add_symbol ("compact.wav");
+	libpd_add_symbol ("compact-table");
+	libpd_finish_message ("compact-load", "read");
+
+	int nSize = libpd_arraysize ("compact-table");
+	float fSample = 0;
+	libpd_read_array (&fSample, "compact-table", 100, 1);
+	float fPeak = Process (4);
+
+	Close (pPatch);
+
+	return nSize == 259 && fSample == 0.5f && fPeak == 0.5f;
+}
+
+// Arguments below 0 are left out
+static void SendPreset (const char *pMessage, float fArg1, float fArg2 = -1, float fArg3 = -1)
+{
+	libpd_start_message (3);
+	libpd_add_float (fArg1);
+	if (fArg2 >= 0)
+	{
+		libpd_add_float (fArg2);
+	}
+	if (fArg3 >= 0)
+	{
+		libpd_add_float (fArg3);
+	}
+	libpd_finish_message (PRESET_RECEIVER, pMessage);
+}
+
+static void SetPresetValues (float fA, float fB, const char *pSymbol)
+{
+	libpd_float ("preset-a", fA);
+	libpd_float ("preset-b", fB);
+	libpd_symbol ("preset-sym", pSymbol);
+}
+
+// Store, recall and morph, and the presets file written and loaded again.
+// All slots and presets are used, the others holding symbols of the
+// longest length, so that the file is as large as it gets (about 4 MB).
+static bool TestPresets (void)
+{
+	char Dir[] = "/tmp/pdtest-XXXXXX";
+	if (mkdtemp (Dir) == nullptr)
+	{
+		return false;
+	}
+	CFATFileSystem FileSystem (Dir);
+
+	static char Receivers[PRESET_MAX_SLOTS * 16];
+	strcpy (Receivers, "preset-a,preset-b,preset-sym");
+	for (unsigned i = 3; i < PRESET_MAX_SLOTS; i++)
+	{
+		sprintf (Receivers + strlen (Receivers), ",preset-big-%u", i);
+	}
+
+	char Long[256];
+	memset (Long, 'x', 255);
+	Long[255] = '\0';
+
+	void *pReceiverA = libpd_bind ("preset-a");
+	void *pReceiverB = libpd_bind ("preset-b");
+	void *pReceiverSym = libpd_bind ("preset-sym");
+
+	CPresetBank *pBank = new CPresetBank;
+	bool bOK = pBank->Initialize (Receivers, nullptr, &FileSystem);
+
+	for (unsigned i = 3; i < PRESET_MAX_SLOTS; i++)
+	{
+		char Name[32];
+		sprintf (Name, "preset-big-%u", i);
+		libpd_symbol (Name, Long);
+	}
+	SetPresetValues (1, 10, "one");
+	SendPreset ("store", 0);
+	SetPresetValues (3, 30, "two");
+	for (unsigned i = 1; i < PRESET_MAX_PRESETS; i++)
+	{
+		SendPreset ("store", i);
+	}
+
+	SendPreset ("recall", 0);
+	bOK = bOK && s_fPresetA == 1 && s_fPresetB == 10 && strcmp (s_PresetSymbol, "one") == 0;
+	SendPreset ("morph", 0, 1, 0.5f);
+	bOK = bOK && s_fPresetA == 2 && s_fPresetB == 20 && strcmp (s_PresetSymbol, "two") == 0;
+
+	// Written once no store followed for a while
+	usleep ((PRESET_SAVE_DELAY_MS + 100) * 1000);
+	pBank->Update ();
+	delete pBank;
+
+	char Path[64];
+	snprintf (Path, sizeof Path, "%s/%s", Dir, PRESET_FILE_NAME);
+	struct stat File;
+	bOK = bOK && stat (Path, &File) == 0 && File.st_size > 4000000;
+
+	SetPresetValues (0, 0, "none");
+	pBank = new CPresetBank;
+	bOK = bOK && pBank->Initialize (Receivers, nullptr, &FileSystem);
+	SendPreset ("recall", PRESET_MAX_PRESETS - 1);
+	bOK = bOK && s_fPresetA == 3 && s_fPresetB == 30 && strcmp (s_PresetSymbol, "two") == 0;
+	delete pBank;
+
+	libpd_unbind (pReceiverA);
+	libpd_unbind (pReceiverB);
+	libpd_unbind (pReceiverSym);
+
+	unlink (Path);
+	rmdir (Dir);
+
+	return bOK;
+}
+
+// The DSP chain must come out in the order of vanilla Pd's recursive sort.
+// osc~ feeds both [*~ 1] and the [*~] before vd~, so whether [*~ 1] and
+// delwrite~ are scheduled before or after the [*~] decides how vd~ reads
+// the delay line.
+static bool TestSortOrder (void)
+{
+	static float Iterative[SORT_TICKS * DEFDACBLKSIZE * OUTCHANNELS];
+	static float Recursive[SORT_TICKS * DEFDACBLKSIZE * OUTCHANNELS];
+
+	void *pPatch = Open ("sort_fanout.pd");
+	float fPeak = Process (SORT_TICKS, Iterative);
+	Close (pPatch);
+
+	SendRecursiveSort (1);
+	pPatch = Open ("sort_fanout.pd");
+	Process (SORT_TICKS, Recursive);
+	Close (pPatch);
+	SendRecursiveSort (0);
+
+	return fPeak > 0 && memcmp (Iterative, Recursive, sizeof Iterative) == 0;
+}
+
+// The FUDI parser as the kernel has it, a member of the CKernel on main()'s
+// stack
+static bool TestFudi (void)
+{
+	static const char Messages[] = "fudi-test 440;\nfudi-test 1;\r\n";
+
+	void *pPatch = Open ("fudi.pd");
+	void *pReceiver = libpd_bind ("fudi-result");
+	s_fFudiResult = 0;
+
+	CFudiParser Fudi;
+	unsigned nMessages = Fudi.ProcessBuffer (Messages, sizeof Messages - 1);
+
+	libpd_unbind (pReceiver);
+	Close (pPatch);
+
+	return nMessages == 2 && s_fFudiResult == 443;
+}
+
+static const struct
+{
+	const char	*pName;
+	bool		(*pTest) (void);
+}
+Tests[] =
+{
+	{"sleep_delay",		TestSleepDelay},
+	{"sleep_receive",	TestSleepReceive},
+	{"sleep_clock",		TestSleepClock},
+	{"sort_order",		TestSortOrder},
+	{"fudi",		TestFudi},
+	{"conv_set",		TestConvSet},
+	{"compact_expand",	TestCompactExpand},
+	{"presets",		TestPresets},
+};
+
+int main (int argc, char **argv)
+{
+	if (argc > 2)
+	{
+		fprintf (stderr, "usage: pdtest [tests directory]\n");
+		return 1;
+	}
+	if (argc == 2)
+	{
+		s_pDir = argv[1];
+	}
+
+	// Set up like the kernel
+	libpd_set_printhook (Print);
+	libpd_set_floathook (FloatHook);
+	libpd_set_symbolhook (SymbolHook);
+	libpd_init ();
+	conv_tilde_setup ();
+	libpd_init_audio (0, OUTCHANNELS, SAMPLERATE);
+
+	unsigned nFailed = 0;
+	for (unsigned i = 0; i < sizeof Tests / sizeof Tests[0]; i++)
+	{
+		// Named first, in case it crashes
+		printf ("%-20s ", Tests[i].pName);
+		fflush (stdout);
+
+		DirtyStack ();
+		bool bOK = (*Tests[i].pTest) ();
+		printf ("%s\n", bOK ? "ok" : "FAILED");
+		if (!bOK)
+		{
+			nFailed++;
+		}
+	}
+
+	if (nFailed > 0)
+	{
+		printf ("%u of %u tests failed\n", nFailed, (unsigned) (sizeof Tests / sizeof Tests[0]));
+
+		return 1;
+	}
+
+	return 0;
+}